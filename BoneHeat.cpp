@@ -0,0 +1,174 @@
+/**
+  * Bone heat weights.
+  *
+  */
+
+#include "BoneHeat.h"
+
+#include <cmath>
+#include <cfloat>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#ifdef __SSE2__
+#include <pmmintrin.h>
+#endif
+
+// Weights below this are not stored
+static const float MIN_HEAT_WEIGHT = 1e-3f;
+
+// Solver settings: relative residual and iteration cap per bone
+static const double HEAT_TOLERANCE = 1e-4;
+static const int HEAT_MAX_ITERATIONS = 2000;
+
+// Distance from p to the segment [a, b]
+static double segmentDistance(const Vector3 & a, const Vector3 & b, const Vector3 & p)
+{
+	Vector3 v = b - a;
+	Vector3 w = p - a;
+	double c1 = w.dot(v);
+	if(c1 <= 0)
+		return w.length();
+	double c2 = v.dot(v);
+	if(c2 <= c1)
+		return (p - b).length();
+	return (p - (a + v * (c1 / c2))).length();
+}
+
+//////////////////////////////////////////////////
+// Build (M H - L) once, then solve one right-hand side per bone
+//////////////////////////////////////////////////
+
+void computeBoneHeatWeights(const TriangleMesh & mesh,
+                            const std::vector<Vector3> & boneHeads,
+                            const std::vector<Vector3> & boneTails,
+                            InfluenceTable & influences,
+                            int threadCount,
+                            BoneHeatStats * stats)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	int n = mesh.vertices.size();
+	int boneCount = n_min((int)boneHeads.size(), (int)InfluenceTable::MAX_BONES);
+	influences.clear();
+	if(n == 0 || boneCount == 0)
+		return;
+
+	// distances below 1e-3 of the mesh size count as 1e-3 (vertex on a bone)
+	Vector3 lo = mesh.vertices[0], hi = mesh.vertices[0];
+	for(int i=0; i<n; i++)
+		for(int c=0; c<3; c++)
+		{
+			lo[c] = n_min(lo[c], mesh.vertices[i][c]);
+			hi[c] = n_max(hi[c], mesh.vertices[i][c]);
+		}
+	double minDistance = 1e-3 * (hi - lo).length();
+
+	// nearest bone(s) of each vertex: heat H and the bones sharing it
+	std::vector<double> heat(n);
+	std::vector<unsigned int> nearestOffsets(n+1, 0);
+	std::vector<InfluenceTable::BoneIndex> nearestBones;
+	std::vector<double> distances(boneCount);
+	for(int i=0; i<n; i++)
+	{
+		double nearest = DBL_MAX;
+		for(int b=0; b<boneCount; b++)
+		{
+			distances[b] = segmentDistance(boneHeads[b], boneTails[b], mesh.vertices[i]);
+			nearest = n_min(nearest, distances[b]);
+		}
+		for(int b=0; b<boneCount; b++)
+			if(distances[b] <= nearest * (1 + 1e-6))
+				nearestBones.push_back(b);
+		nearestOffsets[i+1] = nearestBones.size();
+		nearest = n_max(nearest, minDistance);
+		heat[i] = 1.0 / (nearest * nearest);
+	}
+
+	// A = M H - L (symmetric positive definite), shared by all bones
+	SparseMatrix A;
+	std::vector<double> areas;
+	mesh.cotangentLaplacian(A, areas);
+	for(int i=0; i<n; i++)
+		for(unsigned int k=A.offsets[i]; k<A.offsets[i+1]; k++)
+		{
+			A.values[k] = -A.values[k];
+			if(A.columns[k] == i)
+				A.values[k] += areas[i] * heat[i];
+		}
+	SparseMatrix factor;
+	A.incompleteCholesky(factor);
+
+	// columns[b]: (vertex, weight) of bone b above the threshold
+	std::vector<std::vector<std::pair<unsigned int,float> > > columns(boneCount);
+	std::vector<int> iterations(boneCount, 0);
+	std::atomic<int> nextBone(0);
+
+	if(threadCount <= 0)
+		threadCount = std::thread::hardware_concurrency();
+	threadCount = n_max(1, n_min(threadCount, boneCount));
+
+	std::vector<std::thread> workers;
+	for(int t=0; t<threadCount; t++)
+		workers.push_back(std::thread([&]() {
+#ifdef __SSE2__
+			// heat decays exponentially along the surface; its far tail is
+			// denormal and would slow every CG step down, so flush it to 0
+			_MM_SET_FLUSH_ZERO_MODE(_MM_FLUSH_ZERO_ON);
+			_MM_SET_DENORMALS_ZERO_MODE(_MM_DENORMALS_ZERO_ON);
+#endif
+			std::vector<double> rhs(n), x(n);
+			for(int b = nextBone++; b < boneCount; b = nextBone++)
+			{
+				// p_b, also the initial guess (the solution is close to it near the bone)
+				for(int i=0; i<n; i++)
+				{
+					double p = 0;
+					int shared = nearestOffsets[i+1] - nearestOffsets[i];
+					for(unsigned int k=nearestOffsets[i]; k<nearestOffsets[i+1]; k++)
+						if(nearestBones[k] == b)
+							p = 1.0 / shared;
+					rhs[i] = areas[i] * heat[i] * p;
+					x[i] = p;
+				}
+				iterations[b] = A.solvePCG(factor, &rhs[0], &x[0], HEAT_TOLERANCE, HEAT_MAX_ITERATIONS);
+				for(int i=0; i<n; i++)
+					if(x[i] > MIN_HEAT_WEIGHT)
+						columns[b].push_back(std::make_pair((unsigned int)i, (float)n_min(x[i], 1.0)));
+			}
+		}));
+	for(int t=0; t<threadCount; t++)
+		workers[t].join();
+
+	// transpose the bone columns into vertex rows
+	std::vector<unsigned int> offsets(n+1, 0);
+	for(int b=0; b<boneCount; b++)
+		for(int k=0; k<columns[b].size(); k++)
+			offsets[columns[b][k].first+1]++;
+	for(int i=0; i<n; i++)
+		offsets[i+1] += offsets[i];
+	std::vector<unsigned int> fill(offsets.begin(), offsets.end()-1);
+	influences.bones.resize(offsets[n]);
+	influences.weights.resize(offsets[n]);
+	for(int b=0; b<boneCount; b++)
+		for(int k=0; k<columns[b].size(); k++)
+		{
+			unsigned int slot = fill[columns[b][k].first]++;
+			influences.bones[slot] = b;
+			influences.weights[slot] = columns[b][k].second;
+		}
+	influences.offsets = offsets;
+
+	if(stats)
+	{
+		stats->vertices = n;
+		stats->bones = boneCount;
+		stats->threads = threadCount;
+		stats->iterations = stats->maxIterations = 0;
+		for(int b=0; b<boneCount; b++)
+		{
+			stats->iterations += iterations[b];
+			stats->maxIterations = n_max(stats->maxIterations, iterations[b]);
+		}
+		stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+}
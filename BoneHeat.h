@@ -0,0 +1,46 @@
+/**
+  * Bone heat weights (Baran and Popovic, "Automatic Rigging and Animation
+  * of 3D Characters", 2007).
+  *
+  * The weights of bone b are the equilibrium of heat diffusing over the
+  * surface from the vertices for which b is the nearest bone:
+  *
+  *   (M H - L) w_b = M H p_b
+  *
+  * with L the cotangent Laplacian, M the lumped vertex areas, H(j,j) =
+  * 1 / d(j)^2 for d(j) the distance from vertex j to its nearest bone,
+  * and p_b(j) = 1 if b is that bone (shared among equally near bones).
+  * Unlike nearest-bone weights, heat does not jump across gaps between
+  * limbs, since it only travels along the surface. There is no
+  * visibility test: every vertex is heated by its nearest bone.
+  *
+  * The matrix does not depend on the bone, so it and its preconditioner
+  * (an incomplete Cholesky factor) are built once; the bones are then
+  * solved concurrently by conjugate gradient, each thread taking the next
+  * unsolved bone.
+  */
+
+#ifndef BONE_HEAT_H
+#define BONE_HEAT_H
+
+#include <vector>
+#include "Skinning.h"
+
+struct BoneHeatStats
+{
+	int vertices, bones, threads;
+	int iterations, maxIterations;    // total and worst bone
+	double seconds;
+};
+
+// Bind mesh to the bone segments [boneHeads[b], boneTails[b]]. Weights
+// above a small threshold are stored unnormalized (they sum to about 1);
+// run pruneInfluences() afterwards. threadCount 0 uses every core.
+void computeBoneHeatWeights(const TriangleMesh & mesh,
+                            const std::vector<Vector3> & boneHeads,
+                            const std::vector<Vector3> & boneTails,
+                            InfluenceTable & influences,
+                            int threadCount = 0,
+                            BoneHeatStats * stats = 0);
+
+#endif // BONE_HEAT_H
@@ -0,0 +1,90 @@
+/**
+  * Double-buffered frame pipeline.
+  *
+  */
+
+#include "FramePipeline.h"
+
+FramePipeline::FramePipeline() :
+    busy(false),
+    quit(false)
+{
+}
+
+FramePipeline::~FramePipeline()
+{
+	stop();
+}
+
+// Spawn the worker
+void FramePipeline::start(const Job & newJob)
+{
+	stop();
+	job = newJob;
+	busy = false;
+	quit = false;
+	worker = std::thread(&FramePipeline::run, this);
+}
+
+// Finish the frame in flight and join the worker
+void FramePipeline::stop()
+{
+	if(!worker.joinable())
+		return;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+	worker.join();
+	busy = false;
+}
+
+// Start computing the frame at time
+void FramePipeline::submit(double time)
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		if(busy || !worker.joinable())
+			return;
+		back.time = time;
+		busy = true;
+	}
+	wake.notify_all();
+}
+
+// Wait for the frame in flight and swap it with frame
+bool FramePipeline::retrieve(Frame & frame)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	if(!busy)
+		return false;
+	while(busy)
+		wake.wait(lock);
+	std::swap(frame.time, back.time);
+	frame.vertices.swap(back.vertices);
+	frame.bones.swap(back.bones);
+	return true;
+}
+
+// Worker loop: wait for a submitted frame, compute it, hand it back
+void FramePipeline::run()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	for(;;)
+	{
+		while(!busy && !quit)
+			wake.wait(lock);
+		if(busy)
+		{
+			// back is owned by the worker until busy is cleared
+			lock.unlock();
+			job(back);
+			lock.lock();
+			busy = false;
+			wake.notify_all();
+		}
+		if(quit)
+			return;
+	}
+}
@@ -0,0 +1,70 @@
+/**
+  * Double-buffered frame pipeline: a worker thread computes the pose and
+  * the skinned vertices of frame N+1 while the main thread draws frame N.
+  *
+  * Usage, once per displayed frame:
+  *   pipeline.retrieve(frame);   // wait for the frame started last time
+  *   pipeline.submit(time);      // start the next one on the worker
+  *   ... draw frame ...
+  *
+  * The handoff is explicit (retrieve swaps buffers with the caller, so no
+  * data is shared while the worker runs) and at most one frame is in
+  * flight, so the drawn result is never more than one frame late.
+  */
+
+#ifndef FRAME_PIPELINE_H
+#define FRAME_PIPELINE_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include "Skinning.h"
+
+class FramePipeline
+{
+public:
+	// Result of one frame
+	struct Frame
+	{
+		double time;
+		std::vector<Vector3> vertices;     // deformed mesh
+		std::vector<_matrix34> bones;      // posed bone matrices
+	};
+
+	// Computes frame.vertices and frame.bones for frame.time (worker thread)
+	typedef std::function<void(Frame & frame)> Job;
+
+	FramePipeline();
+	~FramePipeline();
+
+	// Spawn the worker; job must only touch data owned by the job or
+	// left unchanged until stop()
+	void start(const Job & job);
+
+	// Finish the frame in flight and join the worker
+	void stop();
+
+	bool running() const { return worker.joinable(); }
+
+	// Start computing the frame at time (does nothing if one is in flight)
+	void submit(double time);
+
+	// Wait for the frame in flight and swap it with frame.
+	// Returns false if no frame was submitted.
+	bool retrieve(Frame & frame);
+
+private:
+	void run();
+
+	std::thread worker;
+	std::mutex mutex;
+	std::condition_variable wake;
+	Job job;
+	Frame back;              // written by the worker only while busy
+	bool busy;               // a frame is in flight
+	bool quit;
+};
+
+#endif // FRAME_PIPELINE_H
@@ -0,0 +1,842 @@
+/**
+  * Binary glTF reader and its JSON parser.
+  *
+  */
+
+#include "GLBFile.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const unsigned int GLB_MAGIC = 0x46546C67;       // "glTF"
+static const unsigned int CHUNK_JSON = 0x4E4F534A;
+static const unsigned int CHUNK_BIN = 0x004E4942;
+static const int MAX_DEPTH = 256;
+
+enum { BYTE = 5120, UNSIGNED_BYTE = 5121, SHORT = 5122, UNSIGNED_SHORT = 5123, UNSIGNED_INT = 5125, FLOAT = 5126 };
+
+//////////////////////////////////////////////////
+// JSON
+//////////////////////////////////////////////////
+
+namespace {
+
+class JsonParser
+{
+public:
+	JsonParser(const char * text, size_t length) : p(text), end(text + length) {}
+
+	bool parseDocument(JsonValue & value)
+	{
+		if(!parseValue(value, 0))
+			return false;
+		skipSpace();
+		return p == end || fail("trailing characters");
+	}
+
+private:
+	const char * p;
+	const char * end;
+
+	bool fail(const char * what)
+	{
+		printf("JSON: %s\n", what);
+		return false;
+	}
+
+	void skipSpace()
+	{
+		while(p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+			p++;
+	}
+
+	bool literal(const char * word)
+	{
+		size_t n = strlen(word);
+		if(end - p < n || strncmp(p, word, n) != 0)
+			return false;
+		p += n;
+		return true;
+	}
+
+	bool parseValue(JsonValue & value, int depth)
+	{
+		if(depth > MAX_DEPTH)
+			return fail("nesting too deep");
+		skipSpace();
+		if(p == end)
+			return fail("unexpected end");
+		value = JsonValue();
+		switch(*p)
+		{
+		case '{':
+			value.type = JsonValue::OBJECT;
+			p++;
+			skipSpace();
+			if(p < end && *p == '}')
+			{
+				p++;
+				return true;
+			}
+			for(;;)
+			{
+				value.members.push_back(std::make_pair(std::string(), JsonValue()));
+				skipSpace();
+				if(!parseString(value.members.back().first))
+					return false;
+				skipSpace();
+				if(p == end || *p++ != ':')
+					return fail("expected ':'");
+				if(!parseValue(value.members.back().second, depth + 1))
+					return false;
+				skipSpace();
+				if(p < end && *p == ',')
+					p++;
+				else if(p < end && *p == '}')
+				{
+					p++;
+					return true;
+				}
+				else
+					return fail("expected ',' or '}'");
+			}
+		case '[':
+			value.type = JsonValue::ARRAY;
+			p++;
+			skipSpace();
+			if(p < end && *p == ']')
+			{
+				p++;
+				return true;
+			}
+			for(;;)
+			{
+				value.items.push_back(JsonValue());
+				if(!parseValue(value.items.back(), depth + 1))
+					return false;
+				skipSpace();
+				if(p < end && *p == ',')
+					p++;
+				else if(p < end && *p == ']')
+				{
+					p++;
+					return true;
+				}
+				else
+					return fail("expected ',' or ']'");
+			}
+		case '"':
+			value.type = JsonValue::STRING;
+			return parseString(value.string);
+		case 't':
+		case 'f':
+			value.type = JsonValue::BOOLEAN;
+			value.number = *p == 't';
+			return literal(*p == 't' ? "true" : "false") || fail("bad literal");
+		case 'n':
+			return literal("null") || fail("bad literal");
+		default:
+		{
+			// the text is null terminated (see JsonValue::parse)
+			char * after;
+			value.type = JsonValue::NUMBER;
+			value.number = strtod(p, &after);
+			if(after == p)
+				return fail("unexpected character");
+			p = after;
+			return true;
+		}
+		}
+	}
+
+	bool parseString(std::string & s)
+	{
+		if(p == end || *p != '"')
+			return fail("expected a string");
+		p++;
+		while(p < end && *p != '"')
+		{
+			if(*p != '\\')
+			{
+				s += *p++;
+				continue;
+			}
+			if(++p == end)
+				break;
+			char c = *p++;
+			switch(c)
+			{
+			case 'b': s += '\b'; break;
+			case 'f': s += '\f'; break;
+			case 'n': s += '\n'; break;
+			case 'r': s += '\r'; break;
+			case 't': s += '\t'; break;
+			case 'u':
+			{
+				// code unit to UTF-8 (surrogate pairs are kept as two units)
+				if(end - p < 4)
+					return fail("bad escape");
+				unsigned int u = strtoul(std::string(p, 4).c_str(), 0, 16);
+				p += 4;
+				if(u < 0x80)
+					s += (char)u;
+				else if(u < 0x800)
+				{
+					s += (char)(0xC0 | u >> 6);
+					s += (char)(0x80 | (u & 0x3F));
+				}
+				else
+				{
+					s += (char)(0xE0 | u >> 12);
+					s += (char)(0x80 | (u >> 6 & 0x3F));
+					s += (char)(0x80 | (u & 0x3F));
+				}
+				break;
+			}
+			default: s += c; break;       // \" \\ \/
+			}
+		}
+		if(p == end)
+			return fail("unterminated string");
+		p++;
+		return true;
+	}
+};
+
+} // namespace
+
+bool JsonValue::parse(const char * text, size_t length)
+{
+	std::string terminated(text, length);
+	JsonParser parser(terminated.c_str(), length);
+	return parser.parseDocument(*this);
+}
+
+const JsonValue & JsonValue::operator[](const char * key) const
+{
+	static const JsonValue null;
+	for(int i=0; i<members.size(); i++)
+		if(members[i].first == key)
+			return members[i].second;
+	return null;
+}
+
+const JsonValue & JsonValue::operator[](int index) const
+{
+	static const JsonValue null;
+	return type == ARRAY && index >= 0 && index < items.size() ? items[index] : null;
+}
+
+//////////////////////////////////////////////////
+// Accessor views
+//////////////////////////////////////////////////
+
+static int componentBytes(int componentType)
+{
+	switch(componentType)
+	{
+	case BYTE: case UNSIGNED_BYTE: return 1;
+	case SHORT: case UNSIGNED_SHORT: return 2;
+	case UNSIGNED_INT: case FLOAT: return 4;
+	}
+	return 0;
+}
+
+float GLBFile::View::get(size_t i, int c) const
+{
+	const unsigned char * e = data + i * stride;
+	switch(componentType)
+	{
+	case FLOAT:          { float v; memcpy(&v, e + 4*c, 4); return v; }
+	case UNSIGNED_INT:   { unsigned int v; memcpy(&v, e + 4*c, 4); return v; }
+	case UNSIGNED_SHORT: { unsigned short v; memcpy(&v, e + 2*c, 2); return normalized ? v / 65535.0f : v; }
+	case SHORT:          { short v; memcpy(&v, e + 2*c, 2); return normalized ? std::max(v / 32767.0f, -1.0f) : v; }
+	case UNSIGNED_BYTE:  { unsigned char v = e[c]; return normalized ? v / 255.0f : v; }
+	case BYTE:           { signed char v = e[c]; return normalized ? std::max(v / 127.0f, -1.0f) : v; }
+	}
+	return 0;
+}
+
+unsigned int GLBFile::View::index(size_t i, int c) const
+{
+	const unsigned char * e = data + i * stride;
+	switch(componentType)
+	{
+	case UNSIGNED_INT:   { unsigned int v; memcpy(&v, e + 4*c, 4); return v; }
+	case UNSIGNED_SHORT: { unsigned short v; memcpy(&v, e + 2*c, 2); return v; }
+	case UNSIGNED_BYTE:  return e[c];
+	}
+	return (unsigned int)get(i, c);
+}
+
+const float * GLBFile::View::floats() const
+{
+	bool packed = componentType == FLOAT && stride == components * sizeof(float);
+	return packed && ((size_t)data & 3) == 0 ? (const float *)data : 0;
+}
+
+//////////////////////////////////////////////////
+// File
+//////////////////////////////////////////////////
+
+GLBFile::GLBFile() :
+    binary(0),
+    binaryLength(0),
+    mapping(0),
+    size(0),
+    warnedScale(false)
+{
+}
+
+GLBFile::~GLBFile()
+{
+	close();
+}
+
+bool GLBFile::open(const char * filename)
+{
+	close();
+	int fd = ::open(filename, O_RDONLY);
+	if(fd < 0)
+	{
+		printf("GLB: unable to open %s\n", filename);
+		return false;
+	}
+	struct stat info;
+	void * p = MAP_FAILED;
+	if(fstat(fd, &info) == 0 && info.st_size >= 20)
+		p = mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if(p == MAP_FAILED)
+	{
+		printf("GLB: unable to map %s\n", filename);
+		return false;
+	}
+	mapping = p;
+	size = info.st_size;
+
+	// header, then chunks (length, type, data padded to 4 bytes)
+	const unsigned char * bytes = (const unsigned char *)mapping;
+	unsigned int header[3];
+	memcpy(header, bytes, 12);
+	if(header[0] != GLB_MAGIC || header[1] != 2 || header[2] > size)
+	{
+		printf("GLB: %s is not a glTF 2.0 binary\n", filename);
+		close();
+		return false;
+	}
+	bool parsed = false;
+	for(size_t at = 12; at + 8 <= header[2]; )
+	{
+		unsigned int chunk[2];
+		memcpy(chunk, bytes + at, 8);
+		at += 8;
+		if(chunk[0] > header[2] - at)
+			break;
+		if(chunk[1] == CHUNK_JSON && !parsed)
+		{
+			if(!document.parse((const char *)bytes + at, chunk[0]))
+				break;
+			parsed = true;
+		}
+		else if(chunk[1] == CHUNK_BIN && !binary)
+		{
+			binary = bytes + at;
+			binaryLength = chunk[0];
+		}
+		at += (chunk[0] + 3) & ~3u;
+	}
+	if(!parsed || document.type != JsonValue::OBJECT)
+	{
+		printf("GLB: no valid JSON chunk in %s\n", filename);
+		close();
+		return false;
+	}
+	return true;
+}
+
+void GLBFile::close()
+{
+	if(mapping)
+		munmap(mapping, size);
+	mapping = 0;
+	size = 0;
+	binary = 0;
+	binaryLength = 0;
+	document = JsonValue();
+	warnedScale = false;
+}
+
+bool GLBFile::accessor(int index, View & view) const
+{
+	const JsonValue & a = document["accessors"][index];
+	const JsonValue & bv = document["bufferViews"][a["bufferView"].asInt()];
+	if(a.isNull() || bv.isNull() || !a["sparse"].isNull())
+	{
+		printf("GLB: accessor %d is missing, has no buffer view or is sparse\n", index);
+		return false;
+	}
+	if(bv["buffer"].asInt(0) != 0 || !binary)
+	{
+		printf("GLB: accessor %d is not in the embedded buffer\n", index);
+		return false;
+	}
+	static const char * types[] = { "SCALAR", "VEC2", "VEC3", "VEC4", "MAT2", "MAT3", "MAT4" };
+	static const int components[] = { 1, 2, 3, 4, 4, 9, 16 };
+	view.components = 0;
+	for(int t=0; t<7; t++)
+		if(strcmp(a["type"].asString(), types[t]) == 0)
+			view.components = components[t];
+	view.componentType = a["componentType"].asInt();
+	view.normalized = a["normalized"].asNumber() != 0;
+	view.count = a["count"].asNumber();
+	size_t element = view.components * componentBytes(view.componentType);
+	view.stride = bv["byteStride"].asNumber();
+	if(view.stride == 0)
+		view.stride = element;
+	size_t offset = (size_t)bv["byteOffset"].asNumber() + (size_t)a["byteOffset"].asNumber();
+	size_t viewEnd = (size_t)bv["byteOffset"].asNumber() + (size_t)bv["byteLength"].asNumber();
+	if(element == 0 || viewEnd > binaryLength ||
+	   (view.count > 0 && offset + (view.count - 1) * view.stride + element > viewEnd))
+	{
+		printf("GLB: accessor %d is malformed or out of its buffer view\n", index);
+		return false;
+	}
+	view.data = binary + offset;
+	return true;
+}
+
+//////////////////////////////////////////////////
+// Mesh and skin weights
+//////////////////////////////////////////////////
+
+void GLBFile::findSkinnedMesh(int & mesh, int & skin) const
+{
+	const JsonValue & nodes = document["nodes"];
+	mesh = skin = -1;
+	for(int i=0; i<nodes.size() && skin < 0; i++)
+		if(nodes[i]["mesh"].asInt() >= 0 && (mesh < 0 || nodes[i]["skin"].asInt() >= 0))
+		{
+			mesh = nodes[i]["mesh"].asInt();
+			skin = nodes[i]["skin"].asInt();
+		}
+	if(mesh < 0 && document["meshes"].size() > 0)
+		mesh = 0;
+}
+
+bool GLBFile::readMesh(TriangleMesh & mesh, InfluenceTable * influences, int * skin) const
+{
+	int meshIndex, skinIndex;
+	findSkinnedMesh(meshIndex, skinIndex);
+	if(skin)
+		*skin = skinIndex;
+	const JsonValue & primitives = document["meshes"][meshIndex]["primitives"];
+	if(primitives.size() == 0)
+	{
+		printf("GLB: no mesh\n");
+		return false;
+	}
+	int jointCount = document["skins"][skinIndex]["joints"].size();
+
+	mesh.expand();
+	mesh.vertices.clear();
+	mesh.normals.clear();
+	mesh.triangles.clear();
+	mesh.topologyChanged();
+	if(influences)
+		influences->clear();
+	int invalid = 0;
+	std::vector<InfluenceTable::BoneIndex> bones;
+	std::vector<float> weights;
+	for(int p=0; p<primitives.size(); p++)
+	{
+		const JsonValue & primitive = primitives[p];
+		if(primitive["mode"].asInt(4) != 4)
+		{
+			printf("GLB: primitive %d is not a triangle list, skipped\n", p);
+			continue;
+		}
+		View positions;
+		if(!accessor(primitive["attributes"]["POSITION"].asInt(), positions))
+			return false;
+		if(positions.components != 3)
+		{
+			printf("GLB: primitive %d positions are not VEC3, skipped\n", p);
+			continue;
+		}
+
+		// JOINTS_n / WEIGHTS_n pairs, 4 influences each
+		std::vector<View> jointSets, weightSets;
+		for(int set=0; influences; set++)
+		{
+			char joints[32], weights[32];
+			snprintf(joints, sizeof joints, "JOINTS_%d", set);
+			snprintf(weights, sizeof weights, "WEIGHTS_%d", set);
+			const JsonValue & attributes = primitive["attributes"];
+			if(attributes[joints].isNull() || attributes[weights].isNull())
+				break;
+			jointSets.push_back(View());
+			weightSets.push_back(View());
+			if(!accessor(attributes[joints].asInt(), jointSets.back()) ||
+			   !accessor(attributes[weights].asInt(), weightSets.back()) ||
+			   jointSets.back().count < positions.count || weightSets.back().count < positions.count)
+				return false;
+		}
+		bool vec4 = true;
+		for(int set=0; set<jointSets.size(); set++)
+			vec4 = vec4 && jointSets[set].components == 4 && weightSets[set].components == 4;
+		if(!vec4)
+		{
+			printf("GLB: primitive %d joints or weights are not VEC4, skipped\n", p);
+			continue;
+		}
+
+		unsigned int base = mesh.vertices.size();
+		const float * packed = positions.floats();
+		for(size_t i=0; i<positions.count; i++)
+			if(packed)
+				mesh.vertices.push_back(Vector3(packed[3*i], packed[3*i+1], packed[3*i+2]));
+			else
+				mesh.vertices.push_back(Vector3(positions.get(i, 0), positions.get(i, 1), positions.get(i, 2)));
+
+		View indices;
+		bool indexed = !primitive["indices"].isNull();
+		if(indexed && !accessor(primitive["indices"].asInt(), indices))
+			return false;
+		size_t cornerCount = indexed ? indices.count : positions.count;
+		for(size_t c=0; c+2<cornerCount; c+=3)
+		{
+			TriangleMesh::Triangle t;
+			t.a = indexed ? indices.index(c, 0) : c;
+			t.b = indexed ? indices.index(c+1, 0) : c+1;
+			t.c = indexed ? indices.index(c+2, 0) : c+2;
+			if(t.a >= positions.count || t.b >= positions.count || t.c >= positions.count)
+			{
+				invalid++;
+				continue;
+			}
+			t.a += base;
+			t.b += base;
+			t.c += base;
+			mesh.triangles.push_back(t);
+		}
+
+		if(!influences)
+			continue;
+		for(size_t i=0; i<positions.count; i++)
+		{
+			bones.clear();
+			weights.clear();
+			for(int set=0; set<jointSets.size(); set++)
+				for(int k=0; k<4; k++)
+				{
+					float w = weightSets[set].get(i, k);
+					unsigned int j = jointSets[set].index(i, k);
+					if(w > 0 && j < jointCount)
+					{
+						bones.push_back(j);
+						weights.push_back(w);
+					}
+				}
+			influences->addVertex(bones.data(), weights.data(), bones.size());
+		}
+	}
+	if(invalid > 0)
+		printf("GLB: %d triangles with out of range indices skipped\n", invalid);
+	return true;
+}
+
+//////////////////////////////////////////////////
+// Skeleton and clips
+//////////////////////////////////////////////////
+
+// q = a * b (rotation b, then a)
+static void quatMultiply(const float a[4], const float b[4], float q[4])
+{
+	float r[4] = {
+		a[3]*b[0] + a[0]*b[3] + a[1]*b[2] - a[2]*b[1],
+		a[3]*b[1] - a[0]*b[2] + a[1]*b[3] + a[2]*b[0],
+		a[3]*b[2] + a[0]*b[1] - a[1]*b[0] + a[2]*b[3],
+		a[3]*b[3] - a[0]*b[0] - a[1]*b[1] - a[2]*b[2] };
+	memcpy(q, r, sizeof(r));
+}
+
+static void quatRotate(const float q[4], const float v[3], float out[3])
+{
+	// v + 2w (u x v) + 2 u x (u x v)
+	float t[3] = { 2*(q[1]*v[2] - q[2]*v[1]), 2*(q[2]*v[0] - q[0]*v[2]), 2*(q[0]*v[1] - q[1]*v[0]) };
+	float r[3] = {
+		v[0] + q[3]*t[0] + q[1]*t[2] - q[2]*t[1],
+		v[1] + q[3]*t[1] + q[2]*t[0] - q[0]*t[2],
+		v[2] + q[3]*t[2] + q[0]*t[1] - q[1]*t[0] };
+	memcpy(out, r, sizeof(r));
+}
+
+// (rotation, translation) = parent * (rotation, translation)
+static void composeParent(const float parentRotation[4], const float parentTranslation[3],
+                          float rotation[4], float translation[3])
+{
+	quatRotate(parentRotation, translation, translation);
+	for(int k=0; k<3; k++)
+		translation[k] += parentTranslation[k];
+	quatMultiply(parentRotation, rotation, rotation);
+}
+
+void GLBFile::localTransform(int node, float rotation[4], float translation[3]) const
+{
+	const JsonValue & n = document["nodes"][node];
+	float scale[3] = { 1, 1, 1 };
+	if(n["matrix"].size() == 16)
+	{
+		// column-major TRS: scale is the length of the basis columns
+		float m[16], r[3][3];
+		for(int i=0; i<16; i++)
+			m[i] = n["matrix"][i].asNumber();
+		for(int c=0; c<3; c++)
+		{
+			scale[c] = sqrt(m[4*c]*m[4*c] + m[4*c+1]*m[4*c+1] + m[4*c+2]*m[4*c+2]);
+			for(int k=0; k<3; k++)
+				r[k][c] = scale[c] > 0 ? m[4*c+k] / scale[c] : (k == c);
+			translation[c] = m[12+c];
+		}
+		float trace = r[0][0] + r[1][1] + r[2][2];
+		if(trace > 0)
+		{
+			float s = 2 * sqrt(1 + trace);
+			rotation[0] = (r[2][1] - r[1][2]) / s;
+			rotation[1] = (r[0][2] - r[2][0]) / s;
+			rotation[2] = (r[1][0] - r[0][1]) / s;
+			rotation[3] = s / 4;
+		}
+		else
+		{
+			int i = r[1][1] > r[0][0] ? (r[2][2] > r[1][1] ? 2 : 1) : (r[2][2] > r[0][0] ? 2 : 0);
+			int j = (i + 1) % 3, k = (i + 2) % 3;
+			float s = 2 * sqrt(1 + r[i][i] - r[j][j] - r[k][k]);
+			rotation[i] = s / 4;
+			rotation[j] = (r[j][i] + r[i][j]) / s;
+			rotation[k] = (r[k][i] + r[i][k]) / s;
+			rotation[3] = (r[k][j] - r[j][k]) / s;
+		}
+	}
+	else
+	{
+		static const float identity[4] = { 0, 0, 0, 1 };
+		for(int k=0; k<4; k++)
+			rotation[k] = n["rotation"].size() == 4 ? n["rotation"][k].asNumber() : identity[k];
+		for(int k=0; k<3; k++)
+		{
+			translation[k] = n["translation"][k].asNumber();
+			scale[k] = n["scale"][k].asNumber(1);
+		}
+	}
+	if(!warnedScale && (fabs(scale[0] - 1) > 1e-4 || fabs(scale[1] - 1) > 1e-4 || fabs(scale[2] - 1) > 1e-4))
+	{
+		printf("GLB: node scale is not supported and is ignored\n");
+		warnedScale = true;
+	}
+}
+
+// Key times and values of an animation sampler (the value of each
+// cubic spline key, without its tangents)
+bool GLBFile::sample(const JsonValue & sampler, bool rotation, std::vector<float> & times, std::vector<float> & values) const
+{
+	View input, output;
+	if(!accessor(sampler["input"].asInt(), input) || !accessor(sampler["output"].asInt(), output))
+		return false;
+	int n = rotation ? 4 : 3;
+	bool cubic = strcmp(sampler["interpolation"].asString("LINEAR"), "CUBICSPLINE") == 0;
+	if(output.components != n || output.count < input.count * (cubic ? 3 : 1))
+	{
+		printf("GLB: animation sampler output does not match its input\n");
+		return false;
+	}
+	times.resize(input.count);
+	values.resize(n * input.count);
+	for(size_t i=0; i<input.count; i++)
+	{
+		times[i] = input.get(i, 0);
+		for(int c=0; c<n; c++)
+			values[n*i + c] = output.get(cubic ? 3*i + 1 : i, c);
+	}
+	return true;
+}
+
+namespace {
+
+struct Channel
+{
+	std::vector<float> times, values;
+	bool step;
+};
+
+// Value of a channel at time t: clamped, step or linear (normalized lerp,
+// along the shorter arc, for rotations)
+void evaluate(const Channel & channel, int n, float t, float * out)
+{
+	const std::vector<float> & times = channel.times;
+	size_t i = std::upper_bound(times.begin(), times.end(), t) - times.begin();
+	if(i == 0 || i == times.size() || channel.step)
+	{
+		size_t k = i == 0 ? 0 : i - 1;
+		for(int c=0; c<n; c++)
+			out[c] = channel.values[n*k + c];
+		return;
+	}
+	const float * a = &channel.values[n*(i-1)];
+	const float * b = &channel.values[n*i];
+	float w = times[i] > times[i-1] ? (t - times[i-1]) / (times[i] - times[i-1]) : 0;
+	float sign = 1, length = 0;
+	if(n == 4 && a[0]*b[0] + a[1]*b[1] + a[2]*b[2] + a[3]*b[3] < 0)
+		sign = -1;
+	for(int c=0; c<n; c++)
+	{
+		out[c] = a[c] * (1 - w) + sign * b[c] * w;
+		length += out[c] * out[c];
+	}
+	for(int c=0; c<n && n == 4 && length > 0; c++)
+		out[c] /= sqrt(length);
+}
+
+} // namespace
+
+bool GLBFile::readSkeleton(std::vector<Joint> & joints, std::vector<Clip> & clips, int skin) const
+{
+	if(skin < 0)
+	{
+		int mesh;
+		findSkinnedMesh(mesh, skin);
+	}
+	joints.clear();
+	clips.clear();
+	const JsonValue & s = document["skins"][skin];
+	const JsonValue & nodes = document["nodes"];
+	if(s["joints"].size() == 0)
+	{
+		printf("GLB: no skin\n");
+		return false;
+	}
+
+	// parent of every node, joint of every node
+	std::vector<int> parentNode(nodes.size(), -1), jointOf(nodes.size(), -1);
+	for(int i=0; i<nodes.size(); i++)
+		for(int c=0; c<nodes[i]["children"].size(); c++)
+		{
+			int child = nodes[i]["children"][c].asInt();
+			if(child >= 0 && child < nodes.size())
+				parentNode[child] = i;
+		}
+	int jointCount = s["joints"].size();
+	for(int j=0; j<jointCount; j++)
+	{
+		int node = s["joints"][j].asInt();
+		if(node < 0 || node >= nodes.size() || jointOf[node] >= 0)
+		{
+			printf("GLB: skin joint %d is not a valid node\n", j);
+			return false;
+		}
+		jointOf[node] = j;
+	}
+
+	// rest pose; roots take in the transforms of their non-joint ancestors
+	joints.resize(jointCount);
+	std::vector<float> ancestors(7 * jointCount);    // rotation, translation
+	View inverseBinds;
+	bool hasInverseBinds = !s["inverseBindMatrices"].isNull() &&
+	                       accessor(s["inverseBindMatrices"].asInt(), inverseBinds) &&
+	                       inverseBinds.components == 16 && inverseBinds.count >= jointCount;
+	for(int j=0; j<jointCount; j++)
+	{
+		int node = s["joints"][j].asInt();
+		Joint & joint = joints[j];
+		joint.name = nodes[node]["name"].asString();
+		localTransform(node, joint.rotation, joint.translation);
+		float * a = &ancestors[7*j];
+		float identity[7] = { 0, 0, 0, 1, 0, 0, 0 };
+		memcpy(a, identity, sizeof(identity));
+		int p = parentNode[node];
+		while(p >= 0 && jointOf[p] < 0)
+		{
+			float r[4], t[3];
+			localTransform(p, r, t);
+			composeParent(r, t, a, a + 4);
+			p = parentNode[p];
+		}
+		joint.parent = p >= 0 ? jointOf[p] : -1;
+		composeParent(a, a + 4, joint.rotation, joint.translation);
+		joint.hasInverseBind = hasInverseBinds;
+		for(int r=0; r<3 && hasInverseBinds; r++)
+			for(int c=0; c<4; c++)
+				joint.inverseBind.m[r][c] = inverseBinds.get(j, 4*c + r);
+	}
+
+	// clips: the rotation and translation channels of every joint, sampled
+	// at the union of their key times (and at 0 and the clip length)
+	const JsonValue & animations = document["animations"];
+	for(int a=0; a<animations.size(); a++)
+	{
+		const JsonValue & animation = animations[a];
+		std::vector<Channel> rotations(jointCount), translations(jointCount);
+		Clip clip;
+		char name[32];
+		snprintf(name, sizeof name, "animation%d", a);
+		clip.name = animation["name"].asString(name);
+		clip.length = 0;
+		for(int c=0; c<animation["channels"].size(); c++)
+		{
+			const JsonValue & target = animation["channels"][c]["target"];
+			int node = target["node"].asInt();
+			const char * path = target["path"].asString();
+			bool rotation = strcmp(path, "rotation") == 0;
+			if(node < 0 || node >= nodes.size() || jointOf[node] < 0 || (!rotation && strcmp(path, "translation") != 0))
+				continue;
+			const JsonValue & sampler = animation["samplers"][animation["channels"][c]["sampler"].asInt()];
+			Channel & channel = rotation ? rotations[jointOf[node]] : translations[jointOf[node]];
+			if(!sample(sampler, rotation, channel.times, channel.values))
+				return false;
+			channel.step = strcmp(sampler["interpolation"].asString(), "STEP") == 0;
+			if(!channel.times.empty())
+				clip.length = std::max(clip.length, channel.times.back());
+		}
+		clip.tracks.resize(jointCount);
+		for(int j=0; j<jointCount; j++)
+		{
+			if(rotations[j].times.empty() && translations[j].times.empty())
+				continue;
+			Track & track = clip.tracks[j];
+			track.times = rotations[j].times;
+			track.times.insert(track.times.end(), translations[j].times.begin(), translations[j].times.end());
+			track.times.push_back(0);
+			track.times.push_back(clip.length);
+			std::sort(track.times.begin(), track.times.end());
+			track.times.erase(std::unique(track.times.begin(), track.times.end()), track.times.end());
+			int node = s["joints"][j].asInt();
+			float restRotation[4], restTranslation[3];
+			localTransform(node, restRotation, restTranslation);
+			for(int k=0; k<track.times.size(); k++)
+			{
+				float r[4], t[3];
+				if(rotations[j].times.empty())
+					memcpy(r, restRotation, sizeof(r));
+				else
+					evaluate(rotations[j], 4, track.times[k], r);
+				if(translations[j].times.empty())
+					memcpy(t, restTranslation, sizeof(t));
+				else
+					evaluate(translations[j], 3, track.times[k], t);
+				composeParent(&ancestors[7*j], &ancestors[7*j + 4], r, t);
+				track.rotations.insert(track.rotations.end(), r, r + 4);
+				track.translations.insert(track.translations.end(), t, t + 3);
+			}
+		}
+		clips.push_back(clip);
+	}
+	return true;
+}
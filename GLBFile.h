@@ -0,0 +1,139 @@
+/**
+  * Binary glTF 2.0 (.glb) reader: mesh, skin weights, skeleton and clips.
+  *
+  * open() maps the file and parses its JSON chunk with a minimal parser
+  * (JsonValue); the binary chunk is never copied. Accessors are read
+  * through Views into the mapping: floats() returns the data in place
+  * when the layout is already packed floats (positions, float weights),
+  * and get() converts any other component type on the fly.
+  *
+  * readMesh() loads the primitives of the first skinned mesh (or the
+  * first mesh) into one TriangleMesh, and their JOINTS_n / WEIGHTS_n
+  * into an InfluenceTable whose bone indices are skin joint indices.
+  * Primitives that are not triangle lists, or whose POSITION is not VEC3
+  * or JOINTS_n / WEIGHTS_n not VEC4, are skipped with a message.
+  * readSkeleton() returns the joints of that skin in the same order,
+  * with their rest transforms and inverse bind matrices, and the
+  * animations resampled per joint at the union of their key times.
+  * MeshAnimation::LoadGLB() turns these into bones and clips.
+  *
+  * Only the embedded binary buffer is read (no external or data: URIs),
+  * sparse accessors and morph targets are not supported, and node scale
+  * is ignored (MeshAnimation bones are rigid): a warning is printed.
+  */
+
+#ifndef GLB_FILE_H
+#define GLB_FILE_H
+
+#include <string>
+#include <vector>
+#include <utility>
+#include "TriangleMesh.h"
+#include "Skinning.h"
+
+// JSON document tree (objects keep their key order)
+class JsonValue
+{
+public:
+	enum Type { NUL, BOOLEAN, NUMBER, STRING, ARRAY, OBJECT };
+
+	Type type;
+	double number;                       // NUMBER, and 0/1 for BOOLEAN
+	std::string string;
+	std::vector<JsonValue> items;        // ARRAY
+	std::vector<std::pair<std::string, JsonValue> > members;   // OBJECT
+
+	JsonValue() : type(NUL), number(0) {}
+
+	// Parse text; false (with a message) on a syntax error
+	bool parse(const char * text, size_t length);
+
+	// Member or item, a null value if absent
+	const JsonValue & operator[](const char * key) const;
+	const JsonValue & operator[](int index) const;
+	int size() const { return type == ARRAY ? items.size() : members.size(); }
+	bool isNull() const { return type == NUL; }
+
+	double asNumber(double otherwise = 0) const { return type == NUMBER || type == BOOLEAN ? number : otherwise; }
+	int asInt(int otherwise = -1) const { return type == NUMBER ? (int)number : otherwise; }
+	const char * asString(const char * otherwise = "") const { return type == STRING ? string.c_str() : otherwise; }
+};
+
+class GLBFile
+{
+public:
+	// Elements of an accessor, in the mapped binary chunk
+	struct View
+	{
+		const unsigned char * data;
+		size_t count, stride;
+		int componentType;               // GL enum: 5120 byte ... 5126 float
+		int components;                  // 1 (SCALAR) to 16 (MAT4)
+		bool normalized;
+
+		// Component c of element i, converted (and normalized) to float
+		float get(size_t i, int c) const;
+		// Integer component (indices, joints)
+		unsigned int index(size_t i, int c) const;
+		// The data in place if it is packed floats, else 0
+		const float * floats() const;
+	};
+
+	struct Joint
+	{
+		std::string name;
+		int parent;                      // joint index, -1 for a root
+		float rotation[4];               // rest pose, parent space: quaternion x,y,z,w
+		float translation[3];
+		bool hasInverseBind;
+		_matrix34 inverseBind;
+	};
+
+	// Local transforms of one joint at the given times (absolute, parent space)
+	struct Track
+	{
+		std::vector<float> times;
+		std::vector<float> rotations;    // 4 per time
+		std::vector<float> translations; // 3 per time
+	};
+
+	struct Clip
+	{
+		std::string name;
+		float length;                    // seconds
+		std::vector<Track> tracks;       // per joint, empty if not animated
+	};
+
+	GLBFile();
+	~GLBFile();
+
+	bool open(const char * filename);
+	void close();
+
+	const JsonValue & json() const { return document; }
+	bool accessor(int index, View & view) const;
+
+	// Mesh of the first node with a mesh and a skin (or the first mesh);
+	// influences may be 0. Returns the skin index in skin, -1 if none.
+	bool readMesh(TriangleMesh & mesh, InfluenceTable * influences, int * skin = 0) const;
+
+	// Joints and clips of a skin (readMesh()'s by default)
+	bool readSkeleton(std::vector<Joint> & joints, std::vector<Clip> & clips, int skin = -1) const;
+
+private:
+	GLBFile(const GLBFile &);
+	GLBFile & operator=(const GLBFile &);
+
+	void findSkinnedMesh(int & mesh, int & skin) const;
+	void localTransform(int node, float rotation[4], float translation[3]) const;
+	bool sample(const JsonValue & sampler, bool rotation, std::vector<float> & times, std::vector<float> & values) const;
+
+	JsonValue document;
+	const unsigned char * binary;        // BIN chunk
+	size_t binaryLength;
+	void * mapping;
+	size_t size;
+	mutable bool warnedScale;
+};
+
+#endif // GLB_FILE_H
@@ -7,6 +7,8 @@ GLCamera::GLCamera(void){
 	camDistance = -4;
 	target = Point3d(0,0,0);
 	rotations = Vector3d(0,0,0);
+	frustumValid = false;
+	eye[0] = eye[1] = eye[2] = 0;
 }
 
 GLCamera::~GLCamera(void){
@@ -36,3 +38,37 @@ void GLCamera::applyCameraTransformations(){
 	gluLookAt(camPos.x, camPos.y, camPos.z, target.x, target.y, target.z, yW.x, yW.y, yW.z);
 }
 
+//extract the 6 frustum planes from the rows of projection * modelview (world coordinates)
+void GLCamera::updateFrustum(){
+	double p[16], mv[16], c[4][4];
+	glGetDoublev(GL_PROJECTION_MATRIX, p);
+	glGetDoublev(GL_MODELVIEW_MATRIX, mv);
+	//matrices are column-major: c[i][j] is row i, column j of p*mv
+	for (int i=0;i<4;i++)
+		for (int j=0;j<4;j++)
+			c[i][j] = p[i]*mv[j*4] + p[4+i]*mv[j*4+1] + p[8+i]*mv[j*4+2] + p[12+i]*mv[j*4+3];
+	for (int k=0;k<3;k++)
+		for (int j=0;j<4;j++){
+			frustum[2*k][j] = c[3][j] + c[k][j];     //left, bottom, near
+			frustum[2*k+1][j] = c[3][j] - c[k][j];   //right, top, far
+		}
+	//the eye is the modelview origin mapped back: -R^T t
+	for (int j=0;j<3;j++)
+		eye[j] = -(mv[j*4]*mv[12] + mv[j*4+1]*mv[13] + mv[j*4+2]*mv[14]);
+	frustumValid = true;
+}
+
+//a box is outside if its corner furthest along the normal of some plane is behind it
+bool GLCamera::isBoxVisible(const float boxMin[3], const float boxMax[3]) const{
+	if (!frustumValid)
+		return true;
+	for (int k=0;k<6;k++){
+		const double* f = frustum[k];
+		double d = f[3];
+		for (int j=0;j<3;j++)
+			d += f[j] * (f[j] > 0 ? boxMax[j] : boxMin[j]);
+		if (d < 0)
+			return false;
+	}
+	return true;
+}
@@ -16,9 +16,16 @@ public:
 	~GLCamera(void);
 
 	void applyCameraTransformations();
+	// read the view frustum from the current GL projection and modelview matrices
+	void updateFrustum();
+	// false if the box is certainly outside the frustum (always true before updateFrustum)
+	bool isBoxVisible(const float boxMin[3], const float boxMax[3]) const;
 	Vector3d rotations;
 	double camDistance;     // distance, assuming looking down -z axis of camera frame
 	Point3d target;         // look-at point (in world coords)
+	double frustum[6][4];   // planes a*x+b*y+c*z+d >= 0 inside (world coords)
+	double eye[3];          // camera position (world coords), set by updateFrustum
+	bool frustumValid;
 };
 
 #endif
@@ -0,0 +1,375 @@
+/**
+  * Linear blend skinning in a GLSL vertex shader.
+  *
+  */
+
+// shader and buffer entry points are declared by glext.h
+#define GL_GLEXT_PROTOTYPES
+#include "GLHeaders.h"
+#include "GPUSkinning.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <algorithm>
+#include <functional>
+
+// Uploaded vertex
+struct GPUVertex
+{
+	float position[3];
+	float normal[3];
+	float bones[GPUSkinning::MAX_INFLUENCES];     // palette slots
+	float weights[GPUSkinning::MAX_INFLUENCES];
+};
+
+// Uniform components left for the built-in uniforms (matrices, light 0)
+static const int RESERVED_UNIFORM_COMPONENTS = 256;
+
+// Vertex shader, compiled with "#define PALETTE_BONES n" in front.
+// Lighting follows the fixed-function light 0 with GL_COLOR_MATERIAL,
+// and fragments go through the fixed-function pipeline.
+static const char * skinningShader =
+	"uniform vec4 palette[3*PALETTE_BONES];\n"
+	"attribute vec3 position;\n"
+	"attribute vec3 normal;\n"
+	"attribute vec4 boneSlots;\n"
+	"attribute vec4 boneWeights;\n"
+	"varying vec3 skinnedPosition;\n"        // captured by readback()
+	"void main()\n"
+	"{\n"
+	"	vec4 r0 = vec4(0.0), r1 = vec4(0.0), r2 = vec4(0.0);\n"
+	"	for (int k = 0; k < 4; k++)\n"
+	"	{\n"
+	"		int b = 3*int(boneSlots[k]);\n"
+	"		float w = boneWeights[k];\n"
+	"		r0 += w*palette[b];\n"
+	"		r1 += w*palette[b+1];\n"
+	"		r2 += w*palette[b+2];\n"
+	"	}\n"
+	"	vec4 p = vec4(position, 1.0);\n"
+	"	skinnedPosition = vec3(dot(r0, p), dot(r1, p), dot(r2, p));\n"
+	"	vec3 n = vec3(dot(r0.xyz, normal), dot(r1.xyz, normal), dot(r2.xyz, normal));\n"
+	"	gl_Position = gl_ModelViewProjectionMatrix * vec4(skinnedPosition, 1.0);\n"
+	"\n"
+	"	vec3 en = normalize(gl_NormalMatrix * n);\n"
+	"	vec3 l = normalize(gl_LightSource[0].position.xyz);\n"
+	"	vec3 light = gl_LightModel.ambient.rgb + gl_LightSource[0].ambient.rgb\n"
+	"	           + gl_LightSource[0].diffuse.rgb * max(dot(en, l), 0.0);\n"
+	"	gl_FrontColor = vec4(gl_Color.rgb * light, gl_Color.a);\n"
+	"}\n";
+
+GPUSkinning::GPUSkinning() :
+    maxPaletteBones(0),
+    program(0),
+    programBones(0),
+    paletteLocation(-1),
+    vertexBuffer(0),
+    indexBuffer(0),
+    vertexCount(0),
+    meshVertexCount(0),
+    feedback(false)
+{
+}
+
+GPUSkinning::~GPUSkinning()
+{
+	// GL objects die with the context
+}
+
+//////////////////////////////////////////////////
+// Compile and link the skinning program for a palette of paletteBones
+//////////////////////////////////////////////////
+
+bool GPUSkinning::buildProgram(int paletteBones)
+{
+	if(program && programBones == paletteBones)
+		return true;
+	if(program)
+		glDeleteProgram(program);
+	program = 0;
+
+	// transform feedback needs OpenGL 3.0
+	feedback = false;
+#ifdef GL_VERSION_3_0
+	const char * version = (const char *)glGetString(GL_VERSION);
+	feedback = version && atoi(version) >= 3;
+#endif
+
+	char header[64];
+	sprintf(header, "#version 120\n#define PALETTE_BONES %d\n", paletteBones);
+	const char * sources[2] = { header, skinningShader };
+
+	GLuint shader = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(shader, 2, sources, NULL);
+	glCompileShader(shader);
+	GLint status;
+	char log[1024];
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+	if(!status)
+	{
+		glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+		printf("GPUSkinning: vertex shader error:\n%s\n", log);
+		glDeleteShader(shader);
+		return false;
+	}
+
+	program = glCreateProgram();
+	glAttachShader(program, shader);
+	glDeleteShader(shader);      // flagged, freed with the program
+	glBindAttribLocation(program, ATTRIB_POSITION, "position");
+	glBindAttribLocation(program, ATTRIB_NORMAL, "normal");
+	glBindAttribLocation(program, ATTRIB_BONES, "boneSlots");
+	glBindAttribLocation(program, ATTRIB_WEIGHTS, "boneWeights");
+#ifdef GL_VERSION_3_0
+	if(feedback)
+	{
+		const char * varyings[1] = { "skinnedPosition" };
+		glTransformFeedbackVaryings(program, 1, varyings, GL_INTERLEAVED_ATTRIBS);
+	}
+#endif
+	glLinkProgram(program);
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	if(!status)
+	{
+		glGetProgramInfoLog(program, sizeof(log), NULL, log);
+		printf("GPUSkinning: link error:\n%s\n", log);
+		glDeleteProgram(program);
+		program = 0;
+		return false;
+	}
+	paletteLocation = glGetUniformLocation(program, "palette");
+	programBones = paletteBones;
+	return true;
+}
+
+//////////////////////////////////////////////////
+// Upload the bind pose mesh, one vertex range per palette chunk
+//////////////////////////////////////////////////
+
+bool GPUSkinning::upload(const TriangleMesh & bindMesh,
+                         const InfluenceTable & influences, int boneCount)
+{
+	release();
+	int n = bindMesh.vertices.size();
+	if(n == 0 || boneCount == 0 || influences.vertexCount() != n || bindMesh.normals.size() != n)
+		return false;
+
+	// palette slots that fit in the vertex shader uniforms
+	GLint components = 0;
+	glGetIntegerv(GL_MAX_VERTEX_UNIFORM_COMPONENTS, &components);
+	int slots = (components - RESERVED_UNIFORM_COMPONENTS) / 12;
+	if(slots < 3*MAX_INFLUENCES)
+		slots = 3*MAX_INFLUENCES;       // one triangle's bones
+	maxPaletteBones = n_min(boneCount, slots);
+
+	std::vector<PaletteChunk> paletteChunks;
+	if(boneCount <= maxPaletteBones)
+	{
+		// a single chunk holding the whole skeleton
+		paletteChunks.resize(1);
+		for(int b=0; b<boneCount; b++)
+			paletteChunks[0].bones.push_back(b);
+		for(int t=0; t<bindMesh.triangles.size(); t++)
+			paletteChunks[0].triangles.push_back(t);
+	}
+	else
+	{
+		int trimmed = buildPaletteChunks(bindMesh, influences, boneCount, maxPaletteBones, paletteChunks, MAX_INFLUENCES);
+		if(trimmed > 0)
+			printf("GPUSkinning: %d triangle(s) need more than %d bones, their lightest influences are dropped\n",
+			       trimmed, maxPaletteBones);
+	}
+
+	if(!buildProgram(maxPaletteBones))
+		return false;
+
+	std::vector<GPUVertex> vertices;
+	std::vector<unsigned int> indices;
+	std::vector<int> slotOf(boneCount, -1);
+	std::vector<int> chunkOf(n, -1);          // chunkOf[v] == c iff v is uploaded for chunk c
+	std::vector<unsigned int> uploaded(n);    // its index in vertices
+	std::vector<std::pair<float,int> > ranked;  // (weight, bone) of one vertex
+	meshVertexCount = n;
+	sourceVertex.clear();
+
+	for(int c=0; c<paletteChunks.size(); c++)
+	{
+		const PaletteChunk & paletteChunk = paletteChunks[c];
+		Chunk chunk;
+		chunk.bones = paletteChunk.bones;
+		chunk.firstVertex = vertices.size();
+		chunk.firstIndex = indices.size();
+		for(int s=0; s<chunk.bones.size(); s++)
+			slotOf[chunk.bones[s]] = s;
+
+		for(int i=0; i<paletteChunk.triangles.size(); i++)
+		{
+			const TriangleMesh::Triangle & triangle = bindMesh.triangles[paletteChunk.triangles[i]];
+			unsigned int corners[3] = { triangle.a, triangle.b, triangle.c };
+			for(int k=0; k<3; k++)
+			{
+				unsigned int v = corners[k];
+				if(chunkOf[v] != c)
+				{
+					chunkOf[v] = c;
+					uploaded[v] = vertices.size();
+					sourceVertex.push_back(v);
+
+					GPUVertex gv;
+					for(int j=0; j<3; j++)
+					{
+						gv.position[j] = bindMesh.vertices[v][j];
+						gv.normal[j] = bindMesh.normals[v][j];
+					}
+
+					// keep the largest weights
+					ranked.clear();
+					for(unsigned int j=influences.offsets[v]; j<influences.offsets[v+1]; j++)
+						ranked.push_back(std::make_pair(influences.weights[j], (int)influences.bones[j]));
+					int count = n_min((int)ranked.size(), (int)MAX_INFLUENCES);
+					std::partial_sort(ranked.begin(), ranked.begin()+count, ranked.end(), std::greater<std::pair<float,int> >());
+					float sum = 0;
+					for(int j=0; j<MAX_INFLUENCES; j++)
+					{
+						int slot = j < count ? slotOf[ranked[j].second] : -1;
+						gv.bones[j] = slot < 0 ? 0 : slot;
+						gv.weights[j] = slot < 0 ? 0 : ranked[j].first;
+						sum += gv.weights[j];
+					}
+					for(int j=0; j<MAX_INFLUENCES; j++)
+						gv.weights[j] = sum > 0 ? gv.weights[j] / sum : 0;
+					vertices.push_back(gv);
+				}
+				indices.push_back(uploaded[v]);
+			}
+		}
+
+		for(int s=0; s<chunk.bones.size(); s++)
+			slotOf[chunk.bones[s]] = -1;        // bones left out of a chunk have no slot in it
+		chunk.vertexCount = vertices.size() - chunk.firstVertex;
+		chunk.indexCount = indices.size() - chunk.firstIndex;
+		chunks.push_back(chunk);
+	}
+	if(vertices.empty())
+		return false;
+
+	glGenBuffers(1, &vertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size()*sizeof(GPUVertex), &vertices[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glGenBuffers(1, &indexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size()*sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	vertexCount = vertices.size();
+
+	printf("GPUSkinning: %d vertices (%d in mesh), %d chunk(s) of <= %d bones, %d bytes per frame\n",
+	       vertexCount, n, (int)chunks.size(), maxPaletteBones, boneCount*12*(int)sizeof(float));
+	return true;
+}
+
+// Free the GL objects
+void GPUSkinning::release()
+{
+	if(vertexBuffer)
+		glDeleteBuffers(1, &vertexBuffer);
+	if(indexBuffer)
+		glDeleteBuffers(1, &indexBuffer);
+	vertexBuffer = indexBuffer = 0;
+	vertexCount = meshVertexCount = 0;
+	chunks.clear();
+	sourceVertex.clear();
+}
+
+void GPUSkinning::bindAttributes()
+{
+	glUseProgram(program);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	glVertexAttribPointer(ATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(GPUVertex), (void *)offsetof(GPUVertex, position));
+	glVertexAttribPointer(ATTRIB_NORMAL, 3, GL_FLOAT, GL_FALSE, sizeof(GPUVertex), (void *)offsetof(GPUVertex, normal));
+	glVertexAttribPointer(ATTRIB_BONES, MAX_INFLUENCES, GL_FLOAT, GL_FALSE, sizeof(GPUVertex), (void *)offsetof(GPUVertex, bones));
+	glVertexAttribPointer(ATTRIB_WEIGHTS, MAX_INFLUENCES, GL_FLOAT, GL_FALSE, sizeof(GPUVertex), (void *)offsetof(GPUVertex, weights));
+	for(int a=ATTRIB_POSITION; a<=ATTRIB_WEIGHTS; a++)
+		glEnableVertexAttribArray(a);
+}
+
+void GPUSkinning::unbindAttributes()
+{
+	for(int a=ATTRIB_POSITION; a<=ATTRIB_WEIGHTS; a++)
+		glDisableVertexAttribArray(a);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glUseProgram(0);
+}
+
+// Upload the rows of the chunk's bone matrices (the only per-frame data)
+void GPUSkinning::setPalette(const Chunk & chunk, const SkinningPalette & palette)
+{
+	paletteData.resize(12*chunk.bones.size());
+	for(int s=0; s<chunk.bones.size(); s++)
+		memcpy(&paletteData[12*s], palette[chunk.bones[s]].m, 12*sizeof(float));
+	glUniform4fv(paletteLocation, 3*chunk.bones.size(), &paletteData[0]);
+}
+
+//////////////////////////////////////////////////
+// Skin and draw, one palette upload per chunk
+//////////////////////////////////////////////////
+
+void GPUSkinning::draw(const SkinningPalette & palette)
+{
+	if(!ready())
+		return;
+	bindAttributes();
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	for(int c=0; c<chunks.size(); c++)
+	{
+		setPalette(chunks[c], palette);
+		glDrawElements(GL_TRIANGLES, chunks[c].indexCount, GL_UNSIGNED_INT,
+		               (void *)(chunks[c].firstIndex*sizeof(unsigned int)));
+	}
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	unbindAttributes();
+}
+
+//////////////////////////////////////////////////
+// Capture the skinned positions with transform feedback
+//////////////////////////////////////////////////
+
+bool GPUSkinning::readback(const SkinningPalette & palette, std::vector<Vector3> & out)
+{
+	if(!ready() || !feedback)
+		return false;
+#ifdef GL_VERSION_3_0
+	GLuint feedbackBuffer;
+	glGenBuffers(1, &feedbackBuffer);
+	glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, feedbackBuffer);
+	glBufferData(GL_TRANSFORM_FEEDBACK_BUFFER, 3*vertexCount*sizeof(float), NULL, GL_STATIC_READ);
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, feedbackBuffer);
+
+	// every uploaded vertex once, as points, in buffer order
+	bindAttributes();
+	glEnable(GL_RASTERIZER_DISCARD);
+	glBeginTransformFeedback(GL_POINTS);
+	for(int c=0; c<chunks.size(); c++)
+	{
+		setPalette(chunks[c], palette);
+		glDrawArrays(GL_POINTS, chunks[c].firstVertex, chunks[c].vertexCount);
+	}
+	glEndTransformFeedback();
+	glDisable(GL_RASTERIZER_DISCARD);
+	unbindAttributes();
+
+	std::vector<float> positions(3*vertexCount);
+	glGetBufferSubData(GL_TRANSFORM_FEEDBACK_BUFFER, 0, positions.size()*sizeof(float), &positions[0]);
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+	glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, 0);
+	glDeleteBuffers(1, &feedbackBuffer);
+
+	out.resize(meshVertexCount);
+	for(int i=0; i<vertexCount; i++)
+		out[sourceVertex[i]] = Vector3(positions[3*i], positions[3*i+1], positions[3*i+2]);
+	return true;
+#else
+	return false;
+#endif
+}
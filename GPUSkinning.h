@@ -0,0 +1,85 @@
+/**
+  * Linear blend skinning in a GLSL vertex shader.
+  *
+  * Bind pose positions, normals and up to 4 influences per vertex are
+  * uploaded once into a vertex buffer; each frame only the skinning
+  * palette goes to OpenGL, as 3 vec4 uniforms per bone (the rows of a
+  * _matrix34). Per-frame traffic is then proportional to the number of
+  * bones instead of the number of vertices.
+  *
+  * When the skeleton has more bones than the vertex shader has uniform
+  * slots, the mesh is split with buildPaletteChunks(): vertices shared
+  * by several chunks are duplicated, with bone indices local to their
+  * chunk, and each chunk is drawn with its own palette.
+  *
+  * The shader writes the skinned position to a varying that can be
+  * captured with transform feedback (OpenGL 3.0), so the GPU result can
+  * be read back and compared to the CPU skinning.
+  */
+
+#ifndef GPU_SKINNING_H
+#define GPU_SKINNING_H
+
+#include <vector>
+#include "Skinning.h"
+
+class GPUSkinning
+{
+public:
+	enum { MAX_INFLUENCES = 4 };
+
+	GPUSkinning();
+	~GPUSkinning();
+
+	// Compile the shader (if needed) and upload the bind pose mesh, whose
+	// normals must be computed. Vertices with more than MAX_INFLUENCES
+	// influences keep their largest weights, renormalized. Needs a current
+	// GL context; false on error.
+	bool upload(const TriangleMesh & bindMesh,
+	            const InfluenceTable & influences, int boneCount);
+
+	bool ready() const { return vertexCount > 0; }
+
+	// Skin and draw with the fixed-function light 0 and the current color
+	void draw(const SkinningPalette & palette);
+
+	// Skin on the GPU and read the positions back (OpenGL 3.0 transform
+	// feedback), in the vertex order of bindMesh. Vertices used by no
+	// triangle are not uploaded and left unchanged. False if unsupported.
+	bool readback(const SkinningPalette & palette, std::vector<Vector3> & out);
+
+	// Free the GL objects (the shader is kept)
+	void release();
+
+	// Uniform slots per chunk (set by upload)
+	int maxPaletteBones;
+
+private:
+	// Vertex attribute locations
+	enum { ATTRIB_POSITION, ATTRIB_NORMAL, ATTRIB_BONES, ATTRIB_WEIGHTS };
+
+	struct Chunk
+	{
+		std::vector<InfluenceTable::BoneIndex> bones;   // palette slot -> skeleton bone
+		int firstVertex, vertexCount;
+		int firstIndex, indexCount;
+	};
+
+	bool buildProgram(int paletteBones);
+	void bindAttributes();
+	void unbindAttributes();
+	void setPalette(const Chunk & chunk, const SkinningPalette & palette);
+
+	unsigned int program;
+	int programBones;                      // palette size the program was compiled for
+	int paletteLocation;
+	unsigned int vertexBuffer, indexBuffer;
+	int vertexCount;                       // uploaded vertices (with duplicates)
+	int meshVertexCount;
+	bool feedback;                         // transform feedback available
+	std::vector<Chunk> chunks;
+	std::vector<unsigned int> sourceVertex;  // uploaded vertex -> mesh vertex
+	std::vector<float> paletteData;          // 12 floats per chunk bone
+};
+
+#endif // GPU_SKINNING_H
@@ -43,7 +43,7 @@ Vector3 & Vector3::operator-=(const Vector3 & a) {
 // cross product
 Vector3 Vector3::cross(const Vector3 & a) const {
 	return Vector3(
-		v[1]+a.v[2] - v[2]*a.v[1],
+		v[1]*a.v[2] - v[2]*a.v[1],
 		v[2]*a.v[0] - v[0]*a.v[2],
 		v[0]*a.v[1] - v[1]*a.v[0]
 	);
@@ -1,6 +1,13 @@
 #include "tinyxml.h"
 #include <stdio.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "Skinning.h"
+#include "GLBFile.h"
+#include "OgreBinary.h"
 #include "mathlib/_matrix44.h"
+#include "mathlib/_matrix34.h"
 
 #define mmin(a,b) (((a)<(b))?(a):(b))
 #define mmax(a,b) (((a)>(b))?(a):(b))
@@ -10,7 +17,47 @@
 
 #define vec3f _vector3
 #define matrix44 _matrix44
+#define matrix34 _matrix34
 
+// SIMD lanes of the batch pose sampler (instances interpolated together)
+#if defined(__GNUC__)
+typedef float TPoseLanes __attribute__((vector_size(16)));
+#endif
+
+
+//##################################################################//
+// Interned name table : names of any length -> stable ids (0,1,2..)
+//##################################################################//
+
+class TNameTable
+{
+	public:
+
+	int			Intern(const char* name);	// id of name, appended if new
+	int			Find(const char* name) const;	// id of name or -1
+	const char*	Name(int id) const { return names[id].c_str(); }
+	int			Size() const { return names.size(); }
+	void		Clear() { names.clear(); ids.clear(); }
+
+	private:
+
+	std::vector<std::string>				names;
+	std::unordered_map<std::string,int>	ids;
+};
+
+int TNameTable::Intern(const char* name)
+{
+	std::pair<std::unordered_map<std::string,int>::iterator,bool> r=
+		ids.insert(std::make_pair(std::string(name),int(names.size())));
+	if(r.second) names.push_back(r.first->first);
+	return r.first->second;
+}
+
+int TNameTable::Find(const char* name) const
+{
+	std::unordered_map<std::string,int>::const_iterator it=ids.find(name);
+	return it==ids.end() ? -1 : it->second;
+}
 
 //##################################################################//
 // Ogre XML-Animation File Reader
@@ -20,8 +67,7 @@ class MeshAnimation
 {
 	public:
 
-	enum {  NAME_LEN = 30 };
-	
+
 	typedef struct
 	{	
 		float	time;
@@ -36,8 +82,7 @@ class MeshAnimation
 
 	typedef struct
 	{
-		char				nameLength;
-		char				name[NAME_LEN];
+		int					nameId;		// id in animationNames == animation index
 		float				timeLength;
 		std::vector<TTrack>	tracks;
 		int					frameCount;
@@ -45,18 +90,20 @@ class MeshAnimation
 	
 	typedef struct
 	{	
-		char			nameLength;
-		char			name[NAME_LEN];
+		int				nameId;		// id in boneNames == bone index
 		float			rot[4]; // angle,x,y,z
 		float			pos[3];
 		int				parent;
-		matrix44		matrix; // animated result
-		matrix44		invbindmatrix;  // inverse bindmatrix
+		matrix34		matrix; // animated result
+		matrix34		invbindmatrix;  // inverse bindmatrix
 		std::vector<int> childs;
 	} TBone;
 
 	std::vector<TBone>		bones;		
 	std::vector<TAnimation>	animations;
+	TNameTable				boneNames;
+	TNameTable				animationNames;
+	std::vector<int>		evalOrder;	// parents before children
 	
 	MeshAnimation(char* skeletonfilename)
 	{
@@ -65,11 +112,20 @@ class MeshAnimation
 	MeshAnimation(){};
 
 	void  LoadSkeletonXML ( const char* ogreXMLfileName );
-	int   GetBoneIndexOf ( char* name );
-	int   GetAnimationIndexOf  (char* name);
+	bool  LoadGLB ( const char* glbFileName, TriangleMesh* mesh=0, InfluenceTable* influences=0 );
+	bool  LoadSkeletonBinary ( const char* ogreSkeletonFileName );
+	int   GetBoneIndexOf ( const char* name );
+	int   GetAnimationIndexOf  (const char* name);
+	const char* GetBoneName(int bone) { return boneNames.Name(bones[bone].nameId); }
+	const char* GetAnimationName(int animation) { return animationNames.Name(animations[animation].nameId); }
 	void  SetPose(int animation,double time);
 	void  SetBindPose();
-	void  EvalSubtree(int boneid,TAnimation &ani,int frame,float weight);
+	void  EvalBone(int boneid,TAnimation &ani,int frame,float weight);
+	void  EvalBoneKey(int boneid,const TKey *key);
+	void  SamplePoses(int animation,const double *times,int instanceCount,std::vector<TKey> &poses);
+	void  SetLocalPose(const TKey *pose);
+	void  BuildEvalOrder();
+	void  GetSkinningPalette(std::vector<matrix34> &palette);
 	TKey& GetInterpolatedKey(TTrack &t,int frame,float weight,bool normalize=false);
 	void  ResampleAnimationTracks(double frames_per_second);
 	void	DrawSkeleton();
@@ -79,9 +135,11 @@ void MeshAnimation::DrawSkeleton()
 {
 	for (int i = 0; i < bones.size(); i++)
 			{
+				float m[16];
+				bones[i].matrix.get_gl(m);
 				glPushMatrix();
 				glColor3f(1,0,1);
-				glMultMatrixf((float*)bones[i].matrix.m);
+				glMultMatrixf(m);
 				glutSolidCube(0.3);
 				glPopMatrix();
 			}
@@ -105,29 +163,54 @@ MeshAnimation::TKey& MeshAnimation::GetInterpolatedKey(TTrack &t,int frame,float
 	return k;
 }
 
-void MeshAnimation::EvalSubtree(int id,TAnimation &ani,int frame, float weight=0)
+void MeshAnimation::EvalBone(int id,TAnimation &ani,int frame, float weight=0)
+{
+	if(ani.tracks[id].keys.size()>frame) // add animated pose if track available
+	if(frame>=0)
+	{	
+		EvalBoneKey(id,&GetInterpolatedKey(ani.tracks[id],frame,weight));
+		return;
+	}
+	EvalBoneKey(id,0);
+}
+
+void MeshAnimation::EvalBoneKey(int id,const TKey *k)
 {
-	TBone &b=bones[id];	matrix44 a,m,minv;
+	TBone &b=bones[id];	matrix34 a,m;
 	
 	// bind pose : default
 	vec3f pos(b.pos[0],b.pos[1],b.pos[2]);
 	m.set(b.rot[0],b.rot[1],b.rot[2],b.rot[3]);		
 	
-	if(ani.tracks[id].keys.size()>frame) // add animated pose if track available
-	if(frame>=0)
+	if(k) // add animated pose
 	{	
-		TKey &k=GetInterpolatedKey(ani.tracks[id],frame,weight);
-		a.set(k.rot[0],k.rot[1],k.rot[2],k.rot[3]);		
-		pos=pos+vec3f(k.pos[0],k.pos[1],k.pos[2]);
+		a.set(k->rot[0],k->rot[1],k->rot[2],k->rot[3]);		
+		pos=pos+vec3f(k->pos[0],k->pos[1],k->pos[2]);
 		m=a*m;
 	}
 	m.set_translation(pos);
 		
-	// store bone matrix
+	// store bone matrix (parent is already evaluated, see BuildEvalOrder)
 	if(b.parent>=0) b.matrix=m*bones[b.parent].matrix; else b.matrix=m; 
+}
 
-	// progress through tree
-	for(int i = 0; i < b.childs.size(); i++) EvalSubtree(b.childs[i],ani,frame,weight);
+void MeshAnimation::BuildEvalOrder()
+{
+	// breadth first from the roots: every parent precedes its children
+	evalOrder.clear();
+	for (int i = 0; i < bones.size(); i++) if (bones[i].parent==-1) evalOrder.push_back(i);
+	for (int i = 0; i < evalOrder.size(); i++)
+	{
+		TBone &b=bones[evalOrder[i]];
+		evalOrder.insert(evalOrder.end(),b.childs.begin(),b.childs.end());
+	}
+	if(evalOrder.size()!=bones.size()) error_stop("bone hierarchy has a cycle\n");
+}
+
+void MeshAnimation::GetSkinningPalette(std::vector<matrix34> &palette)
+{
+	palette.resize(bones.size());
+	for (int i = 0; i < bones.size(); i++) palette[i]=bones[i].invbindmatrix*bones[i].matrix;
 }
 
 void MeshAnimation::SetPose(int animation_index,double time)
@@ -139,29 +222,112 @@ void MeshAnimation::SetPose(int animation_index,double time)
 	time01=time01-floor(time01);
 	float frame=(ani.frameCount-2)*time01+1;
 	
-	for (int i = 0; i < bones.size(); i++) bones[i].matrix.ident();
-	for (int i = 0; i < bones.size(); i++) if (bones[i].parent==-1) EvalSubtree(i,ani,int(frame),frac(frame));
+	for (int i = 0; i < evalOrder.size(); i++) EvalBone(evalOrder[i],ani,int(frame),frac(frame));
+}
+
+// Sample one animation at many times at once (e.g. one time per crowd
+// instance). Writes instance-major local poses: the key of bone b for
+// instance i is poses[i*bones.size()+b]. Bones without a track get an
+// identity key, which EvalBoneKey turns into the bind pose.
+void MeshAnimation::SamplePoses(int animation_index,const double *times,int instanceCount,std::vector<TKey> &poses)
+{
+	if(animation_index>=animations.size()) error_stop("animation index %d out of range",animation_index);
+
+	enum { LANES = 4, CHANNELS = 7 };	// rot[4] + pos[3]
+	TAnimation &ani=animations[animation_index];
+	int boneCount=bones.size();
+	poses.resize(instanceCount*boneCount);
+
+	// frame and blend weight per instance, as in SetPose
+	std::vector<int>	frames(instanceCount);
+	std::vector<float>	weights(instanceCount);
+	for(int i = 0; i < instanceCount; i++)
+	{
+		double time01=times[i]/double(ani.timeLength);
+		time01=time01-floor(time01);
+		float frame=(ani.frameCount-2)*time01+1;
+		frames[i]=int(frame);
+		weights[i]=frac(frame);
+	}
+
+	for(int b = 0; b < boneCount; b++)
+	{
+		TTrack &t=ani.tracks[b];
+		int n=t.keys.size();
+		for(int i0 = 0; i0 < instanceCount; i0 += LANES)
+		{
+			int lanes=mmin(int(LANES),instanceCount-i0);
+
+			// gather both keys of every lane into channel-major registers
+			#if defined(__GNUC__)
+			TPoseLanes k0[CHANNELS],k1[CHANNELS],w,r[CHANNELS];
+			#else
+			float k0[CHANNELS][LANES],k1[CHANNELS][LANES],w[LANES],r[CHANNELS][LANES];
+			#endif
+			for(int l = 0; l < LANES; l++)
+			{
+				int f=frames[i0+mmin(l,lanes-1)];
+				if(n>f && f>=0)
+				{
+					TKey &a=t.keys[(f  ) % n];
+					TKey &c=t.keys[(f+1) % n];
+					for(int ch = 0; ch < 4; ch++) { k0[ch][l]=a.rot[ch];   k1[ch][l]=c.rot[ch]; }
+					for(int ch = 0; ch < 3; ch++) { k0[4+ch][l]=a.pos[ch]; k1[4+ch][l]=c.pos[ch]; }
+					w[l]=weights[i0+mmin(l,lanes-1)];
+				}
+				else
+				{
+					for(int ch = 0; ch < CHANNELS; ch++) k0[ch][l]=k1[ch][l]=0;
+					w[l]=0;
+				}
+			}
+
+			// interpolate all lanes at once
+			#if defined(__GNUC__)
+			TPoseLanes w1=1.0f-w;
+			for(int ch = 0; ch < CHANNELS; ch++) r[ch]=k0[ch]*w1+k1[ch]*w;
+			#else
+			for(int ch = 0; ch < CHANNELS; ch++)
+				for(int l = 0; l < LANES; l++) r[ch][l]=k0[ch][l]*(1.0f-w[l])+k1[ch][l]*w[l];
+			#endif
+
+			for(int l = 0; l < lanes; l++)
+			{
+				TKey &k=poses[(i0+l)*boneCount+b];
+				k.time=times[i0+l];
+				for(int ch = 0; ch < 4; ch++) k.rot[ch]=r[ch][l];
+				for(int ch = 0; ch < 3; ch++) k.pos[ch]=r[4+ch][l];
+			}
+		}
+	}
+}
+
+// Set bone matrices from one instance of SamplePoses (bones.size() keys)
+void MeshAnimation::SetLocalPose(const TKey *pose)
+{
+	for (int i = 0; i < evalOrder.size(); i++) EvalBoneKey(evalOrder[i],&pose[evalOrder[i]]);
 }
 
 void MeshAnimation::SetBindPose()
 {
 	TAnimation &ani=animations[0];	
-	for(int i = 0; i < bones.size(); i++) bones[i].matrix.ident();
-	for(int i = 0; i < bones.size(); i++) if (bones[i].parent==-1) EvalSubtree(i,ani,-1,0);
+	for(int i = 0; i < evalOrder.size(); i++) EvalBone(evalOrder[i],ani,-1,0);
 	for(int i = 0; i < bones.size(); i++) bones[i].invbindmatrix=bones[i].matrix;
 	for(int i = 0; i < bones.size(); i++) bones[i].invbindmatrix.invert_simpler();
 }
 	
-int MeshAnimation::GetAnimationIndexOf ( char* name )
+int MeshAnimation::GetAnimationIndexOf ( const char* name )
 {
-	for(int i = 0; i < animations.size(); i++) if (strcmp(name, animations[i].name)==0) return i;
-	error_stop("animation %s not found!",name);
+	int id=animationNames.Find(name);
+	if(id<0) error_stop("animation %s not found!",name);
+	return id;
 }
 
-int MeshAnimation::GetBoneIndexOf ( char* name )
+int MeshAnimation::GetBoneIndexOf ( const char* name )
 {
-	for(int i = 0; i < bones.size(); i++) if (strcmp(name,bones[i].name)==0) return i;
-	error_stop( "Error! Bone [%s] does not exist!" ,name );
+	int id=boneNames.Find(name);
+	if(id<0) error_stop( "Error! Bone [%s] does not exist!" ,name );
+	return id;
 }
 void MeshAnimation::ResampleAnimationTracks(double frames_per_second)
 {
@@ -200,6 +366,8 @@ void MeshAnimation::LoadSkeletonXML (const char* ogreXMLfileName)
 {
 	animations.clear();
 	bones.clear();
+	boneNames.Clear();
+	animationNames.Clear();
 
 	TiXmlDocument doc( ogreXMLfileName );
 	if ( !doc.LoadFile() ) error_stop( "File %s load error %s\n", ogreXMLfileName, doc.ErrorDesc() );
@@ -243,8 +411,8 @@ void MeshAnimation::LoadSkeletonXML (const char* ogreXMLfileName)
 		assert( result == 0 );
 		
 		TBone bone;
-		sprintf( bone.name ,"%s", cBoneName);
-		bone.nameLength = strnlen(bone.name,NAME_LEN);
+		bone.nameId = boneNames.Intern(cBoneName ? cBoneName : "");
+		if(bone.nameId!=bones.size()) error_stop("duplicate bone name %s\n",cBoneName);
 		bone.rot[0]    = dAxisAngle;
 		bone.rot[1]    = dAxisX;
 		bone.rot[2]    = dAxisY;
@@ -268,8 +436,8 @@ void MeshAnimation::LoadSkeletonXML (const char* ogreXMLfileName)
 		const char* cBoneParentName;
 		cBoneName = boneParentElement->Attribute( "bone" );
 		cBoneParentName = boneParentElement->Attribute( "parent" );
-		int cBoneIndex		= GetBoneIndexOf((char*)cBoneName);
-		int cBoneParentIndex	= GetBoneIndexOf((char*)cBoneParentName);		//printf ( "Bone[%s,%d] -> Parent[%s,%d]\n" , cBoneName , cBoneIndex, cBoneParentName , cBoneParentIndex ) ;
+		int cBoneIndex		= GetBoneIndexOf(cBoneName);
+		int cBoneParentIndex	= GetBoneIndexOf(cBoneParentName);		//printf ( "Bone[%s,%d] -> Parent[%s,%d]\n" , cBoneName , cBoneIndex, cBoneParentName , cBoneParentIndex ) ;
 		bones[ cBoneIndex ].parent = cBoneParentIndex;
 	}
 
@@ -279,6 +447,7 @@ void MeshAnimation::LoadSkeletonXML (const char* ogreXMLfileName)
 		int p=bones[i].parent;
 		if(p>=0) bones[p].childs.push_back(i);	
 	}
+	BuildEvalOrder();
 
 	// build hierarchy out
 	animationsElement = skeletonNode->FirstChildElement( "animations" );assert( animationsElement );
@@ -291,14 +460,14 @@ void MeshAnimation::LoadSkeletonXML (const char* ogreXMLfileName)
 		const char* cAnimationName;
 		cAnimationName = animationElement->Attribute( "name" );
 		result = animationElement->QueryDoubleAttribute( "length", &dAnimationLength );
-		printf ( "Animation[%d] Name:[%s] , Length: %3.03f sec \n" ,animations.size(), cAnimationName , (float) dAnimationLength ) ;
+		printf ( "Animation[%d] Name:[%s] , Length: %3.03f sec \n" ,(int)animations.size(), cAnimationName , (float) dAnimationLength ) ;
 		
 		// --- Fill Memory Begin ---//
 		
 		TAnimation animation;
 		animation.frameCount=0;
-		sprintf( animation.name ,"%s", cAnimationName);
-		animation.nameLength = strnlen(animation.name,NAME_LEN);
+		animation.nameId = animationNames.Intern(cAnimationName ? cAnimationName : "");
+		if(animation.nameId!=animations.size()) error_stop("duplicate animation name %s\n",cAnimationName);
 		animation.timeLength = dAnimationLength;
 		std::vector<TTrack> &tracks = animation.tracks;
 		tracks.resize(bones.size());
@@ -317,7 +486,7 @@ void MeshAnimation::LoadSkeletonXML (const char* ogreXMLfileName)
 			//printf ( "\n   Bone Name:[%s]\n\n" , cBoneName ) ;
 			
 			// --- Fill Memory Begin ---//
-			int trackIndex = GetBoneIndexOf((char*)cBoneName);
+			int trackIndex = GetBoneIndexOf(cBoneName);
 			TTrack &track = tracks[ trackIndex ];
 			//sprintf( track.name ,"%s", cBoneName);
 			// --- Fill Memory End ---//
@@ -369,7 +538,243 @@ void MeshAnimation::LoadSkeletonXML (const char* ogreXMLfileName)
 	ResampleAnimationTracks(20);// 20 keyframes per second
 	SetBindPose();				// store bind pose
 
-	printf ( "Skeleton: %d bones\n\n" , bones.size() ) ;
+	printf ( "Skeleton: %d bones\n\n" , (int)bones.size() ) ;
+
+	if(bones.size()>InfluenceTable::MAX_BONES) error_stop("too many bones in skeleton (%d>%d)\n",bones.size(),InfluenceTable::MAX_BONES);
+}
+
+// quaternion x,y,z,w -> rot[4] = angle,x,y,z (angle in [0,pi])
+static void QuatToAngleAxis(const float *q,float *rot)
+{
+	float sign=q[3]<0 ? -1 : 1;
+	float w=clamp(sign*q[3],-1.0f,1.0f);
+	float s=sqrt(mmax(1-w*w,0.0f));
+	rot[0]=2*acos(w);
+	if(s<1e-6) { rot[1]=1; rot[2]=0; rot[3]=0; return; }
+	for(int k = 0; k < 3; k++) rot[k+1]=sign*q[k]/s;
+}
+
+// Keys are interpolated as angle and axis: give identity keys the axis
+// of a neighbour, flip axes (and angles) to agree along the track, and
+// take the angle (mod 2 pi) closest to the previous key's
+static void AlignKeyAxes(std::vector<MeshAnimation::TKey> &keys)
+{
+	for(int k = 0; k < keys.size(); k++)
+	if(keys[k].rot[0]<1e-6)
+	for(int d = 1; d < keys.size(); d++)
+	{
+		int n=k-d>=0 && keys[k-d].rot[0]>=1e-6 ? k-d : (k+d<keys.size() && keys[k+d].rot[0]>=1e-6 ? k+d : -1);
+		if(n<0) continue;
+		for(int c = 1; c < 4; c++) keys[k].rot[c]=keys[n].rot[c];
+		break;
+	}
+	for(int k = 1; k < keys.size(); k++)
+	{
+		float *r=keys[k].rot,*p=keys[k-1].rot;
+		if(r[1]*p[1]+r[2]*p[2]+r[3]*p[3]<0)
+			for(int c = 0; c < 4; c++) r[c]=-r[c];
+		while(r[0]-p[0]>M_PI) r[0]-=2*M_PI;
+		while(r[0]-p[0]<-M_PI) r[0]+=2*M_PI;
+	}
+}
+
+// Bones, clips and (optionally) mesh and authored weights of a binary
+// glTF file (see GLBFile.h). Bones are the skin joints, in order, so the
+// influences index them directly. glTF keys are absolute local transforms:
+// they are stored as rotations and offsets from the rest pose, as Ogre keys.
+bool MeshAnimation::LoadGLB (const char* glbFileName, TriangleMesh* mesh, InfluenceTable* influences)
+{
+	GLBFile file;
+	std::vector<GLBFile::Joint> joints;
+	std::vector<GLBFile::Clip> clips;
+	int skin=-1;
+	if(!file.open(glbFileName)) return false;
+	if(mesh && !file.readMesh(*mesh,influences,&skin)) return false;
+	if(!file.readSkeleton(joints,clips,skin)) return false;
+	if(joints.size()>InfluenceTable::MAX_BONES) { printf("GLB: too many joints (%d)\n",(int)joints.size()); return false; }
+
+	animations.clear();
+	bones.clear();
+	boneNames.Clear();
+	animationNames.Clear();
+
+	for(int j = 0; j < joints.size(); j++)
+	{
+		GLBFile::Joint &joint=joints[j];
+		std::string name=joint.name.empty() ? "joint" : joint.name;
+		if(boneNames.Find(name.c_str())>=0) { char suffix[16]; sprintf(suffix,"#%d",j); name+=suffix; }
+		TBone bone;
+		bone.nameId=boneNames.Intern(name.c_str());
+		QuatToAngleAxis(joint.rotation,bone.rot);
+		for(int k = 0; k < 3; k++) bone.pos[k]=joint.translation[k];
+		bone.parent=joint.parent;
+		bones.push_back(bone);
+	}
+	for(int i = 0; i < bones.size(); i++)
+	{
+		int p=bones[i].parent;
+		if(p>=0) bones[p].childs.push_back(i);
+	}
+	BuildEvalOrder();
+
+	for(int a = 0; a < clips.size(); a++)
+	{
+		std::string name=clips[a].name;
+		if(animationNames.Find(name.c_str())>=0) { char suffix[16]; sprintf(suffix,"#%d",a); name+=suffix; }
+		TAnimation animation;
+		animation.nameId=animationNames.Intern(name.c_str());
+		animation.timeLength=clips[a].length;
+		animation.frameCount=0;
+		animation.tracks.resize(bones.size());
+		for(int j = 0; j < bones.size(); j++)
+		{
+			const GLBFile::Track &src=clips[a].tracks[j];
+			const float *rest=joints[j].rotation;
+			for(int k = 0; k < src.times.size(); k++)
+			{
+				// key rotation = rest^-1 * absolute rotation
+				const float *q=&src.rotations[4*k];
+				float d[4]={
+					rest[3]*q[0] - rest[0]*q[3] - rest[1]*q[2] + rest[2]*q[1],
+					rest[3]*q[1] + rest[0]*q[2] - rest[1]*q[3] - rest[2]*q[0],
+					rest[3]*q[2] - rest[0]*q[1] + rest[1]*q[0] - rest[2]*q[3],
+					rest[3]*q[3] + rest[0]*q[0] + rest[1]*q[1] + rest[2]*q[2] };
+				TKey key;
+				key.time=src.times[k];
+				QuatToAngleAxis(d,key.rot);
+				for(int c = 0; c < 3; c++) key.pos[c]=src.translations[3*k+c]-joints[j].translation[c];
+				animation.tracks[j].keys.push_back(key);
+			}
+			AlignKeyAxes(animation.tracks[j].keys);
+			animation.frameCount=mmax(animation.frameCount,(int)src.times.size());
+		}
+		printf ( "Animation[%d] Name:[%s] , Length: %3.03f sec \n" ,(int)animations.size(), name.c_str() , animation.timeLength ) ;
+		animations.push_back(animation);
+	}
+	if(animations.empty())	// SetBindPose and SetPose need a clip
+	{
+		TAnimation animation;
+		animation.nameId=animationNames.Intern("bind pose");
+		animation.timeLength=1;
+		animation.frameCount=0;
+		animation.tracks.resize(bones.size());
+		animations.push_back(animation);
+	}
+	ResampleAnimationTracks(20);// 20 keyframes per second
+	SetBindPose();				// store bind pose
+	for(int j = 0; j < joints.size(); j++)
+		if(joints[j].hasInverseBind) bones[j].invbindmatrix=joints[j].inverseBind;
+
+	printf ( "Skeleton: %d bones from %s\n\n" , (int)bones.size(), glbFileName ) ;
+	return true;
+}
+
+// Ogre binary .skeleton (see OgreBinary.h): bones by handle, parents, and
+// animations whose keys are already relative to the bind pose, as in XML
+bool MeshAnimation::LoadSkeletonBinary (const char* ogreSkeletonFileName)
+{
+	enum { SKELETON_BONE = 0x2000, SKELETON_BONE_PARENT = 0x3000, SKELETON_ANIMATION = 0x4000,
+		   SKELETON_ANIMATION_TRACK = 0x4100, SKELETON_ANIMATION_TRACK_KEYFRAME = 0x4110 };
+
+	OgreBinaryStream s;
+	if(!s.open(ogreSkeletonFileName)) return false;
+	if(s.version.compare(0,12,"[Serializer_")!=0) { printf("%s is not an Ogre skeleton (%s)\n",ogreSkeletonFileName,s.version.c_str()); return false; }
+
+	animations.clear();
+	bones.clear();
+	boneNames.Clear();
+	animationNames.Clear();
+
+	std::vector<std::string> names;
+	std::vector<bool> present;
+	unsigned short id,subId,keyId;
+	size_t end,subEnd,keyEnd;
+	while(s.nextChunk(s.length(),id,end))
+	{
+		if(id==SKELETON_BONE)
+		{
+			// name, handle, position, orientation (x,y,z,w), optional scale
+			std::string name=s.readString();
+			int handle=s.readShort();
+			float q[4];
+			TBone bone;
+			s.readFloats(bone.pos,3);
+			s.readFloats(q,4);
+			QuatToAngleAxis(q,bone.rot);
+			bone.parent=-1;
+			if(handle>=bones.size()) { bones.resize(handle+1); names.resize(handle+1); present.resize(handle+1,false); }
+			bones[handle]=bone;
+			names[handle]=name;
+			present[handle]=true;
+		}
+		else if(id==SKELETON_BONE_PARENT)
+		{
+			int handle=s.readShort();
+			int parent=s.readShort();
+			if(handle>=bones.size() || parent>=bones.size() || !present[handle] || !present[parent])
+			{ printf("%s: parent of an unknown bone\n",ogreSkeletonFileName); return false; }
+			bones[handle].parent=parent;
+		}
+		else if(id==SKELETON_ANIMATION)
+		{
+			TAnimation animation;
+			std::string name=s.readString();
+			animation.nameId=animationNames.Intern(name.c_str());
+			if(animation.nameId!=animations.size()) { printf("%s: duplicate animation name %s\n",ogreSkeletonFileName,name.c_str()); return false; }
+			animation.timeLength=s.readFloat();
+			animation.frameCount=0;
+			animation.tracks.resize(bones.size());
+			while(s.nextChunk(end,subId,subEnd))
+			{
+				if(subId==SKELETON_ANIMATION_TRACK)
+				{
+					int bone=s.readShort();
+					if(bone>=bones.size()) { printf("%s: track of an unknown bone\n",ogreSkeletonFileName); return false; }
+					TTrack &track=animation.tracks[bone];
+					while(s.nextChunk(subEnd,keyId,keyEnd))
+					{
+						if(keyId==SKELETON_ANIMATION_TRACK_KEYFRAME)
+						{
+							// time, rotation (x,y,z,w), translation, optional scale
+							TKey key;
+							float q[4];
+							key.time=s.readFloat();
+							s.readFloats(q,4);
+							s.readFloats(key.pos,3);
+							QuatToAngleAxis(q,key.rot);
+							track.keys.push_back(key);
+						}
+						s.seek(keyEnd);
+					}
+					AlignKeyAxes(track.keys);
+					animation.frameCount=mmax(animation.frameCount,(int)track.keys.size());
+				}
+				s.seek(subEnd);
+			}
+			printf ( "Animation[%d] Name:[%s] , Length: %3.03f sec \n" ,(int)animations.size(), name.c_str() , animation.timeLength ) ;
+			animations.push_back(animation);
+		}
+		s.seek(end);
+	}
+	if(s.failed()) { printf("%s is truncated or malformed\n",ogreSkeletonFileName); return false; }
+
+	// handles must be 0..n-1; names are interned in handle order
+	for(int i = 0; i < bones.size(); i++)
+	{
+		if(!present[i]) { printf("%s: bone handle %d missing\n",ogreSkeletonFileName,i); return false; }
+		bones[i].nameId=boneNames.Intern(names[i].c_str());
+		if(bones[i].nameId!=i) { printf("%s: duplicate bone name %s\n",ogreSkeletonFileName,names[i].c_str()); return false; }
+		int p=bones[i].parent;
+		if(p>=0) bones[p].childs.push_back(i);
+	}
+	for(int a = 0; a < animations.size(); a++) animations[a].tracks.resize(bones.size());
+	if(bones.empty() || animations.empty()) { printf("%s: no bones or no animation\n",ogreSkeletonFileName); return false; }
+	BuildEvalOrder();
+	ResampleAnimationTracks(20);// 20 keyframes per second
+	SetBindPose();				// store bind pose
+
+	printf ( "Skeleton: %d bones\n\n" , (int)bones.size() ) ;
 
-	if(bones.size()>=100) error_stop("too many bones in skeleton (%d>100)\n",bones.size());
+	if(bones.size()>InfluenceTable::MAX_BONES) error_stop("too many bones in skeleton (%d>%d)\n",bones.size(),InfluenceTable::MAX_BONES);
+	return true;
 }
@@ -0,0 +1,166 @@
+/**
+  * Half-edge connectivity of a TriangleMesh.
+  *
+  */
+
+#include "MeshConnectivity.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <functional>
+
+// Run body(begin, end) on threadCount contiguous slices of [0, n)
+static void parallelFor(int n, int threadCount, const std::function<void(int, int)> & body)
+{
+	if(threadCount <= 1 || n < 1024)
+	{
+		body(0, n);
+		return;
+	}
+	std::vector<std::thread> workers;
+	for(int t=0; t<threadCount; t++)
+		workers.push_back(std::thread(body, (int)((long long)n * t / threadCount), (int)((long long)n * (t+1) / threadCount)));
+	for(int t=0; t<threadCount; t++)
+		workers[t].join();
+}
+
+MeshConnectivity::MeshConnectivity() :
+    nonManifoldEdges(0),
+    source(0),
+    sourceRevision(0),
+    sourceVertices(0),
+    sourceTriangles(0)
+{
+	faceOffsets.push_back(0);
+}
+
+// Forget the mesh
+void MeshConnectivity::invalidate()
+{
+	source = 0;
+}
+
+// Rebuild if the mesh changed since the last build
+bool MeshConnectivity::update(const TriangleMesh & mesh, int threadCount)
+{
+	if(source == &mesh && sourceRevision == mesh.topologyRevision &&
+	   sourceVertices == mesh.vertices.size() && sourceTriangles == mesh.triangles.size())
+		return false;
+	build(mesh, threadCount);
+	source = &mesh;
+	sourceRevision = mesh.topologyRevision;
+	sourceVertices = mesh.vertices.size();
+	sourceTriangles = mesh.triangles.size();
+	return true;
+}
+
+//////////////////////////////////////////////////
+// Parallel build: vertex -> face rows, then opposites by searching the
+// faces around each half-edge's target
+//////////////////////////////////////////////////
+
+void MeshConnectivity::build(const TriangleMesh & mesh, int threadCount)
+{
+	int n = mesh.vertices.size();
+	int t = mesh.triangles.size();
+	if(threadCount <= 0)
+		threadCount = std::thread::hardware_concurrency();
+
+	origin.resize(3*t);
+	opposite.resize(3*t);
+	vertexEdge.assign(n, -1);
+	faceOffsets.assign(n+1, 0);
+	faces.resize(3*t);
+
+	// origins and face counts per vertex
+	std::vector<std::atomic<unsigned int> > counts(n);
+	for(int v=0; v<n; v++)
+		counts[v] = 0;
+	parallelFor(t, threadCount, [&](int begin, int end) {
+		for(int f=begin; f<end; f++)
+		{
+			const TriangleMesh::Triangle & tri = mesh.triangles[f];
+			origin[3*f] = tri.a;
+			origin[3*f+1] = tri.b;
+			origin[3*f+2] = tri.c;
+			counts[tri.a]++;
+			counts[tri.b]++;
+			counts[tri.c]++;
+		}
+	});
+	for(int v=0; v<n; v++)
+	{
+		faceOffsets[v+1] = faceOffsets[v] + counts[v];
+		counts[v] = faceOffsets[v];          // now the fill cursor
+	}
+
+	// fill the rows (in any order), then sort each row
+	parallelFor(3*t, threadCount, [&](int begin, int end) {
+		for(int h=begin; h<end; h++)
+			faces[counts[origin[h]]++] = h / 3;
+	});
+	parallelFor(n, threadCount, [&](int begin, int end) {
+		for(int v=begin; v<end; v++)
+			std::sort(faces.begin()+faceOffsets[v], faces.begin()+faceOffsets[v+1]);
+	});
+
+	// opposite of a -> b: the half-edge b -> a in a face of b
+	std::atomic<int> nonManifold(0);
+	parallelFor(3*t, threadCount, [&](int begin, int end) {
+		int found = 0;
+		for(int h=begin; h<end; h++)
+		{
+			unsigned int a = origin[h], b = origin[next(h)];
+			int match = -1, candidates = 0;
+			for(unsigned int k=faceOffsets[b]; k<faceOffsets[b+1]; k++)
+			{
+				int f = faces[k];
+				for(int i=0; i<3; i++)
+					if(origin[3*f+i] == b && origin[3*f+(i+1)%3] == a)
+					{
+						if(match < 0)
+							match = 3*f+i;
+						candidates++;
+					}
+			}
+			opposite[h] = match;
+			found += candidates > 1;
+		}
+		nonManifold += found;
+	});
+	nonManifoldEdges = nonManifold;
+
+	// one outgoing half-edge per vertex, a boundary one when there is one
+	parallelFor(n, threadCount, [&](int begin, int end) {
+		for(int v=begin; v<end; v++)
+			for(unsigned int k=faceOffsets[v]; k<faceOffsets[v+1]; k++)
+			{
+				int f = faces[k];
+				for(int i=0; i<3; i++)
+					if(origin[3*f+i] == v && (vertexEdge[v] < 0 || opposite[prev(3*f+i)] < 0))
+						vertexEdge[v] = 3*f+i;
+			}
+	});
+}
+
+// One-ring of v: the other corners of its faces, each once
+void MeshConnectivity::vertexNeighbors(unsigned int v, std::vector<unsigned int> & out) const
+{
+	out.clear();
+	for(unsigned int k=faceOffsets[v]; k<faceOffsets[v+1]; k++)
+	{
+		int f = faces[k];
+		for(int i=0; i<3; i++)
+			if(origin[3*f+i] != v && std::find(out.begin(), out.end(), origin[3*f+i]) == out.end())
+				out.push_back(origin[3*f+i]);
+	}
+}
+
+// Bytes used by the arrays
+size_t MeshConnectivity::bytes() const
+{
+	return origin.size() * sizeof(unsigned int) + opposite.size() * sizeof(int) +
+	       vertexEdge.size() * sizeof(int) + faceOffsets.size() * sizeof(unsigned int) +
+	       faces.size() * sizeof(unsigned int);
+}
@@ -0,0 +1,71 @@
+/**
+  * Half-edge connectivity of a TriangleMesh, in flat arrays.
+  *
+  * Half-edge h = 3*t + i is corner i -> corner i+1 of triangle t, so its
+  * face, next and previous half-edges are implicit. Stored per half-edge
+  * are its origin vertex and its opposite (-1 on a boundary); per vertex,
+  * one outgoing half-edge (a boundary one if any) and its faces in
+  * compressed rows: faces[faceOffsets[v] .. faceOffsets[v+1]), sorted.
+  *
+  * Memory is 36 bytes per triangle plus 8 bytes per vertex (about 40
+  * bytes per triangle on a closed mesh, where V ~ T/2); see bytes().
+  *
+  * The structure is built in parallel and rebuilt lazily: update(mesh)
+  * does nothing unless the mesh, its vertex or triangle count or its
+  * topologyRevision changed since the last build. Code that edits
+  * mesh.triangles in place must call mesh.topologyChanged().
+  */
+
+#ifndef MESH_CONNECTIVITY_H
+#define MESH_CONNECTIVITY_H
+
+#include <vector>
+#include "TriangleMesh.h"
+
+class MeshConnectivity
+{
+public:
+	// Member variables
+	std::vector<unsigned int> origin;        // 3 per triangle
+	std::vector<int> opposite;               // 3 per triangle, -1 on a boundary
+	std::vector<int> vertexEdge;             // outgoing half-edge per vertex, -1 if isolated
+	std::vector<unsigned int> faceOffsets;   // vertexCount()+1 entries
+	std::vector<unsigned int> faces;
+
+	MeshConnectivity();
+
+	// Rebuild if mesh changed since the last build (threadCount 0: every core).
+	// Returns true if it was rebuilt.
+	bool update(const TriangleMesh & mesh, int threadCount = 0);
+
+	// Forget the mesh (the next update() rebuilds)
+	void invalidate();
+
+	int vertexCount() const { return vertexEdge.size(); }
+	int halfEdgeCount() const { return origin.size(); }
+
+	// Implicit relations
+	static int face(int h) { return h / 3; }
+	static int next(int h) { return h % 3 == 2 ? h - 2 : h + 1; }
+	static int prev(int h) { return h % 3 == 0 ? h + 2 : h - 1; }
+	unsigned int target(int h) const { return origin[next(h)]; }
+	bool isBoundary(int h) const { return opposite[h] < 0; }
+
+	// Neighbors of v (one-ring, each once), by walking the faces of v
+	void vertexNeighbors(unsigned int v, std::vector<unsigned int> & out) const;
+
+	// Number of half-edges with two or more candidate opposites
+	int nonManifoldEdges;
+
+	// Bytes used by the arrays
+	size_t bytes() const;
+
+private:
+	void build(const TriangleMesh & mesh, int threadCount);
+
+	const TriangleMesh * source;
+	unsigned int sourceRevision;
+	size_t sourceVertices, sourceTriangles;
+};
+
+#endif // MESH_CONNECTIVITY_H
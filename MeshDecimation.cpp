@@ -0,0 +1,640 @@
+/**
+  * Quadric error mesh decimation.
+  *
+  */
+
+#include "MeshDecimation.h"
+
+#include <cmath>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+
+// Boundary planes weigh this much more than the triangle planes
+static const double BOUNDARY_WEIGHT = 100;
+
+// End of a linked list
+static const unsigned int NONE = ~0u;
+
+namespace
+{
+
+// Inline 3D arithmetic for the inner loops (Vector3 is not inlined)
+struct Point
+{
+	double x, y, z;
+
+	Point() {}
+	Point(double x_, double y_, double z_) : x(x_), y(y_), z(z_) {}
+	Point operator+(const Point & o) const { return Point(x+o.x, y+o.y, z+o.z); }
+	Point operator-(const Point & o) const { return Point(x-o.x, y-o.y, z-o.z); }
+	Point operator*(double s) const { return Point(x*s, y*s, z*s); }
+	double dot(const Point & o) const { return x*o.x + y*o.y + z*o.z; }
+	Point cross(const Point & o) const { return Point(y*o.z - z*o.y, z*o.x - x*o.z, x*o.y - y*o.x); }
+};
+
+// Symmetric 4x4 quadric: a b c d / b e f g / c f h i / d g i j
+struct Quadric
+{
+	double q[10];
+
+	void clear()
+	{
+		for(int i=0; i<10; i++)
+			q[i] = 0;
+	}
+
+	// Add w * (n.x + d)^2
+	void addPlane(const Point & n, double d, double w)
+	{
+		q[0] += w*n.x*n.x; q[1] += w*n.x*n.y; q[2] += w*n.x*n.z; q[3] += w*n.x*d;
+		q[4] += w*n.y*n.y; q[5] += w*n.y*n.z; q[6] += w*n.y*d;
+		q[7] += w*n.z*n.z; q[8] += w*n.z*d;
+		q[9] += w*d*d;
+	}
+
+	void add(const Quadric & o)
+	{
+		for(int i=0; i<10; i++)
+			q[i] += o.q[i];
+	}
+
+	// A x (upper-left 3x3 block)
+	Point multiply(const Point & p) const
+	{
+		return Point(q[0]*p.x + q[1]*p.y + q[2]*p.z,
+		             q[1]*p.x + q[4]*p.y + q[5]*p.z,
+		             q[2]*p.x + q[5]*p.y + q[7]*p.z);
+	}
+
+	double error(const Point & p) const
+	{
+		return p.dot(multiply(p)) + 2 * (q[3]*p.x + q[6]*p.y + q[8]*p.z) + q[9];
+	}
+
+	// Minimizer of the error, false if the 3x3 block is near singular
+	bool optimum(Point & p) const
+	{
+		double c0 = q[4]*q[7] - q[5]*q[5];
+		double c1 = q[2]*q[5] - q[1]*q[7];
+		double c2 = q[1]*q[5] - q[2]*q[4];
+		double det = q[0]*c0 + q[1]*c1 + q[2]*c2;
+		double scale = q[0] + q[4] + q[7];
+		if(fabs(det) <= 1e-6 * scale*scale*scale)
+			return false;
+		double b0 = -q[3], b1 = -q[6], b2 = -q[8];
+		p.x = (c0*b0 + c1*b1 + c2*b2) / det;
+		p.y = (c1*b0 + (q[0]*q[7] - q[2]*q[2])*b1 + (q[1]*q[2] - q[0]*q[5])*b2) / det;
+		p.z = (c2*b0 + (q[1]*q[2] - q[0]*q[5])*b1 + (q[0]*q[4] - q[1]*q[1])*b2) / det;
+		return true;
+	}
+};
+
+//////////////////////////////////////////////////
+// Decimator state: vertices, their carried weights and triangles
+//////////////////////////////////////////////////
+
+// Candidate of a pass; the position is recomputed when it is applied
+struct Collapse
+{
+	float cost;
+	unsigned int from, to;             // from is merged into to
+};
+
+class Decimator
+{
+public:
+	std::vector<Point> positions;
+	std::vector<Quadric> quadrics;
+	std::vector<char> alive;
+	bool weighted;
+	std::vector<InfluenceTable::BoneIndex> bones;   // MAX_CARRIED_INFLUENCES per vertex
+	std::vector<float> weights;
+	std::vector<unsigned char> counts;
+	std::vector<TriangleMesh::Triangle> triangles;
+	std::vector<char> triangleAlive;
+	// triangles around each vertex, as linked lists of their corners: corner
+	// 3t+i is corner i of triangle t, and moves to the survivor's list when
+	// its vertex is merged
+	std::vector<unsigned int> firstCorner, nextCorner;
+	int liveTriangles;
+	double weightPenalty;
+
+	// every live edge of the current pass, cheapest first
+	std::vector<Collapse> candidates;
+	// vertices merged or moved in the current pass (lockedIn == pass)
+	std::vector<unsigned int> lockedIn;
+	unsigned int pass;
+
+	void init(const TriangleMesh & mesh, const InfluenceTable & influences);
+	void rank();
+	bool locked(const Collapse & c) const { return lockedIn[c.from] == pass || lockedIn[c.to] == pass; }
+	bool apply(const Collapse & c);
+	void snapshot(MeshLOD & lod) const;
+
+private:
+	double place(unsigned int from, unsigned int to, Point & p) const;
+	bool valid(unsigned int u, unsigned int v, const Point & p);
+	bool flips(unsigned int u, unsigned int skip, const Point & p) const;
+	bool boundary(unsigned int a, unsigned int b) const;
+	double weightDistance(unsigned int u, unsigned int v) const;
+	void blendWeights(unsigned int u, unsigned int v, double t);
+
+	std::vector<unsigned int> markA, markB;
+	unsigned int stamp;
+	std::vector<Collapse> sortScratch;
+};
+
+void Decimator::init(const TriangleMesh & mesh, const InfluenceTable & influences)
+{
+	int n = mesh.vertices.size();
+	positions.resize(n);
+	for(int v=0; v<n; v++)
+		positions[v] = Point(mesh.vertices[v][0], mesh.vertices[v][1], mesh.vertices[v][2]);
+	triangles = mesh.triangles;
+	triangleAlive.assign(triangles.size(), 1);
+	liveTriangles = triangles.size();
+	alive.assign(n, 1);
+	lockedIn.assign(n, 0);
+	pass = 0;
+	markA.assign(n, 0);
+	markB.assign(n, 0);
+	stamp = 0;
+
+	// carried weights, normalized
+	weighted = influences.vertexCount() == n;
+	if(weighted)
+	{
+		bones.assign(n * MAX_CARRIED_INFLUENCES, 0);
+		weights.assign(n * MAX_CARRIED_INFLUENCES, 0.0f);
+		counts.assign(n, 0);
+		for(int v=0; v<n; v++)
+		{
+			unsigned int begin = influences.offsets[v];
+			unsigned int end = n_min(influences.offsets[v+1], begin + MAX_CARRIED_INFLUENCES);
+			float sum = 0;
+			for(unsigned int k=begin; k<end; k++)
+				if(influences.weights[k] > 0 && std::isfinite(influences.weights[k]))
+				{
+					bones[v*MAX_CARRIED_INFLUENCES + counts[v]] = influences.bones[k];
+					weights[v*MAX_CARRIED_INFLUENCES + counts[v]] = influences.weights[k];
+					sum += influences.weights[k];
+					counts[v]++;
+				}
+			for(int j=0; j<counts[v]; j++)
+				weights[v*MAX_CARRIED_INFLUENCES + j] /= sum;
+		}
+	}
+
+	// plane quadrics, area weighted
+	quadrics.resize(n);
+	for(int v=0; v<n; v++)
+		quadrics[v].clear();
+	firstCorner.assign(n, NONE);
+	nextCorner.resize(3 * triangles.size());
+	for(int t=0; t<triangles.size(); t++)
+	{
+		const TriangleMesh::Triangle & tri = triangles[t];
+		Point normal = (positions[tri.b] - positions[tri.a]).cross(positions[tri.c] - positions[tri.a]);
+		double area = 0.5 * sqrt(normal.dot(normal));
+		if(area > 0)
+		{
+			normal = normal * (0.5 / area);
+			double d = -normal.dot(positions[tri.a]);
+			quadrics[tri.a].addPlane(normal, d, area);
+			quadrics[tri.b].addPlane(normal, d, area);
+			quadrics[tri.c].addPlane(normal, d, area);
+		}
+		unsigned int corners[3] = { tri.a, tri.b, tri.c };
+		for(int i=2; i>=0; i--)
+		{
+			nextCorner[3*t+i] = firstCorner[corners[i]];
+			firstCorner[corners[i]] = 3*t+i;
+		}
+	}
+
+	// boundary planes, through the edge and perpendicular to its triangle
+	for(int t=0; t<triangles.size(); t++)
+	{
+		const TriangleMesh::Triangle & tri = triangles[t];
+		unsigned int corners[3] = { tri.a, tri.b, tri.c };
+		for(int i=0; i<3; i++)
+		{
+			unsigned int a = corners[i], b = corners[(i+1) % 3];
+			if(!boundary(a, b))
+				continue;
+			Point faceNormal = (positions[tri.b] - positions[tri.a]).cross(positions[tri.c] - positions[tri.a]);
+			Point edge = positions[b] - positions[a];
+			Point normal = edge.cross(faceNormal);
+			double length = sqrt(normal.dot(normal));
+			if(length > 0)
+			{
+				normal = normal * (1 / length);
+				double d = -normal.dot(positions[a]);
+				double w = BOUNDARY_WEIGHT * edge.dot(edge);
+				quadrics[a].addPlane(normal, d, w);
+				quadrics[b].addPlane(normal, d, w);
+			}
+		}
+	}
+}
+
+// Is a -> b on the boundary (no live triangle has b -> a)?
+bool Decimator::boundary(unsigned int a, unsigned int b) const
+{
+	for(unsigned int k=firstCorner[b]; k!=NONE; k=nextCorner[k])
+	{
+		const TriangleMesh::Triangle & tri = triangles[k/3];
+		unsigned int after = k % 3 == 0 ? tri.b : (k % 3 == 1 ? tri.c : tri.a);
+		if(triangleAlive[k/3] && after == a)
+			return false;
+	}
+	return true;
+}
+
+// L1 distance between the weights of u and v
+double Decimator::weightDistance(unsigned int u, unsigned int v) const
+{
+	double distance = 0;
+	const InfluenceTable::BoneIndex * ub = &bones[u*MAX_CARRIED_INFLUENCES];
+	const InfluenceTable::BoneIndex * vb = &bones[v*MAX_CARRIED_INFLUENCES];
+	const float * uw = &weights[u*MAX_CARRIED_INFLUENCES];
+	const float * vw = &weights[v*MAX_CARRIED_INFLUENCES];
+	for(int i=0; i<counts[u]; i++)
+	{
+		float other = 0;
+		for(int j=0; j<counts[v]; j++)
+			if(vb[j] == ub[i])
+				other = vw[j];
+		distance += fabs(uw[i] - other);
+	}
+	for(int j=0; j<counts[v]; j++)
+	{
+		bool shared = false;
+		for(int i=0; i<counts[u]; i++)
+			shared = shared || ub[i] == vb[j];
+		if(!shared)
+			distance += vw[j];
+	}
+	return distance;
+}
+
+// Best position p for merging from and to, and its cost
+double Decimator::place(unsigned int from, unsigned int to, Point & p) const
+{
+	Quadric q = quadrics[from];
+	q.add(quadrics[to]);
+	Point edge = positions[to] - positions[from];
+	Point middle = positions[from] + edge * 0.5;
+	double l2 = edge.dot(edge);
+	if(!q.optimum(p) || (p - middle).dot(p - middle) > l2)
+	{
+		// best point of the edge: the error is quadratic along it
+		double curvature = edge.dot(q.multiply(edge));
+		double t = 0.5;
+		if(curvature > 0)
+		{
+			Point g = q.multiply(positions[from]) + Point(q.q[3], q.q[6], q.q[8]);
+			t = n_max(0.0, n_min(1.0, -edge.dot(g) / curvature));
+		}
+		p = positions[from] + edge * t;
+	}
+	double cost = n_max(0.0, q.error(p));
+	if(weighted && weightPenalty > 0)
+	{
+		double w = weightDistance(from, to);
+		cost += weightPenalty * w * w * l2 * l2;
+	}
+	return cost;
+}
+
+//////////////////////////////////////////////////
+// Candidates of a pass
+//////////////////////////////////////////////////
+
+// Sort by cost: LSD radix sort on the bits of the (non-negative) floats,
+// which order like the floats themselves
+static void sortByCost(std::vector<Collapse> & entries, std::vector<Collapse> & scratch)
+{
+	scratch.resize(entries.size());
+	for(int shift=0; shift<32; shift+=11)
+	{
+		unsigned int counts[2048] = { 0 };
+		for(size_t k=0; k<entries.size(); k++)
+		{
+			unsigned int bits;
+			memcpy(&bits, &entries[k].cost, 4);
+			counts[bits >> shift & 2047]++;
+		}
+		unsigned int sum = 0;
+		for(int d=0; d<2048; d++)
+		{
+			unsigned int c = counts[d];
+			counts[d] = sum;
+			sum += c;
+		}
+		for(size_t k=0; k<entries.size(); k++)
+		{
+			unsigned int bits;
+			memcpy(&bits, &entries[k].cost, 4);
+			scratch[counts[bits >> shift & 2047]++] = entries[k];
+		}
+		entries.swap(scratch);
+	}
+}
+
+// Cost every live edge once, in vertex order (so the vertex data is read
+// nearly sequentially), and sort them; starts a new pass
+void Decimator::rank()
+{
+	candidates.clear();
+	for(unsigned int a=0; a<positions.size(); a++)
+	{
+		if(!alive[a])
+			continue;
+		stamp++;
+		for(unsigned int k=firstCorner[a]; k!=NONE; k=nextCorner[k])
+		{
+			if(!triangleAlive[k/3])
+				continue;
+			const TriangleMesh::Triangle & tri = triangles[k/3];
+			unsigned int corners[3] = { tri.a, tri.b, tri.c };
+			for(int i=0; i<3; i++)
+			{
+				unsigned int b = corners[i];
+				if(b > a && markA[b] != stamp)
+				{
+					markA[b] = stamp;
+					Collapse c;
+					Point p;
+					c.cost = n_max(0.0, place(a, b, p));
+					c.from = a;
+					c.to = b;
+					candidates.push_back(c);
+				}
+			}
+		}
+	}
+	sortByCost(candidates, sortScratch);
+	pass++;
+}
+
+// Would moving u to p flip (or flatten) one of its triangles not containing skip?
+bool Decimator::flips(unsigned int u, unsigned int skip, const Point & p) const
+{
+	for(unsigned int k=firstCorner[u]; k!=NONE; k=nextCorner[k])
+	{
+		if(!triangleAlive[k/3])
+			continue;
+		const TriangleMesh::Triangle & tri = triangles[k/3];
+		if(tri.a == skip || tri.b == skip || tri.c == skip)
+			continue;
+		const Point & a = tri.a == u ? p : positions[tri.a];
+		const Point & b = tri.b == u ? p : positions[tri.b];
+		const Point & c = tri.c == u ? p : positions[tri.c];
+		Point before = (positions[tri.b] - positions[tri.a]).cross(positions[tri.c] - positions[tri.a]);
+		Point after = (b - a).cross(c - a);
+		if(before.dot(after) <= 0)
+			return true;
+	}
+	return false;
+}
+
+// Link condition (common neighbors are exactly the apexes of the shared
+// triangles) and no flipped triangle
+bool Decimator::valid(unsigned int u, unsigned int v, const Point & p)
+{
+	stamp++;
+	int shared = 0;
+	for(unsigned int k=firstCorner[u]; k!=NONE; k=nextCorner[k])
+	{
+		if(!triangleAlive[k/3])
+			continue;
+		const TriangleMesh::Triangle & tri = triangles[k/3];
+		markA[tri.a] = markA[tri.b] = markA[tri.c] = stamp;
+		shared += tri.a == v || tri.b == v || tri.c == v;
+	}
+	if(shared == 0)
+		return false;                            // no longer an edge
+
+	int common = 0;
+	for(unsigned int k=firstCorner[v]; k!=NONE; k=nextCorner[k])
+	{
+		if(!triangleAlive[k/3])
+			continue;
+		const TriangleMesh::Triangle & tri = triangles[k/3];
+		unsigned int corners[3] = { tri.a, tri.b, tri.c };
+		for(int i=0; i<3; i++)
+		{
+			unsigned int w = corners[i];
+			if(w != u && w != v && markA[w] == stamp && markB[w] != stamp)
+			{
+				markB[w] = stamp;
+				common++;
+			}
+		}
+	}
+	if(common != shared)
+		return false;
+
+	return !flips(u, v, p) && !flips(v, u, p);
+}
+
+// Weights of v become (1-t) w(u) + t w(v), largest kept
+void Decimator::blendWeights(unsigned int u, unsigned int v, double t)
+{
+	InfluenceTable::BoneIndex mergedBones[2*MAX_CARRIED_INFLUENCES];
+	float mergedWeights[2*MAX_CARRIED_INFLUENCES];
+	int n = 0;
+	for(int side=0; side<2; side++)
+	{
+		unsigned int x = side == 0 ? u : v;
+		float s = side == 0 ? 1 - t : t;
+		for(int i=0; i<counts[x]; i++)
+		{
+			InfluenceTable::BoneIndex b = bones[x*MAX_CARRIED_INFLUENCES + i];
+			float w = s * weights[x*MAX_CARRIED_INFLUENCES + i];
+			int j = 0;
+			for(; j<n && mergedBones[j] != b; j++)
+				;
+			if(j == n)
+			{
+				mergedBones[n] = b;
+				mergedWeights[n++] = 0;
+			}
+			mergedWeights[j] += w;
+		}
+	}
+
+	// largest first, by insertion
+	for(int i=1; i<n; i++)
+		for(int j=i; j>0 && mergedWeights[j] > mergedWeights[j-1]; j--)
+		{
+			std::swap(mergedWeights[j], mergedWeights[j-1]);
+			std::swap(mergedBones[j], mergedBones[j-1]);
+		}
+	n = n_min(n, (int)MAX_CARRIED_INFLUENCES);
+	float sum = 0;
+	for(int i=0; i<n; i++)
+		sum += mergedWeights[i];
+	counts[v] = 0;
+	for(int i=0; i<n && mergedWeights[i] > 0; i++)
+	{
+		bones[v*MAX_CARRIED_INFLUENCES + i] = mergedBones[i];
+		weights[v*MAX_CARRIED_INFLUENCES + i] = mergedWeights[i] / sum;
+		counts[v]++;
+	}
+}
+
+// Merge c.from into c.to (neither may be locked); false if rejected
+bool Decimator::apply(const Collapse & c)
+{
+	unsigned int u = c.from, v = c.to;
+	Point p;
+	place(u, v, p);
+	if(!valid(u, v, p))
+		return false;
+
+	if(weighted)
+	{
+		Point e = positions[v] - positions[u];
+		double l2 = e.dot(e);
+		double t = l2 > 0 ? n_max(0.0, n_min(1.0, (p - positions[u]).dot(e) / l2)) : 0.5;
+		blendWeights(u, v, t);
+	}
+	positions[v] = p;
+	quadrics[v].add(quadrics[u]);
+	alive[u] = 0;
+
+	// triangles of u: shared ones die, the others move to v with their corner
+	for(unsigned int k=firstCorner[u]; k!=NONE; )
+	{
+		unsigned int next = nextCorner[k];
+		unsigned int t = k / 3;
+		TriangleMesh::Triangle & tri = triangles[t];
+		if(!triangleAlive[t])
+			;
+		else if(tri.a == v || tri.b == v || tri.c == v)
+		{
+			triangleAlive[t] = 0;
+			liveTriangles--;
+		}
+		else
+		{
+			unsigned int * corners[3] = { &tri.a, &tri.b, &tri.c };
+			*corners[k % 3] = v;
+			nextCorner[k] = firstCorner[v];
+			firstCorner[v] = k;
+		}
+		k = next;
+	}
+	firstCorner[u] = NONE;
+	for(unsigned int * link = &firstCorner[v]; *link != NONE; )
+		if(!triangleAlive[*link / 3])
+			*link = nextCorner[*link];          // unlink the dead triangles
+		else
+			link = &nextCorner[*link];
+
+	lockedIn[u] = lockedIn[v] = pass;           // their edges cost something else now
+	return true;
+}
+
+// Copy out the live triangles and the vertices they use
+void Decimator::snapshot(MeshLOD & lod) const
+{
+	std::vector<int> newIndex(positions.size(), -1);
+	lod.mesh.vertices.clear();
+	lod.mesh.normals.clear();
+	lod.mesh.triangles.clear();
+	lod.influences.clear();
+	std::vector<unsigned int> used;
+	for(int t=0; t<triangles.size(); t++)
+	{
+		if(!triangleAlive[t])
+			continue;
+		TriangleMesh::Triangle tri = triangles[t];
+		unsigned int * corners[3] = { &tri.a, &tri.b, &tri.c };
+		for(int i=0; i<3; i++)
+		{
+			unsigned int & x = *corners[i];
+			if(newIndex[x] < 0)
+			{
+				newIndex[x] = used.size();
+				used.push_back(x);
+			}
+			x = newIndex[x];
+		}
+		lod.mesh.triangles.push_back(tri);
+	}
+	for(int i=0; i<used.size(); i++)
+	{
+		const Point & p = positions[used[i]];
+		lod.mesh.vertices.push_back(Vector3(p.x, p.y, p.z));
+		if(weighted)
+			lod.influences.addVertex(&bones[used[i]*MAX_CARRIED_INFLUENCES],
+			                         &weights[used[i]*MAX_CARRIED_INFLUENCES], counts[used[i]]);
+	}
+	lod.mesh.topologyChanged();
+}
+
+} // namespace
+
+//////////////////////////////////////////////////
+// Collapse the cheapest valid edges, pass by pass, until each target is reached
+//////////////////////////////////////////////////
+
+void buildLODChain(const TriangleMesh & mesh,
+                   const InfluenceTable & influences,
+                   const std::vector<int> & targetTriangles,
+                   std::vector<MeshLOD> & lods,
+                   double weightPenalty,
+                   DecimationStats * stats)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	Decimator d;
+	d.weightPenalty = weightPenalty;
+	d.init(mesh, influences);
+
+	int collapses = 0, rejected = 0;
+	double maxError = 0;
+	for(int level=0; level<targetTriangles.size(); level++)
+	{
+		// passes over every edge, cheapest first, until the target; an edge
+		// whose ends moved in this pass waits for the next one. A pass tries
+		// no more edges than there are triangles left to remove, unless all
+		// of those are rejected, so costlier edges wait to be costed again.
+		while(d.liveTriangles > targetTriangles[level])
+		{
+			d.rank();
+			int before = collapses;
+			size_t window = d.liveTriangles - targetTriangles[level];
+			for(size_t k=0; k<d.candidates.size() && d.liveTriangles > targetTriangles[level] &&
+			                (k < window || collapses == before); k++)
+			{
+				const Collapse & c = d.candidates[k];
+				if(d.locked(c))
+					continue;
+				if(d.apply(c))
+				{
+					collapses++;
+					maxError = n_max(maxError, (double)c.cost);
+				}
+				else
+					rejected++;
+			}
+			if(collapses == before)
+				break;                       // every remaining edge is rejected
+		}
+		lods.push_back(MeshLOD());
+		d.snapshot(lods.back());
+		lods.back().maxError = maxError;
+	}
+
+	if(stats)
+	{
+		stats->triangles = mesh.triangles.size();
+		stats->collapses = collapses;
+		stats->rejected = rejected;
+		stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+}
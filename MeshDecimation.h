@@ -0,0 +1,68 @@
+/**
+  * Quadric error mesh decimation (Garland and Heckbert, "Surface
+  * Simplification Using Quadric Error Metrics", 1997) that carries the
+  * skinning weights through every collapse.
+  *
+  * Each vertex accumulates the area-weighted plane quadrics of its
+  * triangles, plus steep planes along open boundaries so that holes and
+  * cuts keep their outline. Decimation runs in passes: each pass costs
+  * every live edge once, in vertex order, sorts them by cost and applies
+  * the cheapest ones (no more than the triangles still to remove), skipping
+  * an edge whose ends already moved in this pass; the next pass costs it
+  * again. This is close to the exact greedy order without keeping a
+  * priority queue up to date, and reads the vertex data nearly in order.
+  * The triangles around each vertex are linked lists through flat corner
+  * arrays: a collapse relinks corners instead of growing per-vertex lists.
+  *
+  * The surviving vertex moves to the point minimizing the sum of both
+  * quadrics (or the best point on the edge when that system is singular);
+  * the collapse is rejected if it would flip a triangle or break the link
+  * condition (the surface stays manifold), and tried again next pass.
+  *
+  * The merged vertex gets the weights of both ends, interpolated by where
+  * the new position falls along the edge, keeping the largest
+  * MAX_CARRIED_INFLUENCES and renormalizing. Collapsing across a change
+  * of weights costs extra, weightPenalty * (L1 weight difference)^2 *
+  * edge length^4 (the same units as the area-weighted quadric), so skin
+  * seams such as joints keep their edge loops longer.
+  *
+  * A single run produces a whole chain: each time the triangle count
+  * reaches the next target, the current mesh is copied out as a level.
+  */
+
+#ifndef MESH_DECIMATION_H
+#define MESH_DECIMATION_H
+
+#include <vector>
+#include "Skinning.h"
+
+enum { MAX_CARRIED_INFLUENCES = 8 };
+
+// One level of detail
+struct MeshLOD
+{
+	TriangleMesh mesh;
+	InfluenceTable influences;       // normalized, empty if the input had none
+	double maxError;                 // largest collapse cost accepted so far
+};
+
+struct DecimationStats
+{
+	int triangles;                   // input
+	int collapses, rejected;         // rejected: flips and link condition
+	double seconds;
+};
+
+// Decimate mesh down to each of targetTriangles (in decreasing order) in
+// one pass, appending one level per target to lods. influences may be
+// empty (geometry only); otherwise its weights are normalized first.
+// When no valid collapse is left, the remaining levels get the smallest
+// mesh reached.
+void buildLODChain(const TriangleMesh & mesh,
+                   const InfluenceTable & influences,
+                   const std::vector<int> & targetTriangles,
+                   std::vector<MeshLOD> & lods,
+                   double weightPenalty = 1,
+                   DecimationStats * stats = 0);
+
+#endif // MESH_DECIMATION_H
@@ -0,0 +1,319 @@
+/**
+  * Meshlet clusters and their culling.
+  *
+  */
+
+#include "Meshlets.h"
+
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+
+// A triangle turning further than this from the cluster's average normal
+// (cosine) starts a new cluster, once the cluster has MIN_SPLIT triangles
+static const float SPLIT_COS = 0;
+static const int MIN_SPLIT = 32;
+
+// Posed cones widen by this many times the largest relative bone rotation.
+// Blending also bends the surface between bones (weight gradient times
+// the bones' relative motion): in tests with random poses, one rotation
+// angle missed normals by up to 0.7 radians, twice by at most 0.06.
+static const float CONE_WIDENING = 2;
+
+// Cones wider than this (cosine of the half angle) never cull anything
+static const float MIN_CONE_COS = 0.1f;
+
+static float coneCutoff(float coneCos)
+{
+	return coneCos <= MIN_CONE_COS ? 1 : sqrt(1 - coneCos * coneCos);
+}
+
+static void sphereFromBox(Meshlets::Bounds & b)
+{
+	float r2 = 0;
+	for(int c=0; c<3; c++)
+	{
+		b.center[c] = 0.5f * (b.boxMin[c] + b.boxMax[c]);
+		float h = 0.5f * (b.boxMax[c] - b.boxMin[c]);
+		r2 += h * h;
+	}
+	b.radius = sqrt(r2);
+}
+
+//////////////////////////////////////////////////
+// Greedy clusters along the triangle order
+//////////////////////////////////////////////////
+
+void Meshlets::build(const TriangleMesh & mesh, const InfluenceTable & influences)
+{
+	clusters.clear();
+	bones.clear();
+	boneBoxes.clear();
+	posed.clear();
+	int n = mesh.vertexCount();
+	int m = mesh.triangleCount();
+	bool skinned = influences.vertexCount() == n;
+
+	// unit normal of each triangle (zero if degenerate)
+	std::vector<Vector3> faceNormals(m);
+	for(int t=0; t<m; t++)
+	{
+		Vector3 a = mesh.position(mesh.corner(t, 0));
+		Vector3 u = mesh.position(mesh.corner(t, 1)) - a;
+		Vector3 v = mesh.position(mesh.corner(t, 2)) - a;
+		Vector3 normal = u.cross(v);
+		if(normal.length() > 0)
+			faceNormals[t] = normal / normal.length();
+	}
+
+	std::vector<int> clusterOf(n, -1);       // last cluster using each vertex
+	std::vector<unsigned int> local;
+	std::vector<float> boneWeights;
+	unsigned int begin = 0;
+	Vector3 normalSum;
+	for(int t=0; t<=m; t++)
+	{
+		int id = clusters.size();
+		bool close = t == m;
+		if(!close)
+		{
+			unsigned int v[3] = { mesh.corner(t, 0), mesh.corner(t, 1), mesh.corner(t, 2) };
+			int added = 0;
+			for(int k=0; k<3; k++)
+				if(clusterOf[v[k]] != id && (k < 1 || v[k] != v[0]) && (k < 2 || v[k] != v[1]))
+					added++;
+			int count = t - begin;
+			close = local.size() + added > MAX_VERTICES || count + 1 > MAX_TRIANGLES ||
+			        (count >= MIN_SPLIT && faceNormals[t].dot(normalSum) < SPLIT_COS * normalSum.length());
+		}
+		if(close && t > begin)
+		{
+			Cluster c;
+			c.triangles.begin = begin;
+			c.triangles.end = t;
+			c.vertexCount = local.size();
+
+			// box, then the sphere around its center
+			Bounds & b = c.bind;
+			for(int k=0; k<3; k++)
+			{
+				b.boxMin[k] = FLT_MAX;
+				b.boxMax[k] = -FLT_MAX;
+			}
+			for(int i=0; i<local.size(); i++)
+			{
+				Vector3 p = mesh.position(local[i]);
+				for(int k=0; k<3; k++)
+				{
+					b.boxMin[k] = std::min(b.boxMin[k], (float)p[k]);
+					b.boxMax[k] = std::max(b.boxMax[k], (float)p[k]);
+				}
+			}
+			sphereFromBox(b);
+			float r2 = 0;
+			for(int i=0; i<local.size(); i++)
+			{
+				Vector3 p = mesh.position(local[i]);
+				float d2 = 0;
+				for(int k=0; k<3; k++)
+					d2 += (p[k] - b.center[k]) * (p[k] - b.center[k]);
+				r2 = std::max(r2, d2);
+			}
+			b.radius = sqrt(r2);
+
+			// normal cone around the average normal
+			Vector3 axis = normalSum.length() > 0 ? normalSum / normalSum.length() : Vector3(1, 0, 0);
+			c.coneCos = normalSum.length() > 0 ? 1 : -1;
+			for(unsigned int f=begin; f<t; f++)
+				c.coneCos = std::min(c.coneCos, (float)faceNormals[f].dot(axis));
+			for(int k=0; k<3; k++)
+				b.coneAxis[k] = axis[k];
+			b.coneCutoff = coneCutoff(c.coneCos);
+
+			// one bind pose box per influencing bone
+			c.boneBegin = c.boneEnd = bones.size();
+			c.dominantBone = 0;
+			boneWeights.clear();
+			for(int i=0; i<local.size() && skinned; i++)
+			{
+				Vector3 p = mesh.position(local[i]);
+				for(unsigned int k=influences.offsets[local[i]]; k<influences.offsets[local[i]+1]; k++)
+				{
+					if(influences.weights[k] <= 0)
+						continue;
+					unsigned int j = c.boneBegin;
+					while(j < c.boneEnd && bones[j] != influences.bones[k])
+						j++;
+					if(j == c.boneEnd)
+					{
+						bones.push_back(influences.bones[k]);
+						boneWeights.push_back(0);
+						for(int d=0; d<3; d++)
+							boneBoxes.push_back(FLT_MAX);
+						for(int d=0; d<3; d++)
+							boneBoxes.push_back(-FLT_MAX);
+						c.boneEnd++;
+					}
+					boneWeights[j - c.boneBegin] += influences.weights[k];
+					float * box = &boneBoxes[6*j];
+					for(int d=0; d<3; d++)
+					{
+						box[d] = std::min(box[d], (float)p[d]);
+						box[3+d] = std::max(box[3+d], (float)p[d]);
+					}
+				}
+			}
+			unsigned int dominant = c.boneBegin;
+			for(unsigned int j=c.boneBegin; j<c.boneEnd; j++)
+				if(boneWeights[j - c.boneBegin] > boneWeights[dominant - c.boneBegin])
+					dominant = j;
+			if(c.boneEnd > c.boneBegin)
+				c.dominantBone = bones[dominant];
+			clusters.push_back(c);
+
+			begin = t;
+			local.clear();
+			normalSum = Vector3(0, 0, 0);
+			id++;
+		}
+		if(t == m)
+			break;
+		for(int k=0; k<3; k++)
+		{
+			unsigned int v = mesh.corner(t, k);
+			if(clusterOf[v] != id)
+			{
+				clusterOf[v] = id;
+				local.push_back(v);
+			}
+		}
+		normalSum += faceNormals[t];
+	}
+}
+
+//////////////////////////////////////////////////
+// Posed bounds from the bone boxes
+//////////////////////////////////////////////////
+
+void Meshlets::refit(const SkinningPalette & palette)
+{
+	posed.resize(clusters.size());
+	for(int i=0; i<clusters.size(); i++)
+	{
+		const Cluster & c = clusters[i];
+		Bounds & b = posed[i];
+		b = c.bind;
+		if(c.dominantBone >= palette.size())
+			continue;
+
+		// union of the bone boxes moved by the palette (see SkinBounds::compute)
+		bool found = false;
+		for(unsigned int j=c.boneBegin; j<c.boneEnd; j++)
+		{
+			if(bones[j] >= palette.size())
+				continue;
+			const float * box = &boneBoxes[6*j];
+			const _matrix34 & m = palette[bones[j]];
+			float center[3] = { 0.5f*(box[0]+box[3]), 0.5f*(box[1]+box[4]), 0.5f*(box[2]+box[5]) };
+			float half[3] = { 0.5f*(box[3]-box[0]), 0.5f*(box[4]-box[1]), 0.5f*(box[5]-box[2]) };
+			for(int k=0; k<3; k++)
+			{
+				float p = m.m[k][0]*center[0] + m.m[k][1]*center[1] + m.m[k][2]*center[2] + m.m[k][3];
+				float e = fabs(m.m[k][0])*half[0] + fabs(m.m[k][1])*half[1] + fabs(m.m[k][2])*half[2];
+				if(!found || p-e < b.boxMin[k]) b.boxMin[k] = p-e;
+				if(!found || p+e > b.boxMax[k]) b.boxMax[k] = p+e;
+			}
+			found = true;
+		}
+		if(!found)
+			continue;
+		sphereFromBox(b);
+
+		// cone: turned by the dominant bone, widened by the others' relative rotation
+		const _matrix34 & d = palette[c.dominantBone];
+		float axis[3], length = 0;
+		for(int k=0; k<3; k++)
+		{
+			axis[k] = d.m[k][0]*c.bind.coneAxis[0] + d.m[k][1]*c.bind.coneAxis[1] + d.m[k][2]*c.bind.coneAxis[2];
+			length += axis[k] * axis[k];
+		}
+		length = sqrt(length);
+		float widening = 0;
+		for(unsigned int j=c.boneBegin; j<c.boneEnd; j++)
+		{
+			if(bones[j] >= palette.size() || bones[j] == c.dominantBone)
+				continue;
+			// angle of the relative rotation: trace(D^T B) = 1 + 2 cos(angle)
+			const _matrix34 & o = palette[bones[j]];
+			float trace = 0;
+			for(int r=0; r<3; r++)
+				for(int k=0; k<3; k++)
+					trace += d.m[r][k] * o.m[r][k];
+			widening = std::max(widening, (float)acos(std::max(-1.0f, std::min(1.0f, 0.5f * (trace - 1)))));
+		}
+		float angle = acos(std::max(-1.0f, std::min(1.0f, c.coneCos))) + CONE_WIDENING * widening;
+		if(length <= 0 || angle >= 0.5f * (float)M_PI)
+		{
+			b.coneCutoff = 1;
+			continue;
+		}
+		for(int k=0; k<3; k++)
+			b.coneAxis[k] = axis[k] / length;
+		b.coneCutoff = coneCutoff(cos(angle));
+	}
+}
+
+//////////////////////////////////////////////////
+// Frustum and normal cone culling
+//////////////////////////////////////////////////
+
+int Meshlets::cull(const GLCamera & camera, std::vector<TriangleMesh::TriangleRange> & visible) const
+{
+	visible.clear();
+	int kept = 0;
+	for(int i=0; i<clusters.size(); i++)
+	{
+		const Bounds & b = posed.size() == clusters.size() ? posed[i] : clusters[i].bind;
+		if(!camera.isBoxVisible(b.boxMin, b.boxMax))
+			continue;
+
+		// back facing: every normal of the cone points away from every
+		// point of the sphere, seen from the eye
+		if(camera.frustumValid && b.coneCutoff < 1)
+		{
+			float view[3], distance = 0, along = 0;
+			for(int k=0; k<3; k++)
+			{
+				view[k] = b.center[k] - camera.eye[k];
+				distance += view[k] * view[k];
+				along += view[k] * b.coneAxis[k];
+			}
+			if(along >= b.coneCutoff * sqrt(distance) + b.radius)
+				continue;
+		}
+
+		kept++;
+		const TriangleMesh::TriangleRange & r = clusters[i].triangles;
+		if(!visible.empty() && visible.back().end == r.begin)
+			visible.back().end = r.end;
+		else
+			visible.push_back(r);
+	}
+	return kept;
+}
+
+double Meshlets::averageVertices() const
+{
+	double sum = 0;
+	for(int i=0; i<clusters.size(); i++)
+		sum += clusters[i].vertexCount;
+	return clusters.empty() ? 0 : sum / clusters.size();
+}
+
+double Meshlets::averageTriangles() const
+{
+	double sum = 0;
+	for(int i=0; i<clusters.size(); i++)
+		sum += clusters[i].triangles.end - clusters[i].triangles.begin;
+	return clusters.empty() ? 0 : sum / clusters.size();
+}
@@ -0,0 +1,83 @@
+/**
+  * Meshlets: the triangle list cut into small clusters (at most
+  * MAX_VERTICES vertices and MAX_TRIANGLES triangles), each one a run of
+  * consecutive triangles with its own bounds, so that whole clusters can
+  * be culled before drawing.
+  *
+  * Clusters are cut greedily along the triangle order, which is spatially
+  * coherent after TriangleMesh::optimizeVertexCache(). A cluster is also
+  * closed early when a triangle turns too far from its average normal,
+  * which keeps the normal cones narrow enough to cull.
+  *
+  * Bind pose bounds are a box, a bounding sphere and a normal cone (axis,
+  * and the cosine of its half angle). For a skinned mesh, each cluster
+  * also keeps one box per bone influencing it, over the bind positions of
+  * the vertices that bone influences. refit() moves these boxes with the
+  * palette, as SkinBounds does for the whole mesh: a skinned vertex is a
+  * convex combination of its bones' transforms, so it stays in the union
+  * of the moved boxes, and no vertex is read. The cone axis follows the
+  * cluster's dominant bone and the cone widens with the largest rotation
+  * of its other bones relative to that one (exact for rigid clusters, a
+  * tested approximation otherwise, as a skinned normal is only roughly a
+  * blend of rotated normals).
+  *
+  * cull() keeps the clusters that are inside the view frustum and not
+  * back facing, as triangle ranges for TriangleMesh::draw(); consecutive
+  * visible clusters share a range. That draw computes normals from the
+  * visible triangles only, so vertices on the border with a culled
+  * cluster (on the silhouette or the screen edge) miss its contribution.
+  */
+
+#ifndef MESHLETS_H
+#define MESHLETS_H
+
+#include <vector>
+#include "Skinning.h"
+#include "GLCamera.h"
+
+class Meshlets
+{
+public:
+	enum { MAX_VERTICES = 64, MAX_TRIANGLES = 124 };
+
+	struct Bounds
+	{
+		float boxMin[3], boxMax[3];
+		float center[3], radius;
+		float coneAxis[3];
+		float coneCutoff;                    // sine of the cone half angle, 1: never back facing
+	};
+
+	struct Cluster
+	{
+		TriangleMesh::TriangleRange triangles;
+		unsigned int vertexCount;
+		unsigned int boneBegin, boneEnd;     // range in bones and boneBoxes
+		InfluenceTable::BoneIndex dominantBone;
+		float coneCos;                       // cosine of the bind pose cone half angle
+		Bounds bind;
+	};
+
+	// Member variables
+	std::vector<Cluster> clusters;
+	std::vector<InfluenceTable::BoneIndex> bones;
+	std::vector<float> boneBoxes;            // 6 per entry of bones: min x,y,z then max x,y,z
+	std::vector<Bounds> posed;               // per cluster, from the last refit()
+
+	// Cut mesh into clusters. influences may be empty (rigid mesh: the
+	// bind pose bounds are used as they are).
+	void build(const TriangleMesh & mesh, const InfluenceTable & influences);
+
+	// Bounds of the clusters skinned with palette, into posed
+	void refit(const SkinningPalette & palette);
+
+	// Ranges of the clusters in view and facing the camera (posed bounds if
+	// refit() was called since build()). Returns the number of clusters kept.
+	int cull(const GLCamera & camera, std::vector<TriangleMesh::TriangleRange> & visible) const;
+
+	// Average vertices and triangles per cluster
+	double averageVertices() const;
+	double averageTriangles() const;
+};
+
+#endif // MESHLETS_H
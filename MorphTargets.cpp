@@ -0,0 +1,138 @@
+/**
+  * Sparse morph targets (blend shapes).
+  *
+  */
+
+#include "MorphTargets.h"
+#include "TriangleMesh.h"
+
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+
+// 4-wide lanes for the accumulation (x,y,z of one vertex + 1 unused)
+#if defined(__GNUC__)
+typedef float MorphLanes __attribute__((vector_size(16)));
+#endif
+
+// Add the difference shape - base as a target
+int MorphTargets::addTarget(const char * name, const std::vector<Vector3> & base,
+                            const std::vector<Vector3> & shape, float epsilon)
+{
+	Target target;
+	target.name = name;
+	for(int i=0; i<base.size() && i<shape.size(); i++)
+	{
+		Vector3 d = shape[i] - base[i];
+		if(d.length() <= epsilon)
+			continue;
+		target.indices.push_back(i);
+		for(int c=0; c<3; c++)
+			target.deltas.push_back(d[c]);
+	}
+	targets.push_back(target);
+	return targets.size()-1;
+}
+
+// Same, reading shape from an OBJ file
+int MorphTargets::addTargetFromOBJ(const char * filename, const std::vector<Vector3> & base,
+                                   float epsilon, const std::vector<unsigned int> * weldMap)
+{
+	TriangleMesh shape(filename);
+	if(weldMap && shape.vertices.size() == weldMap->size())
+	{
+		std::vector<Vector3> welded(base.size());
+		for(int i=0; i<weldMap->size(); i++)
+			welded[(*weldMap)[i]] = shape.vertices[i];
+		shape.vertices.swap(welded);
+	}
+	if(shape.vertices.size() != base.size())
+	{
+		printf("Morph target %s: %d vertices, expected %d\n", filename, (int)shape.vertices.size(), (int)base.size());
+		return -1;
+	}
+	return addTarget(filename, base, shape.vertices, epsilon);
+}
+
+// Reorder vertex indices
+void MorphTargets::permuteVertices(const std::vector<unsigned int> & newToOld)
+{
+	std::vector<unsigned int> oldToNew(newToOld.size());
+	for(int i=0; i<newToOld.size(); i++)
+		oldToNew[newToOld[i]] = i;
+	for(int t=0; t<targets.size(); t++)
+		for(int k=0; k<targets[t].indices.size(); k++)
+			targets[t].indices[k] = oldToNew[targets[t].indices[k]];
+}
+
+// Reset an instance to the base positions
+void MorphTargets::initInstance(Instance & instance, const float * base, int vertexCount) const
+{
+	instance.weights.assign(targets.size(), 0.0f);
+	instance.positions.assign(3*vertexCount+1, 0.0f);
+	if(vertexCount > 0)
+		memcpy(&instance.positions[0], base, 3*vertexCount*sizeof(float));
+	instance.applied.clear();
+}
+
+//////////////////////////////////////////////////
+// Restore the vertices moved last time, then scatter-add active targets
+//////////////////////////////////////////////////
+
+void MorphTargets::apply(Instance & instance, const float * base) const
+{
+	float * out = &instance.positions[0];
+
+	for(int a=0; a<instance.applied.size(); a++)
+	{
+		const Target & target = targets[instance.applied[a]];
+		for(int k=0; k<target.indices.size(); k++)
+		{
+			unsigned int v = target.indices[k];
+			out[3*v  ] = base[3*v  ];
+			out[3*v+1] = base[3*v+1];
+			out[3*v+2] = base[3*v+2];
+		}
+	}
+	instance.applied.clear();
+
+	for(int t=0; t<targets.size(); t++)
+	{
+		float w = instance.weights[t];
+		if(fabs(w) < 1e-6f)
+			continue;
+		instance.applied.push_back(t);
+		const Target & target = targets[t];
+		const float * d = target.deltas.empty() ? 0 : &target.deltas[0];
+		int n = target.indices.size();
+#if defined(__GNUC__)
+		// the 4th lane adds 0 to the next float (positions are padded by one)
+		MorphLanes wl = { w, w, w, 0.0f };
+		for(int k=0; k<n; k++)
+		{
+			float * p = out + 3*target.indices[k];
+			MorphLanes pv, dv = { d[3*k], d[3*k+1], d[3*k+2], 0.0f };
+			memcpy(&pv, p, sizeof(pv));
+			pv += wl * dv;
+			memcpy(p, &pv, sizeof(pv));
+		}
+#else
+		for(int k=0; k<n; k++)
+		{
+			float * p = out + 3*target.indices[k];
+			p[0] += w * d[3*k];
+			p[1] += w * d[3*k+1];
+			p[2] += w * d[3*k+2];
+		}
+#endif
+	}
+}
+
+// Total number of stored deltas
+size_t MorphTargets::deltaCount() const
+{
+	size_t n = 0;
+	for(int t=0; t<targets.size(); t++)
+		n += targets[t].indices.size();
+	return n;
+}
@@ -0,0 +1,69 @@
+/**
+  * Sparse morph targets (blend shapes), applied to bind positions before
+  * skinning.
+  *
+  * Each target only stores the vertices it moves: a vertex index and a
+  * position offset for every delta larger than a threshold. Instances
+  * carry their own weights (one per target, free to animate) and their
+  * own morphed positions, which are updated incrementally: apply() first
+  * restores the vertices moved by the previous call, then accumulates
+  * the active targets, so its cost depends on the size of the active
+  * targets and not on the vertex count.
+  *
+  * Positions are flat float arrays, 3 per vertex (the SkinBatches layout),
+  * padded with one float so the accumulation can use 4-wide vectors.
+  */
+
+#ifndef MORPH_TARGETS_H
+#define MORPH_TARGETS_H
+
+#include <vector>
+#include <string>
+#include "GraphicsMath.h"
+
+class MorphTargets
+{
+public:
+	struct Target
+	{
+		std::string name;
+		std::vector<unsigned int> indices;   // moved vertices
+		std::vector<float> deltas;           // 3 per moved vertex
+	};
+
+	// Per-instance state
+	struct Instance
+	{
+		std::vector<float> weights;          // one per target
+		std::vector<float> positions;        // 3 per vertex (+1 padding)
+		std::vector<int> applied;            // targets accumulated by the last apply()
+	};
+
+	// Member variables
+	std::vector<Target> targets;
+
+	// Add the difference shape - base as a target, keeping deltas longer than epsilon.
+	// Returns the target index.
+	int addTarget(const char * name, const std::vector<Vector3> & base,
+	              const std::vector<Vector3> & shape, float epsilon = 1e-6f);
+
+	// Same, reading shape from an OBJ file with the topology of base (-1 on error).
+	// If base was welded or reordered (TriangleMesh::weld, permuteVertices),
+	// weldMap maps the OBJ vertices to it.
+	int addTargetFromOBJ(const char * filename, const std::vector<Vector3> & base,
+	                     float epsilon = 1e-6f, const std::vector<unsigned int> * weldMap = 0);
+
+	// Reorder vertex indices: new vertex i is old vertex newToOld[i]
+	void permuteVertices(const std::vector<unsigned int> & newToOld);
+
+	// Reset an instance to the base positions (3 floats per vertex), all weights 0
+	void initInstance(Instance & instance, const float * base, int vertexCount) const;
+
+	// Update instance.positions = base + sum_t weight_t * delta_t
+	void apply(Instance & instance, const float * base) const;
+
+	// Total number of stored deltas
+	size_t deltaCount() const;
+};
+
+#endif // MORPH_TARGETS_H
@@ -0,0 +1,210 @@
+/**
+  * Incremental nearest-bone binding.
+  *
+  */
+
+#include "NearestBoneBinder.h"
+
+#include <cfloat>
+#include <chrono>
+#include <unordered_map>
+
+// Distance from p to the segment [a, b]
+static double segmentDistance(const Vector3 & a, const Vector3 & b, const Vector3 & p)
+{
+	Vector3 v = b - a;
+	Vector3 w = p - a;
+	double c1 = w.dot(v);
+	if(c1 <= 0)
+		return w.length();
+	double c2 = v.dot(v);
+	if(c2 <= c1)
+		return (p - b).length();
+	return (p - (a + v * (c1 / c2))).length();
+}
+
+static bool sameVector(const Vector3 & a, const Vector3 & b)
+{
+	return a[0] == b[0] && a[1] == b[1] && a[2] == b[2];
+}
+
+NearestBoneBinder::NearestBoneBinder() :
+    k(0),
+    maxDistance(0)
+{
+}
+
+// Forget the previous binding
+void NearestBoneBinder::clear()
+{
+	vertices.clear();
+	names.clear();
+	heads.clear();
+	tails.clear();
+	nearest.clear();
+	distances.clear();
+	k = 0;
+}
+
+// Find the k nearest bones of vertex v (ties keep the lower index)
+void NearestBoneBinder::bindVertex(int v, const std::vector<Vector3> & boneHeads, const std::vector<Vector3> & boneTails)
+{
+	int * bones = &nearest[v*k];
+	double * dist = &distances[v*k];
+	for(int j=0; j<k; j++)
+	{
+		bones[j] = -1;
+		dist[j] = DBL_MAX;
+	}
+	for(int b=0; b<boneHeads.size(); b++)
+	{
+		double d = segmentDistance(boneHeads[b], boneTails[b], vertices[v]);
+		if(d > maxDistance || d >= dist[k-1])
+			continue;
+		int j = k-1;
+		for(; j>0 && d < dist[j-1]; j--)
+		{
+			bones[j] = bones[j-1];
+			dist[j] = dist[j-1];
+		}
+		bones[j] = b;
+		dist[j] = d;
+	}
+}
+
+//////////////////////////////////////////////////
+// Bind, recomputing only the vertices a skeleton change can affect
+//////////////////////////////////////////////////
+
+void NearestBoneBinder::bind(const std::vector<Vector3> & meshVertices,
+                             const std::vector<std::string> & boneNames,
+                             const std::vector<Vector3> & boneHeads,
+                             const std::vector<Vector3> & boneTails,
+                             int bonesPerVertex, double maxBoneDistance,
+                             InfluenceTable & influences, Stats * stats)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	int n = meshVertices.size();
+	int boneCount = boneHeads.size();
+	bonesPerVertex = n_max(1, n_min(bonesPerVertex, (int)MAX_BONES_PER_VERTEX));
+
+	bool full = k != bonesPerVertex || maxDistance != maxBoneDistance || vertices.size() != n;
+	for(int v=0; v<n && !full; v++)
+		full = !sameVector(vertices[v], meshVertices[v]);
+
+	std::vector<char> dirty(n, 1);
+	int changedBones = boneCount;
+	if(!full)
+	{
+		// match bones by name; unchanged bones keep their segment
+		std::unordered_map<std::string, int> newIndex;
+		for(int b=0; b<boneCount; b++)
+			newIndex[boneNames[b]] = b;
+		std::vector<int> oldToNew(names.size(), -1);     // -1: removed or moved
+		std::vector<char> newChanged(boneCount, 1);
+		for(int b=0; b<names.size(); b++)
+		{
+			std::unordered_map<std::string, int>::iterator it = newIndex.find(names[b]);
+			if(it == newIndex.end())
+				continue;
+			int nb = it->second;
+			if(sameVector(heads[b], boneHeads[nb]) && sameVector(tails[b], boneTails[nb]))
+			{
+				oldToNew[b] = nb;
+				newChanged[nb] = 0;
+			}
+		}
+		changedBones = 0;
+		for(int b=0; b<boneCount; b++)
+			changedBones += newChanged[b];
+		for(int b=0; b<names.size(); b++)
+			changedBones += oldToNew[b] < 0 && newIndex.find(names[b]) == newIndex.end();
+
+		// vertices losing one of their bones; the others get renumbered
+		for(int v=0; v<n; v++)
+		{
+			dirty[v] = 0;
+			for(int j=0; j<k; j++)
+			{
+				int & b = nearest[v*k+j];
+				if(b < 0)
+					continue;
+				if(oldToNew[b] < 0)
+					dirty[v] = 1;
+				else
+					b = oldToNew[b];
+			}
+		}
+
+		// vertices an added or moved bone gets at least as close to as their k-th bone
+		std::vector<double> cellReach(grid.cells.size(), 0.0);
+		for(int c=0; c<grid.cells.size(); c++)
+			for(unsigned int i=grid.cells[c].begin; i<grid.cells[c].end; i++)
+				cellReach[c] = n_max(cellReach[c], n_min(distances[grid.order[i]*k + k-1], maxDistance));
+		for(int b=0; b<boneCount; b++)
+		{
+			if(!newChanged[b])
+				continue;
+			for(int c=0; c<grid.cells.size(); c++)
+			{
+				if(grid.segmentLowerBound(grid.cells[c], boneHeads[b], boneTails[b]) > cellReach[c])
+					continue;
+				for(unsigned int i=grid.cells[c].begin; i<grid.cells[c].end; i++)
+				{
+					unsigned int v = grid.order[i];
+					if(!dirty[v] && segmentDistance(boneHeads[b], boneTails[b], vertices[v]) <= n_min(distances[v*k + k-1], maxDistance))
+						dirty[v] = 1;
+				}
+			}
+		}
+	}
+	else
+	{
+		vertices = meshVertices;
+		k = bonesPerVertex;
+		maxDistance = maxBoneDistance;
+		nearest.assign(n*k, -1);
+		distances.assign(n*k, DBL_MAX);
+		grid.build(vertices, SpatialHashGrid::suggestCellSize(vertices));
+	}
+	names = boneNames;
+	heads = boneHeads;
+	tails = boneTails;
+
+	int recomputed = 0;
+	for(int v=0; v<n; v++)
+		if(dirty[v])
+		{
+			bindVertex(v, heads, tails);
+			recomputed++;
+		}
+
+	// raw weights: 1 for a single bone, inverse square distances otherwise
+	influences.clear();
+	InfluenceTable::BoneIndex bones[MAX_BONES_PER_VERTEX];
+	float weights[MAX_BONES_PER_VERTEX];
+	for(int v=0; v<n; v++)
+	{
+		int count = 0;
+		for(int j=0; j<k; j++)
+			if(nearest[v*k+j] >= 0)
+			{
+				bones[count] = nearest[v*k+j];
+				double d = distances[v*k+j];
+				weights[count] = 1 / (d * d);
+				count++;
+			}
+		if(count == 1)
+			weights[0] = 1;
+		influences.addVertex(bones, weights, count);
+	}
+
+	if(stats)
+	{
+		stats->vertices = n;
+		stats->recomputed = recomputed;
+		stats->changedBones = changedBones;
+		stats->full = full;
+		stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+}
@@ -0,0 +1,68 @@
+/**
+  * Nearest-bone binding (closest 1 or 2 bone segments, inverse square
+  * distance weights) that can be updated incrementally when the skeleton
+  * changes.
+  *
+  * The binder remembers, per vertex, its k nearest bones and their
+  * distances. When rebinding the same mesh to a new skeleton, bones are
+  * matched by name and compared by bind pose segment. A vertex is
+  * recomputed only if
+  *   - one of its bones was removed or moved, or
+  *   - an added or moved bone is now at most as far as its k-th bone.
+  * The second test walks the cells of a SpatialHashGrid over the
+  * vertices, skipping cells that the bone cannot reach; the other
+  * vertices keep their bones (renumbered) and weights.
+  */
+
+#ifndef NEAREST_BONE_BINDER_H
+#define NEAREST_BONE_BINDER_H
+
+#include <vector>
+#include <string>
+#include "Skinning.h"
+#include "SpatialHashGrid.h"
+
+class NearestBoneBinder
+{
+public:
+	enum { MAX_BONES_PER_VERTEX = 2 };
+
+	struct Stats
+	{
+		int vertices, recomputed;
+		int changedBones;                 // removed, added or moved
+		bool full;                        // no usable previous binding
+		double seconds;
+	};
+
+	NearestBoneBinder();
+
+	// Bind vertices to their bonesPerVertex (1 or 2) nearest bones among
+	// the segments [heads[b], tails[b]], named names[b]. Bones further than
+	// maxDistance are ignored. Reuses the previous binding when vertices
+	// are unchanged. Raw weights: 1 for a single bone, 1/d^2 otherwise.
+	void bind(const std::vector<Vector3> & vertices,
+	          const std::vector<std::string> & names,
+	          const std::vector<Vector3> & heads,
+	          const std::vector<Vector3> & tails,
+	          int bonesPerVertex, double maxDistance,
+	          InfluenceTable & influences, Stats * stats = 0);
+
+	// Forget the previous binding
+	void clear();
+
+private:
+	void bindVertex(int v, const std::vector<Vector3> & heads, const std::vector<Vector3> & tails);
+
+	// previous binding
+	std::vector<Vector3> vertices;
+	std::vector<std::string> names;
+	std::vector<Vector3> heads, tails;
+	int k;
+	double maxDistance;
+	std::vector<int> nearest;             // k bone indices per vertex (-1: none)
+	std::vector<double> distances;        // their distances, ascending (maxDistance: none)
+	SpatialHashGrid grid;
+};
+
+#endif // NEAREST_BONE_BINDER_H
@@ -0,0 +1,462 @@
+/**
+  * Ogre binary chunk stream and .mesh reader.
+  *
+  */
+
+#include "OgreBinary.h"
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Chunk ids of OgreMeshFileFormat.h used here
+enum
+{
+	M_MESH = 0x3000,
+	M_SUBMESH = 0x4000,
+	M_SUBMESH_OPERATION = 0x4010,
+	M_SUBMESH_BONE_ASSIGNMENT = 0x4100,
+	M_GEOMETRY = 0x5000,
+	M_GEOMETRY_VERTEX_DECLARATION = 0x5100,
+	M_GEOMETRY_VERTEX_ELEMENT = 0x5110,
+	M_GEOMETRY_VERTEX_BUFFER = 0x5200,
+	M_GEOMETRY_VERTEX_BUFFER_DATA = 0x5210,
+	M_MESH_SKELETON_LINK = 0x6000,
+	M_MESH_BONE_ASSIGNMENT = 0x7000
+};
+
+enum { VET_FLOAT3 = 2, VES_POSITION = 1 };
+enum { OT_TRIANGLE_LIST = 4, OT_TRIANGLE_STRIP = 5, OT_TRIANGLE_FAN = 6 };
+
+//////////////////////////////////////////////////
+// Chunk stream
+//////////////////////////////////////////////////
+
+OgreBinaryStream::OgreBinaryStream() :
+    data(0),
+    size(0),
+    position(0),
+    swapBytes(false),
+    overrun(false)
+{
+}
+
+OgreBinaryStream::~OgreBinaryStream()
+{
+	close();
+}
+
+bool OgreBinaryStream::open(const char * filename)
+{
+	close();
+	int fd = ::open(filename, O_RDONLY);
+	if(fd < 0)
+	{
+		printf("Ogre binary: unable to open %s\n", filename);
+		return false;
+	}
+	struct stat info;
+	void * p = MAP_FAILED;
+	if(fstat(fd, &info) == 0 && info.st_size > 2)
+		p = mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if(p == MAP_FAILED)
+	{
+		printf("Ogre binary: unable to map %s\n", filename);
+		return false;
+	}
+	data = (const unsigned char *)p;
+	size = info.st_size;
+
+	// the header id tells the byte order of the writer
+	unsigned short header;
+	memcpy(&header, data, 2);
+	swapBytes = header == 0x0010;
+	position = 2;
+	if(header != HEADER && !swapBytes)
+	{
+		printf("Ogre binary: %s has no Ogre header\n", filename);
+		close();
+		return false;
+	}
+	version = readString();
+	return !overrun;
+}
+
+void OgreBinaryStream::close()
+{
+	if(data)
+		munmap((void *)data, size);
+	data = 0;
+	size = position = 0;
+	swapBytes = overrun = false;
+	version.clear();
+}
+
+void OgreBinaryStream::read(void * out, size_t n)
+{
+	if(overrun || n > size - position)
+	{
+		overrun = true;
+		memset(out, 0, n);
+		return;
+	}
+	memcpy(out, data + position, n);
+	if(swapBytes)
+		std::reverse((unsigned char *)out, (unsigned char *)out + n);
+	position += n;
+}
+
+bool OgreBinaryStream::nextChunk(size_t end, unsigned short & id, size_t & chunkEnd)
+{
+	if(overrun || position + CHUNK_OVERHEAD > end)
+		return false;
+	size_t start = position;
+	id = readShort();
+	unsigned int length = readInt();
+	chunkEnd = start + length;
+	if(length < CHUNK_OVERHEAD || chunkEnd > end)
+	{
+		printf("Ogre binary: chunk 0x%04x at %d overruns its parent\n", id, (int)start);
+		overrun = true;
+		return false;
+	}
+	return true;
+}
+
+unsigned short OgreBinaryStream::readShort()
+{
+	unsigned short v;
+	read(&v, 2);
+	return v;
+}
+
+unsigned int OgreBinaryStream::readInt()
+{
+	unsigned int v;
+	read(&v, 4);
+	return v;
+}
+
+float OgreBinaryStream::readFloat()
+{
+	float v;
+	read(&v, 4);
+	return v;
+}
+
+void OgreBinaryStream::readFloats(float * out, int n)
+{
+	for(int i=0; i<n; i++)
+		out[i] = readFloat();
+}
+
+bool OgreBinaryStream::readBool()
+{
+	unsigned char v;
+	read(&v, 1);
+	return v != 0;
+}
+
+std::string OgreBinaryStream::readString()
+{
+	const unsigned char * p = overrun ? 0 : (const unsigned char *)memchr(data + position, '\n', size - position);
+	if(!p)
+	{
+		overrun = true;
+		return std::string();
+	}
+	std::string s((const char *)data + position, p - (data + position));
+	position = p + 1 - data;
+	return s;
+}
+
+const unsigned char * OgreBinaryStream::readBytes(size_t n)
+{
+	if(overrun || n > size - position)
+	{
+		overrun = true;
+		return 0;
+	}
+	position += n;
+	return data + position - n;
+}
+
+float OgreBinaryStream::decodeFloat(const unsigned char * p) const
+{
+	unsigned char b[4];
+	memcpy(b, p, 4);
+	if(swapBytes)
+		std::reverse(b, b + 4);
+	float v;
+	memcpy(&v, b, 4);
+	return v;
+}
+
+//////////////////////////////////////////////////
+// .mesh
+//////////////////////////////////////////////////
+
+namespace {
+
+struct BoneAssignment
+{
+	unsigned int vertex;
+	unsigned short bone;
+	float weight;
+
+	bool operator<(const BoneAssignment & other) const { return vertex < other.vertex; }
+};
+
+struct SubMesh
+{
+	bool sharedVertices;
+	int operation;
+	std::vector<unsigned int> indices;
+	std::vector<Vector3> vertices;       // own geometry, unless sharedVertices
+	std::vector<BoneAssignment> assignments;
+};
+
+BoneAssignment readAssignment(OgreBinaryStream & s)
+{
+	BoneAssignment a;
+	a.vertex = s.readInt();
+	a.bone = s.readShort();
+	a.weight = s.readFloat();
+	return a;
+}
+
+// Positions of a M_GEOMETRY chunk (the first FLOAT3 position element)
+bool readGeometry(OgreBinaryStream & s, size_t end, std::vector<Vector3> & vertices)
+{
+	unsigned int count = s.readInt();
+	int source = -1, offset = 0;
+	bool found = false;
+	unsigned short id, elementId;
+	size_t chunkEnd, elementEnd;
+	while(s.nextChunk(end, id, chunkEnd))
+	{
+		if(id == M_GEOMETRY_VERTEX_DECLARATION)
+			while(s.nextChunk(chunkEnd, elementId, elementEnd))
+			{
+				if(elementId == M_GEOMETRY_VERTEX_ELEMENT && !found)
+				{
+					unsigned short elementSource = s.readShort();
+					unsigned short type = s.readShort();
+					unsigned short semantic = s.readShort();
+					unsigned short elementOffset = s.readShort();
+					if(semantic == VES_POSITION)
+					{
+						if(type != VET_FLOAT3)
+						{
+							printf("Ogre mesh: positions are not FLOAT3\n");
+							return false;
+						}
+						source = elementSource;
+						offset = elementOffset;
+						found = true;
+					}
+				}
+				s.seek(elementEnd);
+			}
+		else if(id == M_GEOMETRY_VERTEX_BUFFER)
+		{
+			unsigned short bindIndex = s.readShort();
+			unsigned short vertexSize = s.readShort();
+			while(found && bindIndex == source && s.nextChunk(chunkEnd, elementId, elementEnd))
+			{
+				if(elementId == M_GEOMETRY_VERTEX_BUFFER_DATA)
+				{
+					const unsigned char * bytes = s.readBytes((size_t)count * vertexSize);
+					if(!bytes || offset + 12 > vertexSize)
+						return false;
+					vertices.reserve(vertices.size() + count);
+					for(unsigned int i=0; i<count; i++)
+					{
+						const unsigned char * p = bytes + (size_t)i * vertexSize + offset;
+						vertices.push_back(Vector3(s.decodeFloat(p), s.decodeFloat(p + 4), s.decodeFloat(p + 8)));
+					}
+				}
+				s.seek(elementEnd);
+			}
+		}
+		s.seek(chunkEnd);
+	}
+	if(!found)
+		printf("Ogre mesh: geometry without positions\n");
+	return found && !s.failed();
+}
+
+bool readSubMesh(OgreBinaryStream & s, size_t end, SubMesh & sub)
+{
+	s.readString();                      // material
+	sub.sharedVertices = s.readBool();
+	unsigned int indexCount = s.readInt();
+	bool indices32 = s.readBool();
+	sub.operation = OT_TRIANGLE_LIST;
+	const unsigned char * bytes = s.readBytes((size_t)indexCount * (indices32 ? 4 : 2));
+	if(!bytes)
+		return false;
+	sub.indices.resize(indexCount);
+	for(unsigned int i=0; i<indexCount; i++)
+	{
+		unsigned char b[4] = { 0, 0, 0, 0 };
+		int n = indices32 ? 4 : 2;
+		memcpy(b, bytes + i * n, n);
+		if(s.swapped())
+			std::reverse(b, b + n);
+		sub.indices[i] = indices32 ? *(unsigned int *)b : *(unsigned short *)b;
+	}
+	unsigned short id;
+	size_t chunkEnd;
+	while(s.nextChunk(end, id, chunkEnd))
+	{
+		if(id == M_GEOMETRY && !readGeometry(s, chunkEnd, sub.vertices))
+			return false;
+		else if(id == M_SUBMESH_OPERATION)
+			sub.operation = s.readShort();
+		else if(id == M_SUBMESH_BONE_ASSIGNMENT)
+			sub.assignments.push_back(readAssignment(s));
+		s.seek(chunkEnd);
+	}
+	return !s.failed();
+}
+
+} // namespace
+
+bool readOgreMesh(const char * filename, TriangleMesh & mesh,
+                  InfluenceTable * influences, std::string * skeletonName)
+{
+	OgreBinaryStream s;
+	if(!s.open(filename))
+		return false;
+	if(s.version.compare(0, 16, "[MeshSerializer_") != 0)
+	{
+		printf("Ogre mesh: %s is not a mesh (%s)\n", filename, s.version.c_str());
+		return false;
+	}
+
+	std::vector<Vector3> shared;
+	std::vector<BoneAssignment> sharedAssignments;
+	std::vector<SubMesh> subMeshes;
+	unsigned short id, subId;
+	size_t chunkEnd, subEnd;
+	while(s.nextChunk(s.length(), id, chunkEnd))
+	{
+		if(id == M_MESH)
+		{
+			s.readBool();                // skeletally animated
+			while(s.nextChunk(chunkEnd, subId, subEnd))
+			{
+				bool ok = true;
+				if(subId == M_GEOMETRY)
+					ok = readGeometry(s, subEnd, shared);
+				else if(subId == M_SUBMESH)
+				{
+					subMeshes.push_back(SubMesh());
+					ok = readSubMesh(s, subEnd, subMeshes.back());
+				}
+				else if(subId == M_MESH_SKELETON_LINK && skeletonName)
+					*skeletonName = s.readString();
+				else if(subId == M_MESH_BONE_ASSIGNMENT)
+					sharedAssignments.push_back(readAssignment(s));
+				if(!ok)
+				{
+					printf("Ogre mesh: %s is malformed\n", filename);
+					return false;
+				}
+				s.seek(subEnd);
+			}
+		}
+		s.seek(chunkEnd);
+	}
+	if(s.failed())
+	{
+		printf("Ogre mesh: %s is truncated\n", filename);
+		return false;
+	}
+
+	// shared vertices first, then each submesh's own
+	mesh.expand();
+	mesh.vertices = shared;
+	mesh.normals.clear();
+	mesh.triangles.clear();
+	mesh.topologyChanged();
+	mesh.name = filename;
+	std::vector<BoneAssignment> assignments = sharedAssignments;
+	int invalid = 0;
+	for(int m=0; m<subMeshes.size(); m++)
+	{
+		SubMesh & sub = subMeshes[m];
+		unsigned int base = sub.sharedVertices ? 0 : mesh.vertices.size();
+		unsigned int count = sub.sharedVertices ? shared.size() : sub.vertices.size();
+		if(!sub.sharedVertices)
+			mesh.vertices.insert(mesh.vertices.end(), sub.vertices.begin(), sub.vertices.end());
+		for(int i=0; i<sub.assignments.size() && !sub.sharedVertices; i++)
+		{
+			sub.assignments[i].vertex += base;
+			assignments.push_back(sub.assignments[i]);
+		}
+		if(sub.operation != OT_TRIANGLE_LIST && sub.operation != OT_TRIANGLE_STRIP && sub.operation != OT_TRIANGLE_FAN)
+		{
+			printf("Ogre mesh: submesh %d is not made of triangles, skipped\n", m);
+			continue;
+		}
+		const std::vector<unsigned int> & c = sub.indices;
+		bool list = sub.operation == OT_TRIANGLE_LIST;
+		for(size_t i=0; i+2<c.size(); i += list ? 3 : 1)
+		{
+			TriangleMesh::Triangle t;
+			if(sub.operation == OT_TRIANGLE_FAN)
+			{
+				t.a = c[0]; t.b = c[i+1]; t.c = c[i+2];
+			}
+			else if(list || i % 2 == 0)
+			{
+				t.a = c[i]; t.b = c[i+1]; t.c = c[i+2];
+			}
+			else
+			{
+				t.a = c[i+1]; t.b = c[i]; t.c = c[i+2];   // odd strip triangles flip
+			}
+			if(t.a >= count || t.b >= count || t.c >= count)
+			{
+				invalid++;
+				continue;
+			}
+			t.a += base;
+			t.b += base;
+			t.c += base;
+			mesh.triangles.push_back(t);
+		}
+	}
+	if(invalid > 0)
+		printf("Ogre mesh: %d triangles with out of range indices skipped\n", invalid);
+
+	if(influences)
+	{
+		// assignments grouped by vertex, in file order
+		std::stable_sort(assignments.begin(), assignments.end());
+		influences->clear();
+		std::vector<InfluenceTable::BoneIndex> bones;
+		std::vector<float> weights;
+		size_t k = 0;
+		for(unsigned int v=0; v<mesh.vertices.size(); v++)
+		{
+			bones.clear();
+			weights.clear();
+			for(; k<assignments.size() && assignments[k].vertex == v; k++)
+				if(assignments[k].weight > 0)
+				{
+					bones.push_back(assignments[k].bone);
+					weights.push_back(assignments[k].weight);
+				}
+			influences->addVertex(bones.data(), weights.data(), bones.size());
+		}
+	}
+	return true;
+}
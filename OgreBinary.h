@@ -0,0 +1,79 @@
+/**
+  * Readers for the native Ogre binary formats (.mesh and .skeleton), the
+  * files the Ogre serializers write before any XML conversion.
+  *
+  * Both formats are a header (chunk id 0x1000 and a version string) then
+  * a tree of chunks: an unsigned short id, an unsigned int length that
+  * includes these 6 bytes, the chunk's own fields, then its sub-chunks.
+  * Strings end with '\n', bools are one byte, and the byte order is the
+  * writer's: a header id read as 0x0010 means every field is swapped.
+  * Unknown chunks are skipped by their length, so newer files with extra
+  * chunks (LOD, edge lists, poses) still load.
+  *
+  * OgreBinaryStream maps the file and reads these fields. readOgreMesh()
+  * fills a TriangleMesh (shared geometry, then the submeshes' own, in
+  * order) and the influences from the vertex bone assignments, whose bone
+  * indices are skeleton bone handles. MeshAnimation::LoadSkeletonBinary()
+  * reads the .skeleton with the same stream.
+  */
+
+#ifndef OGRE_BINARY_H
+#define OGRE_BINARY_H
+
+#include <string>
+#include <vector>
+#include "TriangleMesh.h"
+#include "Skinning.h"
+
+class OgreBinaryStream
+{
+public:
+	enum { HEADER = 0x1000, CHUNK_OVERHEAD = 6 };
+
+	std::string version;                 // e.g. "[Serializer_v1.10]"
+
+	OgreBinaryStream();
+	~OgreBinaryStream();
+
+	// Map filename and read its header
+	bool open(const char * filename);
+	void close();
+
+	// Next chunk before end (a position): its id, and the position after it.
+	// False at end, or if the chunk overruns end.
+	bool nextChunk(size_t end, unsigned short & id, size_t & chunkEnd);
+	void seek(size_t p) { position = p; }
+	size_t tell() const { return position; }
+	size_t length() const { return size; }
+
+	// Fields; reading past the end sets failed() and returns zeros
+	unsigned short readShort();
+	unsigned int readInt();
+	float readFloat();
+	void readFloats(float * out, int n);
+	bool readBool();
+	std::string readString();
+	const unsigned char * readBytes(size_t n);
+	float decodeFloat(const unsigned char * p) const;   // a float inside readBytes() data
+	bool swapped() const { return swapBytes; }
+	bool failed() const { return overrun; }
+
+private:
+	OgreBinaryStream(const OgreBinaryStream &);
+	OgreBinaryStream & operator=(const OgreBinaryStream &);
+
+	void read(void * out, size_t n);
+
+	const unsigned char * data;
+	size_t size, position;
+	bool swapBytes, overrun;
+};
+
+// Read an Ogre binary .mesh (triangle lists, strips and fans; other
+// submeshes are skipped). influences may be 0; its bones are the raw bone
+// handles, not checked against any skeleton. skeletonName receives the
+// linked .skeleton file, if any.
+bool readOgreMesh(const char * filename, TriangleMesh & mesh,
+                  InfluenceTable * influences = 0, std::string * skeletonName = 0);
+
+#endif // OGRE_BINARY_H
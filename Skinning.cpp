@@ -0,0 +1,861 @@
+/**
+  * Linear blend skinning on sparse influence tables.
+  *
+  */
+
+#include "Skinning.h"
+
+#include <cstdio>
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Creates an empty table (zero vertices)
+InfluenceTable::InfluenceTable() :
+    offsets(1, 0),
+    bones(),
+    weights()
+{
+}
+
+// Remove all vertices
+void InfluenceTable::clear()
+{
+	offsets.assign(1, 0);
+	bones.clear();
+	weights.clear();
+}
+
+// Append a vertex with n influences
+void InfluenceTable::addVertex(const BoneIndex * vertexBones, const float * vertexWeights, int n)
+{
+	for(int i=0; i<n; i++)
+	{
+		bones.push_back(vertexBones[i]);
+		weights.push_back(vertexWeights[i]);
+	}
+	offsets.push_back(bones.size());
+}
+
+int InfluenceTable::maxInfluences() const
+{
+	int n = 0;
+	for(int i=0; i<vertexCount(); i++)
+		if(influenceCount(i) > n)
+			n = influenceCount(i);
+	return n;
+}
+
+// Index of the largest weight of vertex (-1 if no influence)
+int InfluenceTable::dominantBone(int vertex) const
+{
+	int best = -1;
+	for(unsigned int k=offsets[vertex]; k<offsets[vertex+1]; k++)
+		if(best < 0 || weights[k] > weights[best])
+			best = k;
+	return best < 0 ? -1 : bones[best];
+}
+
+// Reorder vertices: new vertex i is old vertex newToOld[i]
+void InfluenceTable::permute(const std::vector<unsigned int> & newToOld)
+{
+	InfluenceTable sorted;
+	sorted.offsets.reserve(offsets.size());
+	sorted.bones.reserve(bones.size());
+	sorted.weights.reserve(weights.size());
+	for(int i=0; i<newToOld.size(); i++)
+	{
+		unsigned int v = newToOld[i];
+		sorted.addVertex(&bones[offsets[v]], &weights[offsets[v]], influenceCount(v));
+	}
+	*this = sorted;
+}
+
+//////////////////////////////////////////////////
+// Linear blend skinning: p' = sum_k w_k * (palette[b_k] * p)
+//////////////////////////////////////////////////
+
+void skinVertices(const InfluenceTable & influences,
+                  const std::vector<Vector3> & bindPositions,
+                  const SkinningPalette & palette,
+                  std::vector<Vector3> & out)
+{
+	int n = influences.vertexCount();
+	out.resize(n);
+	for(int i=0; i<n; i++)
+	{
+		const Vector3 & p = bindPositions[i];
+		float x = p[0], y = p[1], z = p[2];
+		float rx = 0, ry = 0, rz = 0;
+		for(unsigned int k=influences.offsets[i]; k<influences.offsets[i+1]; k++)
+		{
+			const float (*m)[4] = palette[influences.bones[k]].m;
+			float w = influences.weights[k];
+			rx += w * (m[0][0]*x + m[0][1]*y + m[0][2]*z + m[0][3]);
+			ry += w * (m[1][0]*x + m[1][1]*y + m[1][2]*z + m[1][3]);
+			rz += w * (m[2][0]*x + m[2][1]*y + m[2][2]*z + m[2][3]);
+		}
+		out[i] = Vector3(rx, ry, rz);
+	}
+}
+
+//////////////////////////////////////////////////
+// Weight smoothing: parallel double-buffered Jacobi sweeps on sparse
+// per-vertex rows, by one set of threads meeting at a barrier
+//////////////////////////////////////////////////
+
+// Weights diffused below this are dropped after every sweep
+static const float MIN_SMOOTHED_WEIGHT = 1e-4f;
+
+struct SmoothedInfluence
+{
+	InfluenceTable::BoneIndex bone;
+	float weight;
+};
+
+// All threads wait until the last one arrives; reusable across sweeps
+class SweepBarrier
+{
+public:
+	SweepBarrier(int count) : count(count), waiting(0), generation(0) {}
+
+	void wait()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		int current = generation;
+		if(++waiting == count)
+		{
+			waiting = 0;
+			generation++;
+			released.notify_all();
+		}
+		else
+			released.wait(lock, [&]() { return generation != current; });
+	}
+
+private:
+	std::mutex mutex;
+	std::condition_variable released;
+	int count, waiting, generation;
+};
+
+// Add weight * row into sum; slot[b] is the index of bone b in sum, or -1
+static inline void accumulateRow(std::vector<SmoothedInfluence> & sum, std::vector<int> & slot,
+                                 const SmoothedInfluence * row, unsigned int length, float weight)
+{
+	for(unsigned int k=0; k<length; k++)
+	{
+		int & j = slot[row[k].bone];
+		if(j < 0)
+		{
+			j = sum.size();
+			SmoothedInfluence entry = { row[k].bone, 0.0f };
+			sum.push_back(entry);
+		}
+		sum[j].weight += weight * row[k].weight;
+	}
+}
+
+void smoothInfluences(InfluenceTable & influences,
+                      const std::vector<unsigned int> & adjacencyOffsets,
+                      const std::vector<unsigned int> & adjacency,
+                      int iterations, float lambda, int threadCount)
+{
+	int n = influences.vertexCount();
+	if(n == 0 || iterations <= 0 || adjacencyOffsets.size() != n+1)
+		return;
+
+	if(threadCount <= 0)
+		threadCount = std::thread::hardware_concurrency();
+	threadCount = n_max(1, n_min(threadCount, n));
+
+	// two sets of rows: row[v] points to length[v] entries of a pool;
+	// sweep it reads set it%2 and writes set (it+1)%2, each thread into
+	// its own pool for its own range of vertices
+	std::vector<const SmoothedInfluence *> row[2];
+	std::vector<unsigned int> length[2];
+	std::vector<std::vector<SmoothedInfluence> > pools[2];
+	std::vector<SmoothedInfluence> initial(influences.bones.size());
+	for(int set=0; set<2; set++)
+	{
+		row[set].resize(n);
+		length[set].resize(n);
+		pools[set].resize(threadCount);
+	}
+	int boneCount = 0;
+	for(size_t k=0; k<initial.size(); k++)
+	{
+		boneCount = n_max(boneCount, influences.bones[k] + 1);
+		initial[k].bone = influences.bones[k];
+		initial[k].weight = influences.weights[k];
+	}
+	for(int v=0; v<n; v++)
+	{
+		row[0][v] = initial.empty() ? 0 : &initial[influences.offsets[v]];
+		length[0][v] = influences.offsets[v+1] - influences.offsets[v];
+	}
+
+	SweepBarrier barrier(threadCount);
+	auto sweeps = [&](int t) {
+		int begin = (long long)n * t / threadCount, end = (long long)n * (t+1) / threadCount;
+		std::vector<SmoothedInfluence> sum;
+		std::vector<int> slot(boneCount, -1);      // per thread, reset after each row
+		std::vector<unsigned int> start(end - begin);
+		for(int it=0; it<iterations; it++)
+		{
+			int in = it % 2, out = 1 - in;
+			std::vector<SmoothedInfluence> & pool = pools[out][t];
+			pool.clear();
+			for(int v=begin; v<end; v++)
+			{
+				unsigned int first = adjacencyOffsets[v], last = adjacencyOffsets[v+1];
+				sum.clear();
+				if(first == last)
+					accumulateRow(sum, slot, row[in][v], length[in][v], 1.0f);
+				else
+				{
+					accumulateRow(sum, slot, row[in][v], length[in][v], 1 - lambda);
+					float a = lambda / (last - first);
+					for(unsigned int k=first; k<last; k++)
+						accumulateRow(sum, slot, row[in][adjacency[k]], length[in][adjacency[k]], a);
+				}
+				start[v - begin] = pool.size();
+				for(size_t j=0; j<sum.size(); j++)
+				{
+					slot[sum[j].bone] = -1;
+					if(sum[j].weight > MIN_SMOOTHED_WEIGHT)
+						pool.push_back(sum[j]);
+				}
+				length[out][v] = pool.size() - start[v - begin];
+			}
+			// the pool no longer grows in this sweep: publish the rows
+			for(int v=begin; v<end; v++)
+				row[out][v] = pool.empty() ? 0 : &pool[start[v - begin]];
+			barrier.wait();
+		}
+	};
+	std::vector<std::thread> workers;
+	for(int t=1; t<threadCount; t++)
+		workers.push_back(std::thread(sweeps, t));
+	sweeps(0);
+	for(int t=0; t<workers.size(); t++)
+		workers[t].join();
+
+	// back to the influence table
+	int last = iterations % 2;
+	InfluenceTable smoothed;
+	std::vector<InfluenceTable::BoneIndex> bones;
+	std::vector<float> weights;
+	for(int v=0; v<n; v++)
+	{
+		bones.clear();
+		weights.clear();
+		for(unsigned int k=0; k<length[last][v]; k++)
+		{
+			bones.push_back(row[last][v][k].bone);
+			weights.push_back(row[last][v][k].weight);
+		}
+		smoothed.addVertex(bones.data(), weights.data(), bones.size());
+	}
+	influences = smoothed;
+}
+
+//////////////////////////////////////////////////
+// Weight pruning, renormalization and quantization
+//////////////////////////////////////////////////
+
+void pruneInfluences(InfluenceTable & influences, int maxInfluences,
+                     float minWeight, int quantizeBits, PruneStats * stats)
+{
+	PruneStats s;
+	memset(&s, 0, sizeof(s));
+	s.vertices = influences.vertexCount();
+	s.influencesBefore = influences.bones.size();
+	s.maxBefore = influences.maxInfluences();
+	double scale = quantizeBits == 16 ? 65535.0 : quantizeBits == 8 ? 255.0 : 0.0;
+	if(maxInfluences < 1)
+		maxInfluences = 1;
+
+	InfluenceTable pruned;
+	pruned.offsets.reserve(influences.offsets.size());
+	std::vector<std::pair<float,int> > input;    // (normalized weight, bone), largest first
+	std::vector<InfluenceTable::BoneIndex> bones;
+	std::vector<float> weights;
+
+	for(int v=0; v<s.vertices; v++)
+	{
+		// sanitize: NaN and negative weights count as 0, infinite ones as 1 each
+		input.clear();
+		bool infinite = false;
+		for(unsigned int k=influences.offsets[v]; k<influences.offsets[v+1]; k++)
+			infinite = infinite || isinf(influences.weights[k]) && influences.weights[k] > 0;
+		double sum = 0;
+		for(unsigned int k=influences.offsets[v]; k<influences.offsets[v+1]; k++)
+		{
+			float w = influences.weights[k];
+			if(infinite)
+				w = isinf(w) && w > 0 ? 1.0f : 0.0f;
+			else if(!(w > 0))
+				w = 0;
+			input.push_back(std::make_pair(w, (int)influences.bones[k]));
+			sum += w;
+		}
+		if(!(sum > 0) || isinf(sum))
+		{
+			s.invalidVertices++;
+			pruned.addVertex(0, 0, 0);
+			continue;
+		}
+		for(int i=0; i<input.size(); i++)
+			input[i].first /= sum;
+		std::sort(input.begin(), input.end(), std::greater<std::pair<float,int> >());
+
+		// keep the largest maxInfluences, then those above minWeight
+		int n = n_min((int)input.size(), maxInfluences);
+		s.droppedByCount += input.size() - n;
+		int kept = 1;
+		while(kept < n && input[kept].first >= minWeight && input[kept].first > 0)
+			kept++;
+		s.droppedByWeight += n - kept;
+
+		double keptSum = 0;
+		for(int i=0; i<kept; i++)
+			keptSum += input[i].first;
+		bones.clear();
+		weights.clear();
+		double cumulative = 0, previous = 0;
+		for(int i=0; i<kept; i++)
+		{
+			double w = input[i].first / keptSum;
+			if(scale > 0)
+			{
+				// round the running sum: the integers then add up to scale exactly
+				cumulative += w * scale;
+				double rounded = floor(cumulative + 0.5);
+				if(i == kept-1)
+					rounded = scale;
+				w = (rounded - previous) / scale;
+				previous = rounded;
+				if(w == 0)
+				{
+					s.droppedByWeight++;
+					continue;
+				}
+			}
+			bones.push_back(input[i].second);
+			weights.push_back(w);
+		}
+		pruned.addVertex(bones.empty() ? 0 : &bones[0], weights.empty() ? 0 : &weights[0], bones.size());
+
+		// L1 distance to the normalized input
+		double error = 0;
+		for(int i=0; i<input.size(); i++)
+		{
+			double out = 0;
+			for(int j=0; j<bones.size(); j++)
+				if(bones[j] == input[i].second)
+					out = weights[j];
+			error += fabs(out - input[i].first);
+		}
+		s.maxWeightError = n_max(s.maxWeightError, error);
+		s.meanWeightError += error;
+	}
+
+	influences = pruned;
+	s.influencesAfter = influences.bones.size();
+	s.maxAfter = influences.maxInfluences();
+	if(s.vertices > s.invalidVertices)
+		s.meanWeightError /= s.vertices - s.invalidVertices;
+	if(stats)
+		*stats = s;
+}
+
+//////////////////////////////////////////////////
+// Influence-count batches
+//////////////////////////////////////////////////
+
+int SkinBatches::groupOf(int influenceCount)
+{
+	if(influenceCount <= 1) return GROUP_1;   // 0 influences: weight 0
+	if(influenceCount == 2) return GROUP_2;
+	if(influenceCount <= 4) return GROUP_4;
+	return GROUP_N;
+}
+
+void SkinBatches::sortedOrder(const InfluenceTable & influences, bool byDominantBone,
+                              std::vector<unsigned int> & newToOld)
+{
+	int n = influences.vertexCount();
+	std::vector<std::pair<unsigned int, unsigned int> > keys(n);   // (key, vertex)
+	for(int i=0; i<n; i++)
+	{
+		unsigned int key = groupOf(influences.influenceCount(i)) << 16;
+		if(byDominantBone)
+			key += n_max(influences.dominantBone(i), 0);
+		keys[i] = std::make_pair(key, (unsigned int)i);
+	}
+	std::sort(keys.begin(), keys.end());
+	newToOld.resize(n);
+	for(int i=0; i<n; i++)
+		newToOld[i] = keys[i].second;
+}
+
+void SkinBatches::build(const std::vector<Vector3> & bindPositions,
+                        const InfluenceTable & influences, bool byDominantBone)
+{
+	sortedOrder(influences, byDominantBone, order);
+	int n = order.size();
+	identityOrder = true;
+	for(int j=0; j<n; j++)
+		if(order[j] != j)
+			identityOrder = false;
+
+	const int width[GROUP_N] = { 1, 2, 4 };
+	for(int g=0; g<GROUP_N; g++)
+	{
+		bones[g].clear();
+		weights[g].clear();
+	}
+	general.clear();
+	positions.resize(3*n);
+	for(int g=0; g<=GROUP_COUNT; g++)
+		groupBegin[g] = n;
+	for(int j=n-1; j>=0; j--)
+		groupBegin[groupOf(influences.influenceCount(order[j]))] = j;
+	for(int g=GROUP_COUNT-1; g>=0; g--)
+		groupBegin[g] = n_min(groupBegin[g], groupBegin[g+1]);
+
+	for(int j=0; j<n; j++)
+	{
+		unsigned int v = order[j];
+		for(int d=0; d<3; d++)
+			positions[3*j+d] = bindPositions[v][d];
+
+		int count = influences.influenceCount(v);
+		int g = groupOf(count);
+		const InfluenceTable::BoneIndex * vb = &influences.bones[0] + influences.offsets[v];
+		const float * vw = &influences.weights[0] + influences.offsets[v];
+		if(g == GROUP_N)
+		{
+			general.addVertex(vb, vw, count);
+			continue;
+		}
+		// pad to the group width with zero weights on the first bone
+		for(int s=0; s<width[g]; s++)
+		{
+			bones[g].push_back(s < count ? vb[s] : (count > 0 ? vb[0] : 0));
+			weights[g].push_back(s < count ? vw[s] : 0.0f);
+		}
+	}
+
+	// rigid runs of single-influence vertices
+	rigidRuns.clear();
+	for(int j=groupBegin[GROUP_1], s=0; j<groupBegin[GROUP_1+1]; j++, s++)
+	{
+		InfluenceTable::BoneIndex b = bones[GROUP_1][s];
+		float w = weights[GROUP_1][s];
+		if(rigidRuns.empty() || rigidRuns.back().bone != b || rigidRuns.back().weight != w)
+		{
+			RigidRun run = { b, w, j, j };
+			rigidRuns.push_back(run);
+		}
+		rigidRuns.back().end = j+1;
+	}
+}
+
+#define SKIN_TRANSFORM_ADD(m, w)                                        \
+	rx += (w) * ((m)[0][0]*x + (m)[0][1]*y + (m)[0][2]*z + (m)[0][3]);  \
+	ry += (w) * ((m)[1][0]*x + (m)[1][1]*y + (m)[1][2]*z + (m)[1][3]);  \
+	rz += (w) * ((m)[2][0]*x + (m)[2][1]*y + (m)[2][2]*z + (m)[2][3]);
+
+// Kernel output: doubles (Vector3) or packed floats
+struct Vector3Output
+{
+	Vector3 * out;
+	void operator()(unsigned int i, float x, float y, float z) const { out[i] = Vector3(x, y, z); }
+};
+
+struct FloatOutput
+{
+	float * out;
+	void operator()(unsigned int i, float x, float y, float z) const { out[3*i] = x; out[3*i+1] = y; out[3*i+2] = z; }
+};
+
+template<class Output>
+static void skinBatches(const SkinBatches & batches, const SkinningPalette & palette,
+                        const float * p, Output write)
+{
+	const std::vector<unsigned int> & order = batches.order;
+	const bool identityOrder = batches.identityOrder;
+	const int * groupBegin = batches.groupBegin;
+	const std::vector<SkinBatches::RigidRun> & rigidRuns = batches.rigidRuns;
+	const InfluenceTable & general = batches.general;
+	const int GROUP_2 = SkinBatches::GROUP_2, GROUP_4 = SkinBatches::GROUP_4, GROUP_N = SkinBatches::GROUP_N;
+
+	// 1 influence: one (weighted) matrix per run
+	for(int r=0; r<rigidRuns.size(); r++)
+	{
+		const SkinBatches::RigidRun & run = rigidRuns[r];
+		float m[3][4];
+		for(int i=0; i<3; i++)
+			for(int k=0; k<4; k++)
+				m[i][k] = run.weight * palette[run.bone].m[i][k];
+		for(int j=run.begin; j<run.end; j++)
+		{
+			float x = p[3*j], y = p[3*j+1], z = p[3*j+2];
+			write(identityOrder ? j : order[j],
+				m[0][0]*x + m[0][1]*y + m[0][2]*z + m[0][3],
+				m[1][0]*x + m[1][1]*y + m[1][2]*z + m[1][3],
+				m[2][0]*x + m[2][1]*y + m[2][2]*z + m[2][3]);
+		}
+	}
+
+	// 2 influences
+	const InfluenceTable::BoneIndex * b = batches.bones[GROUP_2].empty() ? 0 : &batches.bones[GROUP_2][0];
+	const float * w = batches.weights[GROUP_2].empty() ? 0 : &batches.weights[GROUP_2][0];
+	for(int j=groupBegin[GROUP_2], s=0; j<groupBegin[GROUP_2+1]; j++, s+=2)
+	{
+		float x = p[3*j], y = p[3*j+1], z = p[3*j+2];
+		float rx = 0, ry = 0, rz = 0;
+		SKIN_TRANSFORM_ADD(palette[b[s  ]].m, w[s  ]);
+		SKIN_TRANSFORM_ADD(palette[b[s+1]].m, w[s+1]);
+		write(identityOrder ? j : order[j], rx, ry, rz);
+	}
+
+	// 3 or 4 influences
+	b = batches.bones[GROUP_4].empty() ? 0 : &batches.bones[GROUP_4][0];
+	w = batches.weights[GROUP_4].empty() ? 0 : &batches.weights[GROUP_4][0];
+	for(int j=groupBegin[GROUP_4], s=0; j<groupBegin[GROUP_4+1]; j++, s+=4)
+	{
+		float x = p[3*j], y = p[3*j+1], z = p[3*j+2];
+		float rx = 0, ry = 0, rz = 0;
+		SKIN_TRANSFORM_ADD(palette[b[s  ]].m, w[s  ]);
+		SKIN_TRANSFORM_ADD(palette[b[s+1]].m, w[s+1]);
+		SKIN_TRANSFORM_ADD(palette[b[s+2]].m, w[s+2]);
+		SKIN_TRANSFORM_ADD(palette[b[s+3]].m, w[s+3]);
+		write(identityOrder ? j : order[j], rx, ry, rz);
+	}
+
+	// more than 4 influences
+	for(int j=groupBegin[GROUP_N], v=0; j<groupBegin[GROUP_N+1]; j++, v++)
+	{
+		float x = p[3*j], y = p[3*j+1], z = p[3*j+2];
+		float rx = 0, ry = 0, rz = 0;
+		for(unsigned int k=general.offsets[v]; k<general.offsets[v+1]; k++)
+		{
+			SKIN_TRANSFORM_ADD(palette[general.bones[k]].m, general.weights[k]);
+		}
+		write(identityOrder ? j : order[j], rx, ry, rz);
+	}
+}
+
+void SkinBatches::skin(const SkinningPalette & palette, std::vector<Vector3> & out,
+                       const float * morphedPositions) const
+{
+	out.resize(order.size());
+	const float * p = morphedPositions ? morphedPositions : (positions.empty() ? 0 : &positions[0]);
+	Vector3Output write = { out.empty() ? 0 : &out[0] };
+	skinBatches(*this, palette, p, write);
+}
+
+void SkinBatches::skin(const SkinningPalette & palette, float * out,
+                       const float * morphedPositions) const
+{
+	const float * p = morphedPositions ? morphedPositions : (positions.empty() ? 0 : &positions[0]);
+	FloatOutput write = { out };
+	skinBatches(*this, palette, p, write);
+}
+
+#undef SKIN_TRANSFORM_ADD
+
+//////////////////////////////////////////////////
+// Quantized skinning input
+//////////////////////////////////////////////////
+
+void QuantizedSkinStream::build(const std::vector<Vector3> & bindPositions,
+                                const std::vector<Vector3> & bindNormals,
+                                const InfluenceTable & influences)
+{
+	int n = influences.vertexCount();
+
+	// positions: 16 bits per coordinate inside the bounding box
+	for(int d=0; d<3; d++)
+	{
+		float lo = 1e30, hi = -1e30;
+		for(int i=0; i<n; i++)
+		{
+			if(bindPositions[i][d] < lo) lo = bindPositions[i][d];
+			if(bindPositions[i][d] > hi) hi = bindPositions[i][d];
+		}
+		if(n == 0) lo = hi = 0;
+		boxMin[d] = lo;
+		boxStep[d] = (hi > lo) ? (hi - lo) / 65535.0f : 1.0f;
+	}
+	positions.resize(3*n);
+	for(int i=0; i<n; i++)
+		for(int d=0; d<3; d++)
+			positions[3*i+d] = (unsigned short) floor((bindPositions[i][d] - boxMin[d]) / boxStep[d] + 0.5f);
+
+	// normals: octahedral snorm16 pairs
+	normals.resize(bindNormals.empty() ? 0 : 2*n);
+	for(int i=0; i<n && !bindNormals.empty(); i++)
+		encodeNormal(bindNormals[i], &normals[2*i]);
+
+	// weights: 8 bits, rounding error given to the largest weight so they sum to 255
+	offsets = influences.offsets;
+	bones = influences.bones;
+	weights.resize(influences.weights.size());
+	for(int i=0; i<n; i++)
+	{
+		int sum = 0, largest = offsets[i];
+		for(unsigned int k=offsets[i]; k<offsets[i+1]; k++)
+		{
+			float w = influences.weights[k];
+			weights[k] = (unsigned char) floor(n_min(n_max(w, 0.0f), 1.0f) * 255.0f + 0.5f);
+			sum += weights[k];
+			if(influences.weights[k] > influences.weights[largest])
+				largest = k;
+		}
+		if(offsets[i+1] > offsets[i])
+			weights[largest] = (unsigned char) n_min(n_max(weights[largest] + 255 - sum, 0), 255);
+	}
+}
+
+size_t QuantizedSkinStream::byteSize() const
+{
+	return positions.size()*sizeof(unsigned short) + normals.size()*sizeof(short)
+	     + offsets.size()*sizeof(unsigned int) + bones.size()*sizeof(InfluenceTable::BoneIndex)
+	     + weights.size();
+}
+
+void QuantizedSkinStream::encodeNormal(const Vector3 & n, short out[2])
+{
+	float l1 = fabs(n[0]) + fabs(n[1]) + fabs(n[2]);
+	float x = l1 > 0 ? n[0] / l1 : 0;
+	float y = l1 > 0 ? n[1] / l1 : 0;
+	if(n[2] < 0)   // fold the lower hemisphere
+	{
+		float ox = (1 - fabs(y)) * (x >= 0 ? 1 : -1);
+		float oy = (1 - fabs(x)) * (y >= 0 ? 1 : -1);
+		x = ox; y = oy;
+	}
+	out[0] = (short) floor(x * 32767.0f + 0.5f);
+	out[1] = (short) floor(y * 32767.0f + 0.5f);
+}
+
+Vector3 QuantizedSkinStream::decodeNormal(const short in[2])
+{
+	float x = in[0] / 32767.0f;
+	float y = in[1] / 32767.0f;
+	float z = 1 - fabs(x) - fabs(y);
+	if(z < 0)
+	{
+		float ox = (1 - fabs(y)) * (x >= 0 ? 1 : -1);
+		float oy = (1 - fabs(x)) * (y >= 0 ? 1 : -1);
+		x = ox; y = oy;
+	}
+	return Vector3(x, y, z).normalized();
+}
+
+//////////////////////////////////////////////////
+// Skinning of a quantized stream. The position dequantization
+// (scale and offset) is folded into a per-frame copy of the palette,
+// and the 1/255 weight scale into the final sum, so the inner loop
+// works directly on the integer inputs.
+//////////////////////////////////////////////////
+
+void skinQuantized(const QuantizedSkinStream & stream,
+                   const SkinningPalette & palette,
+                   std::vector<Vector3> & outPositions,
+                   std::vector<Vector3> * outNormals)
+{
+	_matrix34 dequantize;
+	dequantize.m[0][0] = stream.boxStep[0];  dequantize.m[0][3] = stream.boxMin[0];
+	dequantize.m[1][1] = stream.boxStep[1];  dequantize.m[1][3] = stream.boxMin[1];
+	dequantize.m[2][2] = stream.boxStep[2];  dequantize.m[2][3] = stream.boxMin[2];
+	SkinningPalette qpalette(palette.size());
+	for(int b=0; b<palette.size(); b++)
+		qpalette[b] = dequantize * palette[b];
+
+	bool normals = outNormals && stream.hasNormals();
+	int n = stream.vertexCount();
+	outPositions.resize(n);
+	if(normals)
+		outNormals->resize(n);
+	const float wscale = 1.0f / 255.0f;
+	for(int i=0; i<n; i++)
+	{
+		float x = stream.positions[3*i], y = stream.positions[3*i+1], z = stream.positions[3*i+2];
+		float rx = 0, ry = 0, rz = 0;
+		for(unsigned int k=stream.offsets[i]; k<stream.offsets[i+1]; k++)
+		{
+			const float (*m)[4] = qpalette[stream.bones[k]].m;
+			float w = stream.weights[k];
+			rx += w * (m[0][0]*x + m[0][1]*y + m[0][2]*z + m[0][3]);
+			ry += w * (m[1][0]*x + m[1][1]*y + m[1][2]*z + m[1][3]);
+			rz += w * (m[2][0]*x + m[2][1]*y + m[2][2]*z + m[2][3]);
+		}
+		outPositions[i] = Vector3(rx*wscale, ry*wscale, rz*wscale);
+
+		if(!normals)
+			continue;
+		Vector3 nb = QuantizedSkinStream::decodeNormal(&stream.normals[2*i]);
+		float nx = 0, ny = 0, nz = 0;
+		for(unsigned int k=stream.offsets[i]; k<stream.offsets[i+1]; k++)
+		{
+			const float (*m)[4] = palette[stream.bones[k]].m;
+			float w = stream.weights[k];
+			nx += w * (m[0][0]*nb[0] + m[0][1]*nb[1] + m[0][2]*nb[2]);
+			ny += w * (m[1][0]*nb[0] + m[1][1]*nb[1] + m[1][2]*nb[2]);
+			nz += w * (m[2][0]*nb[0] + m[2][1]*nb[1] + m[2][2]*nb[2]);
+		}
+		(*outNormals)[i] = Vector3(nx, ny, nz).normalized();
+	}
+}
+
+//////////////////////////////////////////////////
+// Per-bone bounds
+//////////////////////////////////////////////////
+
+void SkinBounds::build(const std::vector<Vector3> & bindPositions,
+                       const InfluenceTable & influences, int boneCount)
+{
+	boxes.resize(6*boneCount);
+	for(int b=0; b<boneCount; b++)
+		for(int c=0; c<3; c++)
+		{
+			boxes[6*b+c] = FLT_MAX;
+			boxes[6*b+3+c] = -FLT_MAX;
+		}
+	for(int v=0; v<influences.vertexCount(); v++)
+		for(unsigned int k=influences.offsets[v]; k<influences.offsets[v+1]; k++)
+		{
+			if(influences.weights[k] <= 0 || influences.bones[k] >= boneCount)
+				continue;
+			float * box = &boxes[6*influences.bones[k]];
+			for(int c=0; c<3; c++)
+			{
+				box[c] = n_min(box[c], (float)bindPositions[v][c]);
+				box[3+c] = n_max(box[3+c], (float)bindPositions[v][c]);
+			}
+		}
+}
+
+// Union of the bone boxes moved by the palette: the center is
+// transformed, the half extents by the absolute linear part
+bool SkinBounds::compute(const SkinningPalette & palette, float boxMin[3], float boxMax[3]) const
+{
+	bool found = false;
+	for(int b=0; b<boxes.size()/6 && b<palette.size(); b++)
+	{
+		const float * box = &boxes[6*b];
+		if(box[0] > box[3])
+			continue;
+		const _matrix34 & m = palette[b];
+		float center[3] = { 0.5f*(box[0]+box[3]), 0.5f*(box[1]+box[4]), 0.5f*(box[2]+box[5]) };
+		float half[3] = { 0.5f*(box[3]-box[0]), 0.5f*(box[4]-box[1]), 0.5f*(box[5]-box[2]) };
+		for(int i=0; i<3; i++)
+		{
+			float c = m.m[i][0]*center[0] + m.m[i][1]*center[1] + m.m[i][2]*center[2] + m.m[i][3];
+			float e = fabs(m.m[i][0])*half[0] + fabs(m.m[i][1])*half[1] + fabs(m.m[i][2])*half[2];
+			if(!found || c-e < boxMin[i]) boxMin[i] = c-e;
+			if(!found || c+e > boxMax[i]) boxMax[i] = c+e;
+		}
+		found = true;
+	}
+	return found;
+}
+
+//////////////////////////////////////////////////
+// Split triangles into chunks of at most maxBones bones
+//////////////////////////////////////////////////
+
+// (weight, bone), heaviest first
+static bool influenceHeavier(const std::pair<float,InfluenceTable::BoneIndex> & a,
+                             const std::pair<float,InfluenceTable::BoneIndex> & b)
+{
+	return a.first > b.first || (a.first == b.first && a.second > b.second);
+}
+
+int buildPaletteChunks(const TriangleMesh & mesh,
+                       const InfluenceTable & influences,
+                       int boneCount, int maxBones,
+                       std::vector<PaletteChunk> & chunks,
+                       int maxInfluences)
+{
+	chunks.clear();
+	if(mesh.triangles.empty() || maxBones <= 0)
+		return 0;
+
+	// chunkOf[b] == i iff bone b is in chunk i (the last one so far)
+	// lastTriangle[b] == t iff bone b was already seen in triangle t, at
+	// triangleBones[slotOf[b]]
+	std::vector<int> chunkOf(boneCount, -1);
+	std::vector<int> lastTriangle(boneCount, -1);
+	std::vector<int> slotOf(boneCount);
+	std::vector<std::pair<float,InfluenceTable::BoneIndex> > triangleBones, ranked;
+	chunks.push_back(PaletteChunk());
+	int trimmed = 0;
+
+	for(int t=0; t<mesh.triangles.size(); t++)
+	{
+		unsigned int corners[3] = { mesh.triangles[t].a, mesh.triangles[t].b, mesh.triangles[t].c };
+		int current = chunks.size()-1;
+
+		// distinct bones of this triangle, with their summed weights
+		triangleBones.clear();
+		for(int c=0; c<3; c++)
+		{
+			ranked.clear();
+			for(unsigned int k=influences.offsets[corners[c]]; k<influences.offsets[corners[c]+1]; k++)
+				ranked.push_back(std::make_pair(influences.weights[k], influences.bones[k]));
+			int count = ranked.size();
+			if(maxInfluences > 0 && count > maxInfluences)
+			{
+				count = maxInfluences;
+				std::partial_sort(ranked.begin(), ranked.begin()+count, ranked.end(), influenceHeavier);
+			}
+			for(int k=0; k<count; k++)
+			{
+				InfluenceTable::BoneIndex b = ranked[k].second;
+				if(lastTriangle[b] == t)
+				{
+					triangleBones[slotOf[b]].first += ranked[k].first;
+					continue;
+				}
+				lastTriangle[b] = t;
+				slotOf[b] = triangleBones.size();
+				triangleBones.push_back(ranked[k]);
+			}
+		}
+		if(triangleBones.size() > maxBones)
+		{
+			std::partial_sort(triangleBones.begin(), triangleBones.begin()+maxBones, triangleBones.end(), influenceHeavier);
+			triangleBones.resize(maxBones);
+			trimmed++;
+		}
+
+		// start a new chunk if the current one would overflow
+		int newBones = 0;
+		for(int i=0; i<triangleBones.size(); i++)
+			if(chunkOf[triangleBones[i].second] != current)
+				newBones++;
+		if(chunks[current].bones.size() + newBones > maxBones)
+		{
+			chunks.push_back(PaletteChunk());
+			current++;
+		}
+		PaletteChunk & chunk = chunks[current];
+		for(int i=0; i<triangleBones.size(); i++)
+			if(chunkOf[triangleBones[i].second] != current)
+			{
+				chunkOf[triangleBones[i].second] = current;
+				chunk.bones.push_back(triangleBones[i].second);
+			}
+		chunk.triangles.push_back(t);
+	}
+	return trimmed;
+}
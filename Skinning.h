@@ -0,0 +1,233 @@
+/**
+  * Linear blend skinning on sparse influence tables.
+  *
+  * Bone influences are stored per vertex in compressed rows (CSR):
+  * the influences of vertex i are the entries [offsets[i], offsets[i+1])
+  * of the bones and weights arrays. Bone indices are 16 bit, so a table
+  * can address up to 65535 bones while keeping the stream compact, and
+  * its size only depends on the number of non-zero weights (not on the
+  * number of bones).
+  *
+  * The skinning palette holds one matrix per bone, mapping bind pose
+  * positions to posed positions (inverse bind matrix times bone matrix).
+  *
+  * For bandwidth-bound meshes the input can instead be stored as a
+  * QuantizedSkinStream (16-bit positions, octahedral 16-bit normals,
+  * 8-bit weights) and dequantized inside the skinning kernel.
+  *
+  * Bounds of the skinned mesh can be derived from the palette alone
+  * (SkinBounds), without touching the vertices.
+  *
+  * Renderers with a fixed number of palette slots (e.g. shader uniform
+  * arrays) can split the mesh into palette chunks: each chunk references
+  * at most a given number of bones and lists the triangles drawn with it.
+  */
+
+#ifndef SKINNING_H
+#define SKINNING_H
+
+#include "TriangleMesh.h"
+#include <cstring>
+#include "mathlib/_matrix34.h"
+
+class InfluenceTable
+{
+public:
+	typedef unsigned short BoneIndex;
+	enum { MAX_BONES = 65535 };
+
+	// Member variables
+	std::vector<unsigned int> offsets;   // vertexCount()+1 entries
+	std::vector<BoneIndex> bones;
+	std::vector<float> weights;
+
+	// Creates an empty table (zero vertices)
+	InfluenceTable();
+
+	// Remove all vertices
+	void clear();
+
+	// Append a vertex with n influences
+	void addVertex(const BoneIndex * vertexBones, const float * vertexWeights, int n);
+
+	int vertexCount() const { return offsets.size() - 1; }
+	int influenceCount(int vertex) const { return offsets[vertex+1] - offsets[vertex]; }
+	int maxInfluences() const;
+
+	// Index of the largest weight of vertex (-1 if no influence)
+	int dominantBone(int vertex) const;
+
+	// Reorder vertices: new vertex i is old vertex newToOld[i]
+	void permute(const std::vector<unsigned int> & newToOld);
+};
+
+// One affine matrix per bone: bind pose -> posed position
+typedef std::vector<_matrix34> SkinningPalette;
+
+// Deform bind pose positions into out (resized to the vertex count)
+void skinVertices(const InfluenceTable & influences,
+                  const std::vector<Vector3> & bindPositions,
+                  const SkinningPalette & palette,
+                  std::vector<Vector3> & out);
+
+// Diffuse the weights over the mesh edges: iterations damped Jacobi sweeps
+// w'(v) = (1-lambda) w(v) + lambda * mean of w over the neighbors of v,
+// run in parallel on threadCount threads (0: every core) with two
+// buffers. The adjacency is TriangleMesh::vertexAdjacency(). Rows stay
+// sparse: weights diffused below 1e-4 are dropped after every sweep, so
+// the cost is linear in the number of vertices and independent of the
+// skeleton size. Weights are left unnormalized; run pruneInfluences()
+// afterwards.
+void smoothInfluences(InfluenceTable & influences,
+                      const std::vector<unsigned int> & adjacencyOffsets,
+                      const std::vector<unsigned int> & adjacency,
+                      int iterations, float lambda = 0.5f, int threadCount = 0);
+
+// Error introduced by pruneInfluences(). The weight error of a vertex
+// is the L1 distance between its normalized input and output weights;
+// a vertex moves by at most that times the spread of its bone transforms.
+struct PruneStats
+{
+	int vertices;
+	int influencesBefore, influencesAfter;
+	int maxBefore, maxAfter;               // largest influence count
+	int droppedByCount, droppedByWeight;   // influences removed by each rule
+	int invalidVertices;                   // no finite positive weight (left empty)
+	double maxWeightError, meanWeightError;
+};
+
+// Clean up raw weights: keep the maxInfluences largest, drop those below
+// minWeight (after normalization, always keeping the largest), renormalize
+// to sum 1. With quantizeBits = 8 or 16 the weights are then rounded to
+// multiples of 1/255 or 1/65535 with error diffusion, so the integers
+// sum exactly to 255 or 65535; weights rounded to 0 are removed.
+// Infinite weights (e.g. a vertex on a bone) share the vertex equally.
+void pruneInfluences(InfluenceTable & influences, int maxInfluences,
+                     float minWeight, int quantizeBits = 0,
+                     PruneStats * stats = 0);
+
+// Vertices grouped by influence count, so each group runs a kernel of
+// fixed width (1, 2 or 4 influences, 3 padded to 4) without per-vertex
+// branching; vertices with more than 4 influences use the CSR loop.
+// Within a group vertices can also be sorted by dominant bone.
+//
+// Single-influence vertices are rigid: consecutive ones with the same
+// bone and weight form a run, transformed by one matrix in a tight
+// streaming loop (a mesh bound with computeClosest1Bone is all runs).
+//
+// order[j] is the original index of batch vertex j. When the mesh is
+// already in batch order (see sortedOrder()), order is the identity and
+// the kernels write their output sequentially.
+class SkinBatches
+{
+public:
+	enum { GROUP_1, GROUP_2, GROUP_4, GROUP_N, GROUP_COUNT };
+
+	// Member variables
+	int groupBegin[GROUP_COUNT+1];           // batch vertex range of each group
+	std::vector<unsigned int> order;         // batch vertex -> original vertex
+	bool identityOrder;
+	std::vector<float> positions;            // 3 per batch vertex, bind pose
+	std::vector<InfluenceTable::BoneIndex> bones[GROUP_N];   // width 1,2,4
+	std::vector<float> weights[GROUP_N];
+	InfluenceTable general;                  // GROUP_N influences
+
+	struct RigidRun { InfluenceTable::BoneIndex bone; float weight; int begin, end; };
+	std::vector<RigidRun> rigidRuns;         // covers GROUP_1
+
+	// Batch order of a table: by group, then (optionally) by dominant bone
+	static void sortedOrder(const InfluenceTable & influences, bool byDominantBone,
+	                        std::vector<unsigned int> & newToOld);
+
+	// Build batches (in sortedOrder()) from bind positions and influences
+	void build(const std::vector<Vector3> & bindPositions,
+	           const InfluenceTable & influences, bool byDominantBone);
+
+	// Skin every group; out is in original vertex order. morphedPositions,
+	// if given, replaces positions (same batch layout, e.g. MorphTargets).
+	void skin(const SkinningPalette & palette, std::vector<Vector3> & out,
+	          const float * morphedPositions = 0) const;
+
+	// Same, into 3 floats per vertex (e.g. TriangleMesh::compactVertices)
+	void skin(const SkinningPalette & palette, float * out,
+	          const float * morphedPositions = 0) const;
+
+	static int groupOf(int influenceCount);
+};
+
+// Bandwidth-reduced skinning input. Per vertex: 3 x 16-bit positions in
+// the bind pose bounding box, 2 x 16-bit octahedral normal, and per
+// influence a 16-bit bone and an 8-bit weight (weights sum to 255).
+class QuantizedSkinStream
+{
+public:
+	// Member variables
+	float boxMin[3];                     // position = boxMin + q * boxStep
+	float boxStep[3];
+	std::vector<unsigned short> positions;   // 3 per vertex
+	std::vector<short> normals;              // 2 per vertex (snorm16)
+	std::vector<unsigned int> offsets;       // as InfluenceTable::offsets
+	std::vector<InfluenceTable::BoneIndex> bones;
+	std::vector<unsigned char> weights;
+
+	// Quantize bind pose positions, normals (may be empty) and influences
+	void build(const std::vector<Vector3> & bindPositions,
+	           const std::vector<Vector3> & bindNormals,
+	           const InfluenceTable & influences);
+
+	int vertexCount() const { return offsets.size() - 1; }
+	bool hasNormals() const { return !normals.empty(); }
+
+	// Bytes read by skinQuantized(), for comparison with the float input
+	size_t byteSize() const;
+
+	// Octahedral normal encoding
+	static void encodeNormal(const Vector3 & n, short out[2]);
+	static Vector3 decodeNormal(const short in[2]);
+};
+
+// Deform a quantized stream; outNormals may be NULL
+void skinQuantized(const QuantizedSkinStream & stream,
+                   const SkinningPalette & palette,
+                   std::vector<Vector3> & outPositions,
+                   std::vector<Vector3> * outNormals);
+
+// Bind pose bounding box of the vertices influenced by each bone.
+// A skinned vertex is a convex combination of its bind position moved by
+// each of its bones (weights >= 0 summing to 1), so it lies in the union
+// of the bone boxes moved by the palette: O(bones) bounds per frame.
+class SkinBounds
+{
+public:
+	// 6 floats per bone: min x,y,z then max x,y,z (min > max if unused)
+	std::vector<float> boxes;
+
+	void build(const std::vector<Vector3> & bindPositions,
+	           const InfluenceTable & influences, int boneCount);
+
+	// Axis-aligned bounds of the mesh skinned with palette.
+	// Returns false if no bone influences any vertex.
+	bool compute(const SkinningPalette & palette, float boxMin[3], float boxMax[3]) const;
+};
+
+// Subset of a mesh drawn with a palette of at most maxBones bones
+struct PaletteChunk
+{
+	std::vector<InfluenceTable::BoneIndex> bones;   // chunk slot -> skeleton bone
+	std::vector<unsigned int> triangles;            // indices into mesh.triangles
+};
+
+// Greedily split the triangles of mesh into chunks referencing at most
+// maxBones bones each. Linear in the number of triangles. Only the
+// maxInfluences largest weights of each vertex count (0: all of them),
+// as when the renderer keeps that many. Every triangle is placed: one
+// that still needs more than maxBones bones keeps its heaviest ones (by
+// weight summed over its corners) and the others are left out of its
+// chunk. Returns the number of triangles trimmed that way.
+int buildPaletteChunks(const TriangleMesh & mesh,
+                       const InfluenceTable & influences,
+                       int boneCount, int maxBones,
+                       std::vector<PaletteChunk> & chunks,
+                       int maxInfluences = 0);
+
+#endif // SKINNING_H
@@ -0,0 +1,233 @@
+/**
+  * Sparse matrix in compressed rows and conjugate gradient solver.
+  *
+  */
+
+#include "SparseMatrix.h"
+
+#include <cmath>
+#include <algorithm>
+
+// Creates an empty matrix (zero rows)
+SparseMatrix::SparseMatrix() :
+    offsets(1, 0)
+{
+}
+
+static bool tripletColumnLess(const SparseMatrix::Triplet & a, const SparseMatrix::Triplet & b)
+{
+	return a.column < b.column;
+}
+
+// Build from unsorted triplets; duplicates are summed. The triplets are
+// bucketed by row, so only the (short) rows are sorted.
+void SparseMatrix::setFromTriplets(int rowCount, std::vector<Triplet> & triplets)
+{
+	std::vector<unsigned int> rowStart(rowCount+1, 0);
+	for(int k=0; k<triplets.size(); k++)
+		rowStart[triplets[k].row+1]++;
+	for(int i=0; i<rowCount; i++)
+		rowStart[i+1] += rowStart[i];
+	std::vector<Triplet> byRow(triplets.size());
+	std::vector<unsigned int> fill(rowStart.begin(), rowStart.end()-1);
+	for(int k=0; k<triplets.size(); k++)
+		byRow[fill[triplets[k].row]++] = triplets[k];
+	triplets.swap(byRow);
+
+	offsets.assign(rowCount+1, 0);
+	columns.clear();
+	values.clear();
+	for(int i=0; i<rowCount; i++)
+	{
+		std::sort(triplets.begin() + rowStart[i], triplets.begin() + rowStart[i+1], tripletColumnLess);
+		for(unsigned int k=rowStart[i]; k<rowStart[i+1]; k++)
+		{
+			if(k > rowStart[i] && triplets[k].column == triplets[k-1].column)
+			{
+				values.back() += triplets[k].value;
+				continue;
+			}
+			columns.push_back(triplets[k].column);
+			values.push_back(triplets[k].value);
+		}
+		offsets[i+1] = columns.size();
+	}
+}
+
+// y = A x
+void SparseMatrix::multiply(const double * x, double * y) const
+{
+	for(int i=0; i<rows(); i++)
+	{
+		double sum = 0;
+		for(unsigned int k=offsets[i]; k<offsets[i+1]; k++)
+			sum += values[k] * x[columns[k]];
+		y[i] = sum;
+	}
+}
+
+// Inverse of the diagonal
+void SparseMatrix::inverseDiagonal(std::vector<double> & out) const
+{
+	out.assign(rows(), 0.0);
+	for(int i=0; i<rows(); i++)
+		for(unsigned int k=offsets[i]; k<offsets[i+1]; k++)
+			if(columns[k] == i && values[k] != 0)
+				out[i] = 1.0 / values[k];
+}
+
+//////////////////////////////////////////////////
+// Incomplete Cholesky, IC(0)
+//////////////////////////////////////////////////
+
+void SparseMatrix::incompleteCholesky(SparseMatrix & factor) const
+{
+	int n = rows();
+	factor.offsets.assign(n+1, 0);
+	factor.columns.clear();
+	factor.values.clear();
+	for(int i=0; i<n; i++)
+	{
+		// row i of L, left to right: L(i,j) = (A(i,j) - sum_m<j L(i,m) L(j,m)) / L(j,j)
+		unsigned int rowStart = factor.columns.size();
+		double diagonal = 0;
+		for(unsigned int k=offsets[i]; k<offsets[i+1]; k++)
+		{
+			unsigned int j = columns[k];
+			if(j == i)
+				diagonal = values[k];
+			if(j >= i)
+				continue;
+			double sum = values[k];
+			unsigned int a = rowStart, b = factor.offsets[j], bEnd = factor.offsets[j+1] - 1;   // row j without its diagonal
+			while(a < factor.columns.size() && b < bEnd)
+				if(factor.columns[a] < factor.columns[b])
+					a++;
+				else if(factor.columns[a] > factor.columns[b])
+					b++;
+				else
+					sum -= factor.values[a++] * factor.values[b++];
+			factor.columns.push_back(j);
+			factor.values.push_back(sum / factor.values[bEnd]);
+		}
+		double pivot = diagonal;
+		for(unsigned int a=rowStart; a<factor.columns.size(); a++)
+			pivot -= factor.values[a] * factor.values[a];
+		if(pivot <= 0)
+			pivot = diagonal > 0 ? diagonal : 1;
+		factor.columns.push_back(i);                 // diagonal last in its row
+		factor.values.push_back(sqrt(pivot));
+		factor.offsets[i+1] = factor.columns.size();
+	}
+}
+
+//////////////////////////////////////////////////
+// Preconditioned conjugate gradient
+//////////////////////////////////////////////////
+
+// z = M^-1 r for the Jacobi preconditioner
+struct JacobiPreconditioner
+{
+	const std::vector<double> & invDiagonal;
+
+	void apply(const double * r, double * z) const
+	{
+		for(int i=0; i<invDiagonal.size(); i++)
+			z[i] = invDiagonal[i] * r[i];
+	}
+};
+
+// z = (L L^T)^-1 r: forward substitution with L, then backward with L^T
+struct CholeskyPreconditioner
+{
+	const SparseMatrix & L;
+
+	void apply(const double * r, double * z) const
+	{
+		int n = L.rows();
+		for(int i=0; i<n; i++)
+		{
+			double sum = r[i];
+			unsigned int diagonal = L.offsets[i+1] - 1;
+			for(unsigned int k=L.offsets[i]; k<diagonal; k++)
+				sum -= L.values[k] * z[L.columns[k]];
+			z[i] = sum / L.values[diagonal];
+		}
+		for(int i=n-1; i>=0; i--)
+		{
+			unsigned int diagonal = L.offsets[i+1] - 1;
+			z[i] /= L.values[diagonal];
+			for(unsigned int k=L.offsets[i]; k<diagonal; k++)
+				z[L.columns[k]] -= L.values[k] * z[i];
+		}
+	}
+};
+
+template <class Preconditioner>
+static int conjugateGradient(const SparseMatrix & A, const Preconditioner & preconditioner,
+                             const double * b, double * x, double tolerance, int maxIterations)
+{
+	int n = A.rows();
+	std::vector<double> r(n), z(n), p(n), q(n);
+
+	A.multiply(x, &q[0]);
+	double bNorm = 0, rz = 0;
+	for(int i=0; i<n; i++)
+	{
+		r[i] = b[i] - q[i];
+		bNorm += b[i] * b[i];
+	}
+	preconditioner.apply(&r[0], &z[0]);
+	for(int i=0; i<n; i++)
+	{
+		p[i] = z[i];
+		rz += r[i] * z[i];
+	}
+	double threshold = tolerance * tolerance * bNorm;
+
+	int iteration = 0;
+	for(; iteration<maxIterations; iteration++)
+	{
+		double rr = 0;
+		for(int i=0; i<n; i++)
+			rr += r[i] * r[i];
+		if(rr <= threshold)
+			break;
+
+		A.multiply(&p[0], &q[0]);
+		double pq = 0;
+		for(int i=0; i<n; i++)
+			pq += p[i] * q[i];
+		if(pq <= 0)
+			break;                       // not positive definite (or converged to 0)
+		double alpha = rz / pq;
+		for(int i=0; i<n; i++)
+		{
+			x[i] += alpha * p[i];
+			r[i] -= alpha * q[i];
+		}
+		preconditioner.apply(&r[0], &z[0]);
+		double rzNew = 0;
+		for(int i=0; i<n; i++)
+			rzNew += r[i] * z[i];
+		double beta = rzNew / rz;
+		rz = rzNew;
+		for(int i=0; i<n; i++)
+			p[i] = z[i] + beta * p[i];
+	}
+	return iteration;
+}
+
+int SparseMatrix::solvePCG(const std::vector<double> & invDiagonal, const double * b, double * x,
+                           double tolerance, int maxIterations) const
+{
+	JacobiPreconditioner preconditioner = { invDiagonal };
+	return conjugateGradient(*this, preconditioner, b, x, tolerance, maxIterations);
+}
+
+int SparseMatrix::solvePCG(const SparseMatrix & factor, const double * b, double * x,
+                           double tolerance, int maxIterations) const
+{
+	CholeskyPreconditioner preconditioner = { factor };
+	return conjugateGradient(*this, preconditioner, b, x, tolerance, maxIterations);
+}
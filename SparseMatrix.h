@@ -0,0 +1,57 @@
+/**
+  * Sparse matrix in compressed rows (CSR) and a preconditioned conjugate
+  * gradient solver for symmetric positive definite systems.
+  *
+  * The entries of row i are [offsets[i], offsets[i+1]) of the columns and
+  * values arrays, sorted by column. The solver only reads the matrix and
+  * the preconditioner, so several right-hand sides can be solved
+  * concurrently from different threads. The preconditioner is either the
+  * inverse diagonal (Jacobi) or an incomplete Cholesky factor, computed
+  * once and shared by every solve.
+  */
+
+#ifndef SPARSE_MATRIX_H
+#define SPARSE_MATRIX_H
+
+#include <vector>
+
+class SparseMatrix
+{
+public:
+	// Member variables
+	std::vector<unsigned int> offsets;   // rows()+1 entries
+	std::vector<unsigned int> columns;
+	std::vector<double> values;
+
+	// Creates an empty matrix (zero rows)
+	SparseMatrix();
+
+	int rows() const { return offsets.size() - 1; }
+
+	// Build from unsorted (row, column, value) triplets; duplicates are summed
+	struct Triplet { unsigned int row, column; double value; };
+	void setFromTriplets(int rowCount, std::vector<Triplet> & triplets);
+
+	// y = A x
+	void multiply(const double * x, double * y) const;
+
+	// Inverse of the diagonal (Jacobi preconditioner), 0 where the diagonal is 0
+	void inverseDiagonal(std::vector<double> & out) const;
+
+	// Incomplete Cholesky factor (no fill-in): lower triangular L with the
+	// pattern of the lower half of A, L L^T ~ A. Needs a symmetric A; a
+	// pivot that is not positive falls back to the diagonal of A.
+	void incompleteCholesky(SparseMatrix & factor) const;
+
+	// Solve A x = b by conjugate gradient with the Jacobi preconditioner
+	// invDiagonal, starting from x. Stops when |r| <= tolerance |b|.
+	// Returns the number of iterations.
+	int solvePCG(const std::vector<double> & invDiagonal, const double * b, double * x,
+	             double tolerance, int maxIterations) const;
+
+	// Same, preconditioned by an incompleteCholesky() factor of A
+	int solvePCG(const SparseMatrix & factor, const double * b, double * x,
+	             double tolerance, int maxIterations) const;
+};
+
+#endif // SPARSE_MATRIX_H
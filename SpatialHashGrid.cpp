@@ -0,0 +1,124 @@
+/**
+  * Sparse uniform grid over a point set.
+  *
+  */
+
+#include "SpatialHashGrid.h"
+
+#include <algorithm>
+
+SpatialHashGrid::SpatialHashGrid() :
+    cellSize(1)
+{
+}
+
+// 21 bits per coordinate
+unsigned long long SpatialHashGrid::key(int x, int y, int z)
+{
+	const unsigned long long mask = (1 << 21) - 1;
+	return ((unsigned long long)(x & mask) << 42) | ((unsigned long long)(y & mask) << 21) | (unsigned long long)(z & mask);
+}
+
+// Bucket points into cells: expected O(n) (hashing, then a counting sort)
+void SpatialHashGrid::build(const std::vector<Vector3> & points, double size)
+{
+	cellSize = size;
+	int n = points.size();
+	cells.clear();
+	index.clear();
+	index.reserve(n);
+
+	std::vector<int> cellOf(n);
+	for(int i=0; i<n; i++)
+	{
+		int x = coordinate(points[i][0]), y = coordinate(points[i][1]), z = coordinate(points[i][2]);
+		std::pair<std::unordered_map<unsigned long long, int>::iterator, bool> found =
+			index.insert(std::make_pair(key(x, y, z), (int)cells.size()));
+		if(found.second)
+		{
+			Cell cell = { x, y, z, 0, 0 };
+			cells.push_back(cell);
+		}
+		cellOf[i] = found.first->second;
+		cells[cellOf[i]].end++;           // count for now
+	}
+
+	unsigned int begin = 0;
+	for(int c=0; c<cells.size(); c++)
+	{
+		cells[c].begin = begin;
+		begin += cells[c].end;
+		cells[c].end = cells[c].begin;
+	}
+	order.resize(n);
+	for(int i=0; i<n; i++)
+		order[cells[cellOf[i]].end++] = i;
+}
+
+// Cell size for about pointsPerCell points per cell
+double SpatialHashGrid::suggestCellSize(const std::vector<Vector3> & points, double pointsPerCell)
+{
+	if(points.empty())
+		return 1;
+	Vector3 lo = points[0], hi = points[0];
+	for(int i=0; i<points.size(); i++)
+		for(int c=0; c<3; c++)
+		{
+			lo[c] = std::min(lo[c], points[i][c]);
+			hi[c] = std::max(hi[c], points[i][c]);
+		}
+	double volume = 1;
+	double largest = 0;
+	for(int c=0; c<3; c++)
+		largest = std::max(largest, hi[c] - lo[c]);
+	if(largest <= 0)
+		return 1;
+	for(int c=0; c<3; c++)
+		volume *= std::max(hi[c] - lo[c], 1e-3 * largest);
+	return cbrt(volume * pointsPerCell / points.size());
+}
+
+// Index of the cell at (x,y,z), -1 if empty
+int SpatialHashGrid::findCell(int x, int y, int z) const
+{
+	std::unordered_map<unsigned long long, int>::const_iterator it = index.find(key(x, y, z));
+	return it == index.end() ? -1 : it->second;
+}
+
+// Points within radius of p
+void SpatialHashGrid::query(const std::vector<Vector3> & points, const Vector3 & p, double radius,
+                            std::vector<unsigned int> & out) const
+{
+	int lo[3], hi[3];
+	for(int c=0; c<3; c++)
+	{
+		lo[c] = coordinate(p[c] - radius);
+		hi[c] = coordinate(p[c] + radius);
+	}
+	double radius2 = radius * radius;
+	for(int x=lo[0]; x<=hi[0]; x++)
+		for(int y=lo[1]; y<=hi[1]; y++)
+			for(int z=lo[2]; z<=hi[2]; z++)
+			{
+				int c = findCell(x, y, z);
+				if(c < 0)
+					continue;
+				for(unsigned int k=cells[c].begin; k<cells[c].end; k++)
+				{
+					Vector3 d = points[order[k]] - p;
+					if(d.dot(d) <= radius2)
+						out.push_back(order[k]);
+				}
+			}
+}
+
+// Distance from the segment to the cell center, minus the half diagonal
+double SpatialHashGrid::segmentLowerBound(const Cell & c, const Vector3 & a, const Vector3 & b) const
+{
+	Vector3 center((c.x + 0.5) * cellSize, (c.y + 0.5) * cellSize, (c.z + 0.5) * cellSize);
+	Vector3 v = b - a;
+	Vector3 w = center - a;
+	double c1 = w.dot(v), c2 = v.dot(v);
+	Vector3 closest = c1 <= 0 ? a : (c2 <= c1 ? b : a + v * (c1 / c2));
+	return std::max(0.0, (center - closest).length() - 0.5 * sqrt(3.0) * cellSize);
+}
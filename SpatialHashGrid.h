@@ -0,0 +1,61 @@
+/**
+  * Uniform grid over a point set, stored sparsely: only non-empty cells
+  * exist, found through a hash table on their integer coordinates.
+  *
+  * The points are grouped by cell, so the points of cell c are
+  * order[cells[c].begin .. cells[c].end), in increasing index order.
+  * Building takes expected O(n) time; a radius query visits the cells
+  * overlapping the query box and only tests the points they hold.
+  */
+
+#ifndef SPATIAL_HASH_GRID_H
+#define SPATIAL_HASH_GRID_H
+
+#include <vector>
+#include <unordered_map>
+#include <cmath>
+#include "GraphicsMath.h"
+
+class SpatialHashGrid
+{
+public:
+	struct Cell
+	{
+		int x, y, z;                  // integer coordinates
+		unsigned int begin, end;      // range in order
+	};
+
+	// Member variables
+	double cellSize;
+	std::vector<Cell> cells;
+	std::vector<unsigned int> order;  // point indices, grouped by cell
+
+	SpatialHashGrid();
+
+	// Bucket points into cells of the given size (> 0)
+	void build(const std::vector<Vector3> & points, double size);
+
+	// Cell size giving about pointsPerCell points per cell for points
+	// spread over the bounding box of points
+	static double suggestCellSize(const std::vector<Vector3> & points, double pointsPerCell = 4);
+
+	// Index of the cell at integer coordinates (x,y,z), -1 if empty
+	int findCell(int x, int y, int z) const;
+
+	// Integer coordinate of a position along one axis
+	int coordinate(double p) const { return (int)floor(p / cellSize); }
+
+	// Append to out the points within radius of p (positions from build)
+	void query(const std::vector<Vector3> & points, const Vector3 & p, double radius,
+	           std::vector<unsigned int> & out) const;
+
+	// Lower bound of the distance from the segment [a, b] to any point of
+	// cell c (distance to the cell center minus its half diagonal)
+	double segmentLowerBound(const Cell & c, const Vector3 & a, const Vector3 & b) const;
+
+private:
+	static unsigned long long key(int x, int y, int z);
+	std::unordered_map<unsigned long long, int> index;
+};
+
+#endif // SPATIAL_HASH_GRID_H
@@ -0,0 +1,491 @@
+/**
+  * Out-of-core OBJ import.
+  *
+  */
+
+#include "StreamingImport.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <cfloat>
+#include <cctype>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char MAGIC[4] = { 'L', 'B', 'S', 'M' };
+static const unsigned int VERSION = 1;
+
+// Cell coordinates are packed in 21 bits each
+static const double MAX_CELLS_PER_AXIS = (1 << 21) - 1;
+
+namespace {
+
+// A file created at a given size and mapped read-write
+class WritableMap
+{
+public:
+	char * data;
+
+	WritableMap() : data(0), fd(-1), size(0) {}
+	~WritableMap() { finish(size); }
+
+	// temporary: the file is unlinked at once and vanishes when unmapped
+	bool create(const char * filename, size_t bytes, bool temporary)
+	{
+		fd = ::open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if(fd < 0)
+			return false;
+		if(temporary)
+			unlink(filename);
+		size = bytes;
+		if(ftruncate(fd, bytes) != 0)
+			return false;
+		if(bytes == 0)
+			return true;
+		void * p = mmap(0, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if(p == MAP_FAILED)
+			return false;
+		data = (char *)p;
+		return true;
+	}
+
+	// Unmap and close, keeping the first keep bytes
+	void finish(size_t keep)
+	{
+		if(data)
+			munmap(data, size);
+		data = 0;
+		if(fd >= 0)
+		{
+			if(keep < size && ftruncate(fd, keep) != 0)
+				printf("streamOBJ: could not trim the output\n");
+			::close(fd);
+		}
+		fd = -1;
+	}
+
+private:
+	int fd;
+	size_t size;
+};
+
+// The v and f lines of an OBJ file, read through a buffer of fixed size
+class ObjReader
+{
+public:
+	ObjReader(size_t bufferBytes) : file(0), line(0), capacity(0), buffer(bufferBytes) {}
+	~ObjReader() { close(); free(line); }
+
+	bool open(const char * filename)
+	{
+		close();
+		file = fopen(filename, "rb");
+		if(file)
+			setvbuf(file, &buffer[0], _IOFBF, buffer.size());
+		return file != 0;
+	}
+
+	void close()
+	{
+		if(file)
+			fclose(file);
+		file = 0;
+	}
+
+	// Type of the next v or f line ('v', 'f', or 0 at the end of the file);
+	// text points after the keyword
+	char next(const char *& text)
+	{
+		while(getline(&line, &capacity, file) > 0)
+		{
+			const char * p = line;
+			while(*p == ' ' || *p == '\t')
+				p++;
+			if((p[0] == 'v' || p[0] == 'f') && (p[1] == ' ' || p[1] == '\t'))
+			{
+				text = p + 2;
+				return p[0];
+			}
+		}
+		return 0;
+	}
+
+private:
+	FILE * file;
+	char * line;
+	size_t capacity;
+	std::vector<char> buffer;
+};
+
+void parseVertex(const char * text, double p[3])
+{
+	char * end;
+	for(int c=0; c<3; c++)
+	{
+		p[c] = strtod(text, &end);
+		text = end;
+	}
+}
+
+// 0-based corners of a face (v, v/t, v//n or v/t/n; negative indices are
+// relative to the vertices read so far), -1 for an invalid index
+void parseFace(const char * text, long long verticesSoFar, std::vector<long long> & corners)
+{
+	corners.clear();
+	char * end;
+	for(const char * p = text; ; p = end)
+	{
+		while(*p == ' ' || *p == '\t')
+			p++;
+		long long i = strtoll(p, &end, 10);
+		if(end == p)
+			break;
+		while(*end && !isspace((unsigned char)*end))
+			end++;
+		corners.push_back(i > 0 ? i - 1 : (i < 0 ? verticesSoFar + i : -1));
+	}
+}
+
+// Fixed capacity hash table of grid cells, open addressing
+class CellTable
+{
+public:
+	struct Cell
+	{
+		unsigned long long key;          // 0: empty
+		unsigned int id;                 // output vertex, in order of creation
+		unsigned int count;
+		double sum[3];
+	};
+
+	unsigned int count;
+
+	// Within bytes, and no larger than needed for maxCells
+	CellTable(size_t bytes, long long maxCells) : count(0)
+	{
+		size_t capacity = 16;
+		while(2 * capacity * sizeof(Cell) <= bytes && capacity / 4 * 3 < maxCells)
+			capacity *= 2;
+		cells.resize(capacity);
+		mask = capacity - 1;
+		shift = 64;
+		for(size_t c=capacity; c>1; c/=2)
+			shift--;
+		maxCount = capacity / 4 * 3;
+	}
+
+	size_t bytes() const { return cells.size() * sizeof(Cell); }
+
+	void clear()
+	{
+		memset(&cells[0], 0, bytes());
+		count = 0;
+	}
+
+	// Output vertex of the cell holding p, -1 if the table is full
+	long long insert(unsigned long long key, const double p[3])
+	{
+		key++;
+		size_t i = key * 0x9E3779B97F4A7C15ull >> shift;     // top bits mix every axis
+		while(cells[i].key != 0 && cells[i].key != key)
+			i = (i + 1) & mask;
+		Cell & c = cells[i];
+		if(c.key == 0)
+		{
+			if(count == maxCount)
+				return -1;
+			c.key = key;
+			c.id = count++;
+		}
+		c.count++;
+		for(int d=0; d<3; d++)
+			c.sum[d] += p[d];
+		return c.id;
+	}
+
+	// Average position of each cell, by output vertex
+	void writeAverages(float * positions) const
+	{
+		for(size_t i=0; i<cells.size(); i++)
+			if(cells[i].key != 0)
+				for(int d=0; d<3; d++)
+					positions[3*cells[i].id + d] = cells[i].sum[d] / cells[i].count;
+	}
+
+private:
+	std::vector<Cell> cells;
+	size_t mask, maxCount;
+	int shift;
+};
+
+} // namespace
+
+//////////////////////////////////////////////////
+// OBJ -> mapped binary mesh, in bounded memory
+//////////////////////////////////////////////////
+
+bool streamOBJ(const char * objFile, const char * outFile,
+               const StreamingImportOptions & options,
+               StreamingImportStats * stats,
+               std::vector<unsigned int> * vertexMap)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	size_t bufferBytes = options.memoryBudget / 8;
+	bufferBytes = bufferBytes < 4096 ? 4096 : (bufferBytes > (16 << 20) ? (16 << 20) : bufferBytes);
+	ObjReader reader(bufferBytes);
+	bool clustering = options.cellSize > 0;
+	int passes = 0;
+
+	// pass 1: counts and bounding box
+	if(!reader.open(objFile))
+	{
+		printf("streamOBJ: unable to open %s\n", objFile);
+		return false;
+	}
+	long long objVertices = 0, objTriangles = 0;
+	double boxMin[3] = { DBL_MAX, DBL_MAX, DBL_MAX }, boxMax[3] = { -DBL_MAX, -DBL_MAX, -DBL_MAX };
+	std::vector<long long> corners;
+	const char * text;
+	for(char type; (type = reader.next(text)) != 0; )
+		if(type == 'v')
+		{
+			double p[3];
+			parseVertex(text, p);
+			for(int d=0; d<3; d++)
+			{
+				boxMin[d] = p[d] < boxMin[d] ? p[d] : boxMin[d];
+				boxMax[d] = p[d] > boxMax[d] ? p[d] : boxMax[d];
+			}
+			objVertices++;
+		}
+		else
+		{
+			parseFace(text, objVertices, corners);
+			if(corners.size() >= 3)
+				objTriangles += corners.size() - 2;
+		}
+	passes++;
+	if(objVertices >= 0xFFFFFFFFll)
+	{
+		printf("streamOBJ: %lld vertices do not fit 32-bit indices\n", objVertices);
+		return false;
+	}
+
+	// pass 2 (clustering): vertex -> cell, growing the cells when the table fills up
+	double cellSize = options.cellSize;
+	size_t tableBytes = options.memoryBudget > bufferBytes ? options.memoryBudget - bufferBytes : 0;
+	CellTable table(clustering ? tableBytes : 0, objVertices);
+	WritableMap cellMap;
+	std::string scratch = std::string(outFile) + ".cells";
+	if(clustering && !cellMap.create(scratch.c_str(), objVertices * sizeof(unsigned int), true))
+	{
+		printf("streamOBJ: unable to map %s\n", scratch.c_str());
+		return false;
+	}
+	for(int d=0; d<3 && clustering; d++)
+		if(boxMax[d] - boxMin[d] > cellSize * MAX_CELLS_PER_AXIS)
+			cellSize = (boxMax[d] - boxMin[d]) / MAX_CELLS_PER_AXIS;
+	for(bool full = clustering; full; )
+	{
+		full = false;
+		table.clear();
+		reader.open(objFile);
+		unsigned int * cellOf = (unsigned int *)cellMap.data;
+		long long v = 0;
+		for(char type; !full && (type = reader.next(text)) != 0; )
+			if(type == 'v')
+			{
+				double p[3];
+				parseVertex(text, p);
+				unsigned long long key = 0;
+				for(int d=0; d<3; d++)
+					key = key << 21 | (unsigned long long)((p[d] - boxMin[d]) / cellSize);
+				long long id = table.insert(key, p);
+				if(id < 0)
+				{
+					full = true;
+					cellSize *= 2;
+				}
+				else
+					cellOf[v++] = id;
+			}
+		passes++;
+	}
+
+	// output: header, positions, then triangles (trimmed to those kept)
+	long long outVertices = clustering ? table.count : objVertices;
+	size_t positionBytes = outVertices * 3 * sizeof(float);
+	WritableMap out;
+	if(!out.create(outFile, sizeof(StreamedMeshHeader) + positionBytes + objTriangles * 3 * sizeof(unsigned int), false))
+	{
+		printf("streamOBJ: unable to map %s\n", outFile);
+		return false;
+	}
+	float * positions = (float *)(out.data + sizeof(StreamedMeshHeader));
+	unsigned int * indices = (unsigned int *)(out.data + sizeof(StreamedMeshHeader) + positionBytes);
+	if(clustering)
+		table.writeAverages(positions);
+
+	// pass 3: vertices (unless clustered) and triangles, straight to the map
+	const unsigned int * cellOf = (const unsigned int *)cellMap.data;
+	if(vertexMap)
+	{
+		vertexMap->clear();
+		if(clustering)
+			vertexMap->assign(cellOf, cellOf + objVertices);
+	}
+	long long v = 0, triangles = 0, invalid = 0;
+	reader.open(objFile);
+	for(char type; (type = reader.next(text)) != 0; )
+		if(type == 'v')
+		{
+			if(!clustering)
+			{
+				double p[3];
+				parseVertex(text, p);
+				for(int d=0; d<3; d++)
+					positions[3*v + d] = p[d];
+			}
+			v++;
+		}
+		else
+		{
+			parseFace(text, v, corners);
+			if(corners.size() < 3)
+				continue;
+			bool valid = true;
+			for(int k=0; k<corners.size(); k++)
+				valid = valid && corners[k] >= 0 && corners[k] < objVertices;
+			if(!valid)
+			{
+				invalid += corners.size() - 2;
+				continue;
+			}
+			for(int k=0; k<corners.size() && clustering; k++)
+				corners[k] = cellOf[corners[k]];
+			for(int i=0; i+2<corners.size(); i++)
+			{
+				unsigned int a = corners[0], b = corners[i+1], c = corners[i+2];
+				if(clustering && (a == b || b == c || c == a))
+					continue;             // collapsed into a cell
+				indices[3*triangles] = a;
+				indices[3*triangles+1] = b;
+				indices[3*triangles+2] = c;
+				triangles++;
+			}
+		}
+	passes++;
+
+	StreamedMeshHeader * header = (StreamedMeshHeader *)out.data;
+	memcpy(header->magic, MAGIC, 4);
+	header->version = VERSION;
+	header->vertexCount = outVertices;
+	header->triangleCount = triangles;
+	out.finish(sizeof(StreamedMeshHeader) + positionBytes + triangles * 3 * sizeof(unsigned int));
+
+	if(stats)
+	{
+		stats->objVertices = objVertices;
+		stats->objTriangles = objTriangles;
+		stats->vertices = outVertices;
+		stats->triangles = triangles;
+		stats->invalidTriangles = invalid;
+		stats->cellSize = clustering ? cellSize : 0;
+		stats->passes = passes;
+		stats->bufferBytes = bufferBytes;
+		stats->tableBytes = clustering ? table.bytes() : 0;
+		stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+	return true;
+}
+
+//////////////////////////////////////////////////
+// Read-only mapping of the output
+//////////////////////////////////////////////////
+
+MappedMesh::MappedMesh() :
+    header(0),
+    size(0)
+{
+}
+
+MappedMesh::~MappedMesh()
+{
+	close();
+}
+
+bool MappedMesh::open(const char * filename)
+{
+	close();
+	int fd = ::open(filename, O_RDONLY);
+	if(fd < 0)
+	{
+		printf("MappedMesh: unable to open %s\n", filename);
+		return false;
+	}
+	struct stat info;
+	void * p = MAP_FAILED;
+	if(fstat(fd, &info) == 0 && info.st_size >= sizeof(StreamedMeshHeader))
+		p = mmap(0, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if(p == MAP_FAILED)
+	{
+		printf("MappedMesh: unable to map %s\n", filename);
+		return false;
+	}
+	header = (const StreamedMeshHeader *)p;
+	size = info.st_size;
+	if(memcmp(header->magic, MAGIC, 4) != 0 || header->version != VERSION ||
+	   size < sizeof(StreamedMeshHeader) + (header->vertexCount + header->triangleCount) * 3 * 4)
+	{
+		printf("MappedMesh: %s is not a streamed mesh\n", filename);
+		close();
+		return false;
+	}
+	return true;
+}
+
+void MappedMesh::close()
+{
+	if(header)
+		munmap((void *)header, size);
+	header = 0;
+	size = 0;
+}
+
+const float * MappedMesh::positions() const
+{
+	return (const float *)(header + 1);
+}
+
+const unsigned int * MappedMesh::indices() const
+{
+	return (const unsigned int *)(positions() + 3 * header->vertexCount);
+}
+
+void MappedMesh::toTriangleMesh(TriangleMesh & mesh) const
+{
+	mesh.expand();
+	int n = vertexCount(), m = triangleCount();
+	const float * p = positions();
+	const unsigned int * c = indices();
+	mesh.vertices.resize(n);
+	for(int i=0; i<n; i++)
+		mesh.vertices[i] = Vector3(p[3*i], p[3*i+1], p[3*i+2]);
+	mesh.normals.clear();
+	mesh.triangles.resize(m);
+	for(int t=0; t<m; t++)
+	{
+		mesh.triangles[t].a = c[3*t];
+		mesh.triangles[t].b = c[3*t+1];
+		mesh.triangles[t].c = c[3*t+2];
+	}
+	mesh.topologyChanged();
+}
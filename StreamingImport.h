@@ -0,0 +1,98 @@
+/**
+  * Out-of-core OBJ import for scans larger than memory.
+  *
+  * streamOBJ() converts an OBJ file into a binary mesh file written
+  * through a memory map, in passes over the text. Each pass holds a read
+  * buffer and, when clustering, a fixed-capacity cell table, so peak
+  * memory is set by memoryBudget and does not grow with the file:
+  *  1. count vertices and triangles (n-gons are fans), bounding box;
+  *  2. (clustering only) bucket the vertices into cells; the OBJ vertex
+  *     -> cell map goes to a memory-mapped scratch file (4 bytes per
+  *     vertex, paged by the OS rather than held);
+  *  3. write the vertices and triangles straight into the mapped output.
+  *
+  * Clustering (Rossignac and Borrel vertex clustering, the scheme of
+  * Lindstrom's out-of-core simplification) welds with a small cellSize
+  * and decimates with a larger one: the vertices of a cell become their
+  * average, and triangles with two corners in one cell are dropped. If a
+  * pass fills the cell table, the cell size doubles and the pass starts
+  * over; stats report the size used.
+  *
+  * The OBJ vertex -> output vertex map can be copied out of the scratch
+  * file (for morph targets read in OBJ order); that copy is the one
+  * thing that grows with the file, 4 bytes per OBJ vertex.
+  *
+  * Output file: StreamedMeshHeader, then 3 floats per vertex, then 3
+  * 32-bit indices per triangle, in native byte order. MappedMesh maps it
+  * back read-only.
+  */
+
+#ifndef STREAMING_IMPORT_H
+#define STREAMING_IMPORT_H
+
+#include <cstddef>
+#include <vector>
+#include "TriangleMesh.h"
+
+struct StreamedMeshHeader
+{
+	char magic[4];                       // "LBSM"
+	unsigned int version;
+	unsigned long long vertexCount;
+	unsigned long long triangleCount;
+};
+
+struct StreamingImportOptions
+{
+	size_t memoryBudget;                 // bytes for the read buffer and the cell table
+	double cellSize;                     // 0: keep every vertex; > 0: cluster vertices
+
+	StreamingImportOptions() : memoryBudget(64 << 20), cellSize(0) {}
+};
+
+struct StreamingImportStats
+{
+	long long objVertices, objTriangles;
+	long long vertices, triangles;       // written
+	long long invalidTriangles;          // out of range indices
+	double cellSize;                     // after doubling, if the table filled up
+	int passes;
+	size_t bufferBytes, tableBytes;     // memory held
+	double seconds;
+};
+
+// Convert objFile into outFile. Returns false (with a message) on error.
+// If vertexMap is given, it receives the output vertex of each OBJ vertex
+// when clustering (it is left empty otherwise: the vertices are unchanged).
+bool streamOBJ(const char * objFile, const char * outFile,
+               const StreamingImportOptions & options = StreamingImportOptions(),
+               StreamingImportStats * stats = 0,
+               std::vector<unsigned int> * vertexMap = 0);
+
+// Read-only memory map of a streamOBJ() output
+class MappedMesh
+{
+public:
+	MappedMesh();
+	~MappedMesh();
+
+	bool open(const char * filename);
+	void close();
+
+	long long vertexCount() const { return header ? header->vertexCount : 0; }
+	long long triangleCount() const { return header ? header->triangleCount : 0; }
+	const float * positions() const;             // 3 per vertex
+	const unsigned int * indices() const;        // 3 per triangle
+
+	// Copy into the vertices and triangles of mesh
+	void toTriangleMesh(TriangleMesh & mesh) const;
+
+private:
+	MappedMesh(const MappedMesh &);
+	MappedMesh & operator=(const MappedMesh &);
+
+	const StreamedMeshHeader * header;
+	size_t size;
+};
+
+#endif // STREAMING_IMPORT_H
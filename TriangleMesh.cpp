@@ -6,6 +6,7 @@
   */
 
 #include "TriangleMesh.h"
+#include "SpatialHashGrid.h"
 
 #include <cmath>
 #include "defs.h"
@@ -14,12 +15,15 @@
 #include <iostream>
 #include <sstream>
 #include <cstdlib>
+#include <algorithm>
 
 // Creates an empty triangle mesh
 TriangleMesh::TriangleMesh() :
     vertices(),
     normals(),
-    triangles()
+    triangles(),
+    topologyRevision(0),
+    compactStorage(false)
 {
 }
 
@@ -27,7 +31,9 @@ TriangleMesh::TriangleMesh() :
 TriangleMesh::TriangleMesh(const char * filename) :
     vertices(),
     normals(),
-    triangles()
+    triangles(),
+    topologyRevision(0),
+    compactStorage(false)
 {
 	readFromOBJ(filename);
 }
@@ -43,6 +49,12 @@ void TriangleMesh::readFromOBJ(const char * filename)
 	vertices.clear();
 	normals.clear();
 	triangles.clear();
+	compactVertices.clear();
+	compactNormals.clear();
+	indices16.clear();
+	indices32.clear();
+	compactStorage = false;
+	topologyChanged();
 	
 	// Opening file
 	string line;
@@ -125,25 +137,131 @@ TriangleMesh::MeshDrawStyle & operator++(TriangleMesh::MeshDrawStyle & style)
 
 void TriangleMesh::print()
 {
-  int nVert = vertices.size();
-  int nTri = triangles.size();
+  int nVert = vertexCount();
+  int nTri = triangleCount();
 
   cout << "Mesh " << name << ": " << nVert << " vertices, " << nTri << " triangles" << endl;
   if (nVert>50) {
     cout << "Too many vertices to reasonably print." << endl;
     return;
   }
-  for(int i=0; i<nVert; i++) 
-    printf("vertex %d:  %6.3f %6.3f %6.3f\n", i, vertices[i][0], vertices[i][1], vertices[i][2]);
+  for(int i=0; i<nVert; i++) {
+    Vector3 v = position(i);
+    printf("vertex %d:  %6.3f %6.3f %6.3f\n", i, v[0], v[1], v[2]);
+  }
   for (int j=0; j<nTri; j++)
-    printf("face %d:   %d %d %d\n", j, triangles[j].a, triangles[j].b, triangles[j].c); 
+    printf("face %d:   %d %d %d\n", j, corner(j, 0), corner(j, 1), corner(j, 2)); 
+}
+
+//////////////////////////////////////////////////	
+// Compact storage
+//////////////////////////////////////////////////	
+
+// Positions, normals and triangles of the full storage as flat arrays
+// (Vector3 is three packed doubles, Triangle three packed indices)
+static double * flat(std::vector<Vector3> & v) { return v.empty() ? 0 : &v[0][0]; }
+static unsigned int * flat(std::vector<TriangleMesh::Triangle> & t) { return t.empty() ? 0 : &t[0].a; }
+template<class T>
+static T * flat(std::vector<T> & v) { return v.empty() ? 0 : &v[0]; }
+
+void TriangleMesh::compact()
+{
+	if(compactStorage)
+		return;
+	int n = vertices.size();
+	compactVertices.assign(flat(vertices), flat(vertices) + 3*n);
+	if(normals.size() == n)
+		compactNormals.assign(flat(normals), flat(normals) + 3*n);
+	else
+		compactNormals.clear();
+	if(n < 65536)
+		indices16.assign(flat(triangles), flat(triangles) + 3*triangles.size());
+	else
+		indices32.assign(flat(triangles), flat(triangles) + 3*triangles.size());
+	std::vector<Vertex>().swap(vertices);
+	std::vector<Normal>().swap(normals);
+	std::vector<Triangle>().swap(triangles);
+	compactStorage = true;
+	topologyChanged();
+}
+
+void TriangleMesh::expand()
+{
+	if(!compactStorage)
+		return;
+	int n = vertexCount();
+	vertices.resize(n);
+	for(int i=0; i<n; i++)
+		vertices[i] = position(i);
+	normals.resize(compactNormals.size() / 3);
+	for(int i=0; i<normals.size(); i++)
+		normals[i] = Normal(compactNormals[3*i], compactNormals[3*i+1], compactNormals[3*i+2]);
+	triangles.resize(triangleCount());
+	for(int t=0; t<triangles.size(); t++)
+	{
+		triangles[t].a = corner(t, 0);
+		triangles[t].b = corner(t, 1);
+		triangles[t].c = corner(t, 2);
+	}
+	std::vector<float>().swap(compactVertices);
+	std::vector<float>().swap(compactNormals);
+	std::vector<unsigned short>().swap(indices16);
+	std::vector<unsigned int>().swap(indices32);
+	compactStorage = false;
+	topologyChanged();
+}
+
+int TriangleMesh::vertexCount() const
+{
+	return compactStorage ? compactVertices.size() / 3 : vertices.size();
+}
+
+int TriangleMesh::triangleCount() const
+{
+	return compactStorage ? (indices16.size() + indices32.size()) / 3 : triangles.size();
+}
+
+Vector3 TriangleMesh::position(int i) const
+{
+	if(compactStorage)
+		return Vector3(compactVertices[3*i], compactVertices[3*i+1], compactVertices[3*i+2]);
+	return vertices[i];
+}
+
+unsigned int TriangleMesh::corner(int t, int k) const
+{
+	if(!compactStorage)
+		return (&triangles[t].a)[k];
+	return indices16.empty() ? indices32[3*t+k] : indices16[3*t+k];
+}
+
+void TriangleMesh::setPositions(const std::vector<Vector3> & positions)
+{
+	if(!compactStorage)
+	{
+		vertices = positions;
+		return;
+	}
+	compactVertices.resize(3*positions.size());
+	for(int i=0; i<positions.size(); i++)
+		for(int d=0; d<3; d++)
+			compactVertices[3*i+d] = positions[i][d];
+}
+
+size_t TriangleMesh::bytes() const
+{
+	return vertices.size() * sizeof(Vertex) + normals.size() * sizeof(Normal)
+	     + triangles.size() * sizeof(Triangle)
+	     + (compactVertices.size() + compactNormals.size()) * sizeof(float)
+	     + indices16.size() * sizeof(unsigned short) + indices32.size() * sizeof(unsigned int);
 }
 
 //////////////////////////////////////////////////	
 // resize object to have unit length along the largest dimension
 //////////////////////////////////////////////////	
 
-void TriangleMesh::normalize(float newsize)
+template<class Real>
+static void normalizePositions(Real * p, int n, float newsize)
 {
   Vector3 min, max, len;
 
@@ -151,10 +269,9 @@ void TriangleMesh::normalize(float newsize)
     min[d] = 1e10;
     max[d] = -1e10;
   }
-  int n = vertices.size();
   for(int i=0; i<n; i++) {
     for (int d=0; d<3; d++) {
-      float val = vertices[i][d];
+      float val = p[3*i+d];
       if (val>max[d]) 
 	max[d] = val;
       if (val<min[d]) 
@@ -172,40 +289,412 @@ void TriangleMesh::normalize(float newsize)
   printf("maxlen=%f, sf=%f\n",maxlen,sf);
   for (int i=0; i<n; i++) {
     for (int d=0; d<3; d++) {
-      float val = (vertices[i][d] - min[d])*sf;
-      vertices[i][d] = val;
+      float val = (p[3*i+d] - min[d])*sf;
+      p[3*i+d] = val;
     }
   } 
 }
 
+void TriangleMesh::normalize(float newsize)
+{
+  if (compactStorage)
+    normalizePositions(flat(compactVertices), vertexCount(), newsize);
+  else
+    normalizePositions(flat(vertices), vertexCount(), newsize);
+}
+
 //////////////////////////////////////////////////	
-// Compute surface normals
+// Weld coincident vertices
 //////////////////////////////////////////////////	
 
-void TriangleMesh::computeNormals()
+int TriangleMesh::weld(double epsilon, std::vector<unsigned int> * oldToNew)
 {
 	int n = vertices.size();
-	//	std::vector<Vertex> normals(n);
-	normals.resize(n);
+	SpatialHashGrid grid;
+	grid.build(vertices, max(epsilon, SpatialHashGrid::suggestCellSize(vertices, 1)));
+
+	// each vertex goes to the first earlier kept vertex within epsilon
+	std::vector<unsigned int> remap(n);
+	std::vector<char> isKept(n, 0);
+	std::vector<unsigned int> near;
+	std::vector<Vertex> keptVertices;
+	std::vector<Normal> keptNormals;
+	bool withNormals = normals.size() == n;
 	for(int i=0; i<n; i++)
 	{
-		normals[i][0] = 0;
-		normals[i][1] = 0;
-		normals[i][2] = 0;
+		near.clear();
+		grid.query(vertices, vertices[i], epsilon, near);
+		int target = i;
+		for(int k=0; k<near.size(); k++)
+			if(near[k] < target && isKept[near[k]])
+				target = near[k];
+		if(target < i)
+		{
+			remap[i] = remap[target];
+			continue;
+		}
+		isKept[i] = 1;
+		remap[i] = keptVertices.size();
+		keptVertices.push_back(vertices[i]);
+		if(withNormals)
+			keptNormals.push_back(normals[i]);
+	}
+
+	std::vector<Triangle> keptTriangles;
+	keptTriangles.reserve(triangles.size());
+	for(int t=0; t<triangles.size(); t++)
+	{
+		Triangle tri = { remap[triangles[t].a], remap[triangles[t].b], remap[triangles[t].c] };
+		if(tri.a != tri.b && tri.b != tri.c && tri.c != tri.a)
+			keptTriangles.push_back(tri);
+	}
+
+	int removed = n - keptVertices.size();
+	vertices.swap(keptVertices);
+	if(withNormals)
+		normals.swap(keptNormals);
+	triangles.swap(keptTriangles);
+	topologyChanged();
+	if(oldToNew)
+		oldToNew->swap(remap);
+	return removed;
+}
+
+//////////////////////////////////////////////////	
+// Cotangent Laplacian and lumped vertex areas
+//////////////////////////////////////////////////	
+
+void TriangleMesh::cotangentLaplacian(SparseMatrix & L, std::vector<double> & areas) const
+{
+	int n = vertices.size();
+	std::vector<SparseMatrix::Triplet> triplets;
+	triplets.reserve(n + 6*triangles.size());
+	for(unsigned int i=0; i<n; i++)
+	{
+		SparseMatrix::Triplet t = { i, i, 0.0 };     // diagonal slot, filled below
+		triplets.push_back(t);
+	}
+	areas.assign(n, 0.0);
+
+	for(int t=0; t<triangles.size(); t++)
+	{
+		unsigned int corner[3] = { triangles[t].a, triangles[t].b, triangles[t].c };
+		double doubleArea = (vertices[corner[1]] - vertices[corner[0]]).cross(vertices[corner[2]] - vertices[corner[0]]).length();
+		if(doubleArea <= 0)
+			continue;
+		for(int c=0; c<3; c++)
+		{
+			areas[corner[c]] += doubleArea / 6;
+
+			// angle at corner c faces the edge (a, b)
+			unsigned int a = corner[(c+1)%3], b = corner[(c+2)%3];
+			Vector3 u = vertices[a] - vertices[corner[c]];
+			Vector3 v = vertices[b] - vertices[corner[c]];
+			double halfCot = 0.5 * u.dot(v) / doubleArea;   // |u x v| == doubleArea
+			SparseMatrix::Triplet ab = { a, b, halfCot }, ba = { b, a, halfCot };
+			triplets.push_back(ab);
+			triplets.push_back(ba);
+		}
+	}
+	L.setFromTriplets(n, triplets);
+
+	for(int i=0; i<n; i++)
+	{
+		unsigned int diagonal = 0;
+		double sum = 0;
+		for(unsigned int k=L.offsets[i]; k<L.offsets[i+1]; k++)
+			if(L.columns[k] == i)
+				diagonal = k;
+			else
+			{
+				L.values[k] = max(L.values[k], 0.0);
+				sum += L.values[k];
+			}
+		L.values[diagonal] = -sum;
+	}
+}
+
+//////////////////////////////////////////////////	
+// Vertex adjacency (CSR)
+//////////////////////////////////////////////////	
+
+void TriangleMesh::vertexAdjacency(std::vector<unsigned int> & offsets, std::vector<unsigned int> & neighbors) const
+{
+	int n = vertices.size();
+
+	// every triangle adds both directions of its 3 edges, duplicates removed below
+	std::vector<unsigned int> start(n+1, 0);
+	for(int t=0; t<triangles.size(); t++)
+	{
+		start[triangles[t].a+1] += 2;
+		start[triangles[t].b+1] += 2;
+		start[triangles[t].c+1] += 2;
+	}
+	for(int i=0; i<n; i++)
+		start[i+1] += start[i];
+	std::vector<unsigned int> all(start[n]);
+	std::vector<unsigned int> fill(start.begin(), start.end()-1);
+	for(int t=0; t<triangles.size(); t++)
+	{
+		unsigned int corner[3] = { triangles[t].a, triangles[t].b, triangles[t].c };
+		for(int c=0; c<3; c++)
+		{
+			all[fill[corner[c]]++] = corner[(c+1)%3];
+			all[fill[corner[c]]++] = corner[(c+2)%3];
+		}
+	}
+
+	offsets.assign(n+1, 0);
+	neighbors.clear();
+	neighbors.reserve(all.size()/2);
+	for(int i=0; i<n; i++)
+	{
+		std::sort(all.begin()+start[i], all.begin()+start[i+1]);
+		for(unsigned int k=start[i]; k<start[i+1]; k++)
+			if(k == start[i] || all[k] != all[k-1])
+				neighbors.push_back(all[k]);
+		offsets[i+1] = neighbors.size();
+	}
+}
+
+//////////////////////////////////////////////////	
+// Reorder vertices, remap triangles
+//////////////////////////////////////////////////	
+
+void TriangleMesh::permuteVertices(const std::vector<unsigned int> & newToOld)
+{
+	int n = vertices.size();
+	std::vector<unsigned int> oldToNew(n);
+	std::vector<Vertex> newVertices(n);
+	for(int i=0; i<n; i++)
+	{
+		oldToNew[newToOld[i]] = i;
+		newVertices[i] = vertices[newToOld[i]];
+	}
+	vertices.swap(newVertices);
+	if(normals.size() == n)
+	{
+		std::vector<Normal> newNormals(n);
+		for(int i=0; i<n; i++)
+			newNormals[i] = normals[newToOld[i]];
+		normals.swap(newNormals);
 	}
-	// Each incident face contributes
 	for(int i=0; i<triangles.size(); i++)
+	{
+		triangles[i].a = oldToNew[triangles[i].a];
+		triangles[i].b = oldToNew[triangles[i].b];
+		triangles[i].c = oldToNew[triangles[i].c];
+	}
+	topologyChanged();
+}
+
+//////////////////////////////////////////////////	
+// Vertex cache optimization
+//////////////////////////////////////////////////	
+
+enum { MAX_SCORED_CACHE = 64 };
+
+// Forsyth's vertex score: recently used vertices and vertices with few
+// triangles left (so they get finished) score high
+static float vertexCacheScore(int position, int remaining, int cacheSize)
+{
+	if(remaining == 0)
+		return -1;
+	float score = 0;
+	if(position >= 0)
+	{
+		if(position < 3)
+			score = 0.75f;    // the last triangle's vertices, in any order
+		else
+			score = pow(1 - (position - 3) / (float)(cacheSize - 3), 1.5f);
+	}
+	return score + 2 / sqrt((float)remaining);
+}
+
+void TriangleMesh::optimizeVertexCache(int cacheSize)
+{
+	int n = vertices.size();
+	int m = triangles.size();
+	cacheSize = max(4, min(cacheSize, (int)MAX_SCORED_CACHE));
+	if(m == 0)
+		return;
+
+	// triangles of each vertex; the first remaining[v] are not emitted yet
+	std::vector<unsigned int> offsets(n+1, 0);
+	for(int t=0; t<m; t++)
+	{
+		offsets[triangles[t].a+1]++;
+		offsets[triangles[t].b+1]++;
+		offsets[triangles[t].c+1]++;
+	}
+	for(int v=0; v<n; v++)
+		offsets[v+1] += offsets[v];
+	std::vector<unsigned int> vertexTriangles(offsets[n]);
+	std::vector<unsigned int> remaining(n, 0);
+	for(int t=0; t<m; t++)
+	{
+		const unsigned int * c = &triangles[t].a;
+		for(int i=0; i<3; i++)
+			vertexTriangles[offsets[c[i]] + remaining[c[i]]++] = t;
+	}
+
+	std::vector<int> position(n, -1);
+	std::vector<float> score(n);
+	for(int v=0; v<n; v++)
+		score[v] = vertexCacheScore(-1, remaining[v], cacheSize);
+	std::vector<float> triangleScore(m);
+	std::vector<char> emitted(m, 0);
+	int best = 0;
+	for(int t=0; t<m; t++)
+	{
+		const unsigned int * c = &triangles[t].a;
+		triangleScore[t] = score[c[0]] + score[c[1]] + score[c[2]];
+		if(triangleScore[t] > triangleScore[best])
+			best = t;
+	}
+
+	unsigned int cache[MAX_SCORED_CACHE + 3], newCache[MAX_SCORED_CACHE + 3];
+	int cached = 0;
+	int nextUnemitted = 0;
+	std::vector<Triangle> newTriangles;
+	newTriangles.reserve(m);
+	while(newTriangles.size() < m)
+	{
+		if(best < 0)
+		{
+			// dead end: nothing in the cache has triangles left
+			while(emitted[nextUnemitted])
+				nextUnemitted++;
+			best = nextUnemitted;
+		}
+		int t = best;
+		emitted[t] = 1;
+		newTriangles.push_back(triangles[t]);
+		const unsigned int * c = &triangles[t].a;
+
+		// retire t from its vertices and put them in front of the cache
+		int newCached = 0;
+		for(int i=0; i<3; i++)
+		{
+			unsigned int v = c[i];
+			unsigned int * list = &vertexTriangles[offsets[v]];
+			for(unsigned int k=0; k<remaining[v]; k++)
+				if(list[k] == t)
+				{
+					std::swap(list[k], list[remaining[v]-1]);
+					remaining[v]--;
+					break;
+				}
+			if(position[v] != -2)
+			{
+				position[v] = -2;    // placed
+				newCache[newCached++] = v;
+			}
+		}
+		for(int i=0; i<cached; i++)
+			if(position[cache[i]] != -2)
+				newCache[newCached++] = cache[i];
+
+		// rescore the cache (evicted vertices drop to their valence score)
+		for(int i=0; i<newCached; i++)
+		{
+			unsigned int v = newCache[i];
+			position[v] = i < cacheSize ? i : -1;
+			float delta = vertexCacheScore(position[v], remaining[v], cacheSize) - score[v];
+			score[v] += delta;
+			unsigned int * list = &vertexTriangles[offsets[v]];
+			for(unsigned int k=0; k<remaining[v]; k++)
+				triangleScore[list[k]] += delta;
+		}
+		cached = min(newCached, cacheSize);
+		std::copy(newCache, newCache + cached, cache);
+
+		// next: the best triangle touching the cache
+		best = -1;
+		for(int i=0; i<cached; i++)
+		{
+			unsigned int v = cache[i];
+			unsigned int * list = &vertexTriangles[offsets[v]];
+			for(unsigned int k=0; k<remaining[v]; k++)
+				if(best < 0 || triangleScore[list[k]] > triangleScore[best])
+					best = list[k];
+		}
+	}
+	triangles.swap(newTriangles);
+	topologyChanged();
+}
+
+void TriangleMesh::firstUseOrder(std::vector<unsigned int> & newToOld) const
+{
+	int n = vertices.size();
+	std::vector<char> used(n, 0);
+	newToOld.clear();
+	newToOld.reserve(n);
+	for(int t=0; t<triangles.size(); t++)
+	{
+		const unsigned int * c = &triangles[t].a;
+		for(int i=0; i<3; i++)
+			if(!used[c[i]])
+			{
+				used[c[i]] = 1;
+				newToOld.push_back(c[i]);
+			}
+	}
+	for(int v=0; v<n; v++)
+		if(!used[v])
+			newToOld.push_back(v);
+}
+
+double TriangleMesh::averageCacheMissRatio(int cacheSize) const
+{
+	if(triangles.empty())
+		return 0;
+	// a vertex is cached if fewer than cacheSize misses happened since its own
+	std::vector<int> missedAt(vertices.size(), -cacheSize - 1);
+	int misses = 0;
+	for(int t=0; t<triangles.size(); t++)
+	{
+		const unsigned int * c = &triangles[t].a;
+		for(int i=0; i<3; i++)
+			if(misses - missedAt[c[i]] > cacheSize)
+				missedAt[c[i]] = misses++;
+	}
+	return misses / (double)triangles.size();
+}
+
+//////////////////////////////////////////////////	
+// Compute surface normals
+//////////////////////////////////////////////////	
+
+// Normals from the triangles of ranges. With everyVertex, all n normals are
+// reset and normalized, otherwise only those of the corners of ranges.
+template<class Real, class Index>
+static void accumulateNormals(const Real * p, const Index * corners,
+                              const TriangleMesh::TriangleRange * ranges, int rangeCount,
+                              int n, bool everyVertex, Real * normals)
+{
+	if(everyVertex)
+		for(int i=0; i<3*n; i++)
+			normals[i] = 0;
+	else
+		for(int r=0; r<rangeCount; r++)
+			for(unsigned int k=3*ranges[r].begin; k<3*ranges[r].end; k++)
+				normals[3*corners[k]] = normals[3*corners[k]+1] = normals[3*corners[k]+2] = 0;
+	// Each incident face contributes
+	for(int r=0; r<rangeCount; r++)
+	for(unsigned int i=ranges[r].begin; i<ranges[r].end; i++)
 	{
 		// incident edges
-		Vertex a = vertices[triangles[i].a];
-		Vertex b = vertices[triangles[i].b];
-		Vertex c = vertices[triangles[i].c];
+		const Index * c = corners + 3*i;
+		const Real * a = p + 3*c[0];
+		const Real * b = p + 3*c[1];
+		const Real * d = p + 3*c[2];
 		double ux = b[0]-a[0];
 		double uy = b[1]-a[1];
 		double uz = b[2]-a[2];
-		double vx = c[0]-a[0];
-		double vy = c[1]-a[1];
-		double vz = c[2]-a[2];
+		double vx = d[0]-a[0];
+		double vy = d[1]-a[1];
+		double vz = d[2]-a[2];
 
 		// cross-product
 		double nx = - uy*vz + uz*vy;
@@ -220,82 +709,113 @@ void TriangleMesh::computeNormals()
 		}
 
 		// contribute to vertices' normal
-		normals[triangles[i].a][0] += nx;	normals[triangles[i].a][1] += ny;	normals[triangles[i].a][2] += nz;
-		normals[triangles[i].b][0] += nx;	normals[triangles[i].b][1] += ny;	normals[triangles[i].b][2] += nz;
-		normals[triangles[i].c][0] += nx;	normals[triangles[i].c][1] += ny;	normals[triangles[i].c][2] += nz;
+		for(int k=0; k<3; k++)
+		{
+			normals[3*c[k]] += nx;	normals[3*c[k]+1] += ny;	normals[3*c[k]+2] += nz;
+		}
 	}
-	// Normalize
-	for(int i=0; i<n; i++)
+	// Normalize (a vertex shared by several triangles of the ranges is
+	// visited again once unit length, which leaves it unchanged)
+	for(int r=0; r<(everyVertex ? 1 : rangeCount); r++)
+	for(unsigned int k=(everyVertex ? 0 : 3*ranges[r].begin); k<(everyVertex ? n : 3*ranges[r].end); k++)
 	{
-		Vertex v = normals[i];
+		Real * v = normals + 3*(everyVertex ? k : corners[k]);
 		double length = sqrt(v[0]*v[0]+v[1]*v[1]+v[2]*v[2]);
 		if(length>0)
 		{
-			normals[i][0] *= 1/length;
-			normals[i][1] *= 1/length;
-			normals[i][2] *= 1/length;
+			v[0] *= 1/length;
+			v[1] *= 1/length;
+			v[2] *= 1/length;
 		}
 	}
 }
 
+void TriangleMesh::computeNormals()
+{
+	TriangleRange all = { 0, (unsigned int)triangleCount() };
+	computeNormals(&all, 1, true);
+}
+
+void TriangleMesh::computeNormals(const TriangleRange * ranges, int rangeCount, bool everyVertex)
+{
+	int n = vertexCount();
+	if(!compactStorage)
+	{
+		normals.resize(n);
+		accumulateNormals(flat(vertices), flat(triangles), ranges, rangeCount, n, everyVertex, flat(normals));
+		return;
+	}
+	compactNormals.resize(3*n);
+	if(indices16.empty())
+		accumulateNormals(flat(compactVertices), flat(indices32), ranges, rangeCount, n, everyVertex, flat(compactNormals));
+	else
+		accumulateNormals(flat(compactVertices), flat(indices16), ranges, rangeCount, n, everyVertex, flat(compactNormals));
+}
+
 //////////////////////////////////////////////////	
 // Draw mesh using deprecated OpenGL functions.
 // To set a uniform color to the mesh, call glColor(...) beforehand
 //////////////////////////////////////////////////	
 
-void TriangleMesh::draw(MeshDrawStyle style)
+static void emitVertex(const double * v) { glVertex3dv(v); }
+static void emitVertex(const float * v) { glVertex3fv(v); }
+static void emitNormal(const double * n) { glNormal3dv(n); }
+static void emitNormal(const float * n) { glNormal3fv(n); }
+
+template<class Real, class Index>
+static void drawTriangles(TriangleMesh::MeshDrawStyle style, const Real * vertices, const Real * normals,
+                          const Index * corners, int triangleCount)
 {
 	// ---------- Send geometry to OpenGL ----------
 
 	switch(style) {
-	case SHADED:
-	  computeNormals();
+	case TriangleMesh::SHADED:
 	  glBegin(GL_TRIANGLES);
-	  for(int i=0; i<triangles.size(); i++)
+	  for(int i=0; i<triangleCount; i++)
 	    {
-	      glNormal3d(normals[triangles[i].a][0], normals[triangles[i].a][1], normals[triangles[i].a][2]);
-	      glVertex3d(vertices[triangles[i].a][0], vertices[triangles[i].a][1], vertices[triangles[i].a][2]);
-	      glNormal3d(normals[triangles[i].b][0], normals[triangles[i].b][1], normals[triangles[i].b][2]);
-	      glVertex3d(vertices[triangles[i].b][0], vertices[triangles[i].b][1], vertices[triangles[i].b][2]);
-	      glNormal3d(normals[triangles[i].c][0], normals[triangles[i].c][1], normals[triangles[i].c][2]);
-	      glVertex3d(vertices[triangles[i].c][0], vertices[triangles[i].c][1], vertices[triangles[i].c][2]);
+	      emitNormal(normals + 3*corners[3*i]);
+	      emitVertex(vertices + 3*corners[3*i]);
+	      emitNormal(normals + 3*corners[3*i+1]);
+	      emitVertex(vertices + 3*corners[3*i+1]);
+	      emitNormal(normals + 3*corners[3*i+2]);
+	      emitVertex(vertices + 3*corners[3*i+2]);
 	    }
 	  glEnd();
 	  break;
-	case SOLID:
+	case TriangleMesh::SOLID:
 	  glDisable(GL_LIGHTING);
 	  glColor3f(1.0, 1.0, 1.0);
 	  glPolygonOffset(1.0, 2);
 	  glEnable(GL_POLYGON_OFFSET_FILL);
 	  glBegin(GL_TRIANGLES);
-	  for(int i=0; i<triangles.size(); i++)
+	  for(int i=0; i<triangleCount; i++)
 	    {
-	      glVertex3d(vertices[triangles[i].a][0], vertices[triangles[i].a][1], vertices[triangles[i].a][2]);
-	      glVertex3d(vertices[triangles[i].b][0], vertices[triangles[i].b][1], vertices[triangles[i].b][2]);
-	      glVertex3d(vertices[triangles[i].c][0], vertices[triangles[i].c][1], vertices[triangles[i].c][2]);
+	      emitVertex(vertices + 3*corners[3*i]);
+	      emitVertex(vertices + 3*corners[3*i+1]);
+	      emitVertex(vertices + 3*corners[3*i+2]);
 	    }
 	  glEnd();
 	  glColor3f(0,0,0);
-	  for(int i=0; i<triangles.size(); i++)
+	  for(int i=0; i<triangleCount; i++)
 	    {
 	      glBegin(GL_LINE_LOOP);
-	      glVertex3d(vertices[triangles[i].a][0], vertices[triangles[i].a][1], vertices[triangles[i].a][2]);
-	      glVertex3d(vertices[triangles[i].b][0], vertices[triangles[i].b][1], vertices[triangles[i].b][2]);
-	      glVertex3d(vertices[triangles[i].c][0], vertices[triangles[i].c][1], vertices[triangles[i].c][2]);
+	      emitVertex(vertices + 3*corners[3*i]);
+	      emitVertex(vertices + 3*corners[3*i+1]);
+	      emitVertex(vertices + 3*corners[3*i+2]);
 	      glEnd();
 	    }
 	  glEnable(GL_LIGHTING);
 	  glPolygonOffset(0,0);
 	break;
-	case WIRE:
+	case TriangleMesh::WIRE:
 	  glDisable(GL_LIGHTING);
 	  glColor3f(1.0, 1.0, 1.0);
-	  for(int i=0; i<triangles.size(); i++)
+	  for(int i=0; i<triangleCount; i++)
 	    {
 	      glBegin(GL_LINE_LOOP);
-	      glVertex3d(vertices[triangles[i].a][0], vertices[triangles[i].a][1], vertices[triangles[i].a][2]);
-	      glVertex3d(vertices[triangles[i].b][0], vertices[triangles[i].b][1], vertices[triangles[i].b][2]);
-	      glVertex3d(vertices[triangles[i].c][0], vertices[triangles[i].c][1], vertices[triangles[i].c][2]);
+	      emitVertex(vertices + 3*corners[3*i]);
+	      emitVertex(vertices + 3*corners[3*i+1]);
+	      emitVertex(vertices + 3*corners[3*i+2]);
 	      glEnd();
 	    }
 	  glEnable(GL_LIGHTING);
@@ -305,3 +825,31 @@ void TriangleMesh::draw(MeshDrawStyle style)
 	}
 }
 
+void TriangleMesh::draw(MeshDrawStyle style)
+{
+	TriangleRange all = { 0, (unsigned int)triangleCount() };
+	drawRanges(style, &all, 1, true);
+}
+
+void TriangleMesh::draw(MeshDrawStyle style, const std::vector<TriangleRange> & ranges)
+{
+	if(!ranges.empty())
+		drawRanges(style, &ranges[0], ranges.size(), false);
+}
+
+void TriangleMesh::drawRanges(MeshDrawStyle style, const TriangleRange * ranges, int rangeCount, bool everyVertex)
+{
+	if(style == SHADED)
+		computeNormals(ranges, rangeCount, everyVertex);
+	for(int r=0; r<rangeCount; r++)
+	{
+		unsigned int begin = ranges[r].begin, count = ranges[r].end - ranges[r].begin;
+		if(!compactStorage)
+			drawTriangles(style, flat(vertices), flat(normals), flat(triangles) + 3*begin, count);
+		else if(indices16.empty())
+			drawTriangles(style, flat(compactVertices), flat(compactNormals), flat(indices32) + 3*begin, count);
+		else
+			drawTriangles(style, flat(compactVertices), flat(compactNormals), flat(indices16) + 3*begin, count);
+	}
+}
+
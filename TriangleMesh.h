@@ -11,6 +11,10 @@
   * The mesh is stored via the public members:
   *  - vertices: a 3D position for each vertex
   *  - triangles: three vertex indices for each triangle
+  *
+  * A mesh that is only deformed and drawn can be switched to compact
+  * storage (compact()): float positions and normals, and 16-bit indices
+  * when it has fewer than 65536 vertices, about half the memory.
   * 
   * It draws it using glBegin(), glVertex(), glNormal() and glEnd().
   * Normals are automatically computed when drawing.
@@ -25,6 +29,7 @@
 
 #include <vector>
 #include "GraphicsMath.h"
+#include "SparseMatrix.h"
 #include <iostream>
 #include <string>
 
@@ -42,11 +47,85 @@ public:
 	std::vector<Normal> normals;
 	std::vector<Triangle> triangles;
 
+	// Incremented whenever triangles change (see MeshConnectivity). Code
+	// editing triangles directly must call topologyChanged().
+	unsigned int topologyRevision;
+	void topologyChanged() { topologyRevision++; }
+
 	void computeNormals();
 	void normalize(float newsize);
 
+	// Reorder vertices (and normals, if computed): new vertex i is old
+	// vertex newToOld[i]. Triangles are remapped accordingly.
+	void permuteVertices(const std::vector<unsigned int> & newToOld);
+
+	// Reorder triangles for the post-transform vertex cache (Forsyth,
+	// "Linear-Speed Vertex Cache Optimisation", scored against an LRU cache
+	// of cacheSize entries). Vertices are left in place; see firstUseOrder().
+	void optimizeVertexCache(int cacheSize = 32);
+
+	// Vertex order by first use in the triangle list, unreferenced vertices
+	// last (for permuteVertices: new vertex i is old vertex newToOld[i])
+	void firstUseOrder(std::vector<unsigned int> & newToOld) const;
+
+	// Average cache miss ratio: vertices transformed per triangle with a
+	// FIFO cache of cacheSize entries (0.5 is ideal for a large closed
+	// mesh, 3 means no reuse at all)
+	double averageCacheMissRatio(int cacheSize = 16) const;
+
+	// Merge vertices closer than epsilon (into the first of them, so
+	// merges never chain further than epsilon), in expected linear time
+	// with a spatial hash grid. Triangles are remapped and those left with
+	// a repeated corner removed; normals, if computed, follow the kept
+	// vertices. oldToNew (optional) receives the vertex mapping.
+	// Returns the number of vertices removed.
+	int weld(double epsilon, std::vector<unsigned int> * oldToNew = 0);
+
+	// Cotangent Laplacian: L(i,j) = (cot a + cot b)/2 over the angles facing
+	// edge ij (clamped to >= 0), L(i,i) = -sum of row i. areas receives the
+	// lumped area of each vertex (a third of its triangles' areas).
+	void cotangentLaplacian(SparseMatrix & L, std::vector<double> & areas) const;
+
+	// Vertex adjacency in compressed rows: the neighbors of vertex i (sharing
+	// an edge, sorted, no duplicates) are neighbors[offsets[i] .. offsets[i+1])
+	void vertexAdjacency(std::vector<unsigned int> & offsets, std::vector<unsigned int> & neighbors) const;
+
+	// Compact storage (see compact()): 3 floats per vertex, and either
+	// indices16 or indices32 (3 per triangle)
+	std::vector<float> compactVertices;
+	std::vector<float> compactNormals;
+	std::vector<unsigned short> indices16;
+	std::vector<unsigned int> indices32;
+
+	// Move vertices, normals and triangles to compact storage (they are
+	// released). computeNormals(), normalize(), draw(), print() and the
+	// accessors below work with either storage; the other operations
+	// (weld, permuteVertices, ...) need expand() first.
+	void compact();
+	void expand();
+	bool isCompact() const { return compactStorage; }
+
+	int vertexCount() const;
+	int triangleCount() const;
+	Vector3 position(int i) const;
+	unsigned int corner(int t, int k) const;     // k-th vertex of triangle t
+
+	// Replace all positions (vertexCount() of them), converted to floats
+	// when compact
+	void setPositions(const std::vector<Vector3> & positions);
+
+	// Bytes used by positions, normals and indices
+	size_t bytes() const;
+
 	enum MeshDrawStyle { WIRE, SOLID, SHADED };
 	void draw(MeshDrawStyle style = SHADED);     // draws triangle mesh
+
+	// Triangles [begin, end), e.g. a cluster (see Meshlets)
+	struct TriangleRange { unsigned int begin, end; };
+
+	// Draw only the given ranges. With SHADED, normals are only computed
+	// for their vertices and from their triangles.
+	void draw(MeshDrawStyle style, const std::vector<TriangleRange> & ranges);
 	void print();    // print triangle mesh
 
 	// Creates an empty triangle mesh
@@ -59,6 +138,12 @@ public:
 	// Ignore all lines but v and f lines.
 	// Convert n-gons to triangles.
 	void readFromOBJ(const char * filename);
+
+private:
+	bool compactStorage;
+
+	void computeNormals(const TriangleRange * ranges, int rangeCount, bool everyVertex);
+	void drawRanges(MeshDrawStyle style, const TriangleRange * ranges, int rangeCount, bool everyVertex);
 };
 
 // Cycle through TriangleMesh::DrawStyle
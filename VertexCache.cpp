@@ -0,0 +1,296 @@
+/**
+  * Vertex cache writer and memory-mapped player.
+  *
+  */
+
+#include "VertexCache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <cfloat>
+#include <climits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char MAGIC[4] = { 'L', 'B', 'V', 'C' };
+static const unsigned int VERSION = 1;
+
+// Prediction of coordinate i of frame number k in its keyframe group
+// (k == 0: keyframe), from the frame itself (keyframes) or the two before
+static inline long long predict(unsigned int k, size_t i, const int * frame,
+                                const int * previous, const int * older)
+{
+	if(k == 0)
+		return i >= 3 ? frame[i-3] : 0;
+	if(k == 1)
+		return previous[i];
+	return 2LL * previous[i] - older[i];
+}
+
+static inline void putVarint(std::vector<unsigned char> & out, long long value)
+{
+	unsigned long long z = (unsigned long long)value << 1 ^ (unsigned long long)(value >> 63);   // zigzag
+	while(z >= 0x80)
+	{
+		out.push_back((unsigned char)(z | 0x80));
+		z >>= 7;
+	}
+	out.push_back((unsigned char)z);
+}
+
+static inline bool getVarint(const unsigned char *& p, const unsigned char * end, long long & value)
+{
+	unsigned long long z = 0;
+	for(int shift = 0; shift < 64; shift += 7)
+	{
+		if(p == end)
+			return false;
+		unsigned char b = *p++;
+		z |= (unsigned long long)(b & 0x7F) << shift;
+		if(!(b & 0x80))
+		{
+			value = (long long)(z >> 1) ^ -(long long)(z & 1);
+			return true;
+		}
+	}
+	return false;
+}
+
+//////////////////////////////////////////////////
+// Writer
+//////////////////////////////////////////////////
+
+VertexCacheWriter::VertexCacheWriter() :
+    file(0),
+    clampedCount(0),
+    writeFailed(false)
+{
+}
+
+VertexCacheWriter::~VertexCacheWriter()
+{
+	close();
+}
+
+bool VertexCacheWriter::open(const char * filename, int vertexCount, const VertexCacheOptions & options)
+{
+	close();
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MAGIC, 4);
+	header.version = VERSION;
+	header.vertexCount = vertexCount;
+	header.keyframeInterval = options.keyframeInterval > 0 ? options.keyframeInterval : 1;
+	header.framesPerSecond = options.framesPerSecond;
+	header.precision = options.precision;
+	if(vertexCount <= 0 || !(options.precision > 0))
+	{
+		printf("VertexCacheWriter: no vertices or no precision\n");
+		return false;
+	}
+	file = fopen(filename, "wb");
+	if(!file)
+	{
+		printf("VertexCacheWriter: unable to create %s\n", filename);
+		return false;
+	}
+	writeFailed = fwrite(&header, sizeof(header), 1, file) != 1;    // rewritten by close()
+	offsets.assign(1, sizeof(header));
+	previous.assign(3 * vertexCount, 0);
+	older.assign(3 * vertexCount, 0);
+	clampedCount = 0;
+	return !writeFailed;
+}
+
+bool VertexCacheWriter::writeFrame(const float * positions)
+{
+	if(!file)
+		return false;
+	size_t n = 3 * header.vertexCount;
+	if(frameCount() == 0)
+		for(int c=0; c<3; c++)
+		{
+			header.origin[c] = FLT_MAX;
+			for(size_t i=c; i<n; i+=3)
+				header.origin[c] = std::min(header.origin[c], positions[i]);
+		}
+
+	// quantize into older (frame t-2 is no longer needed once predicted)
+	unsigned int k = frameCount() % header.keyframeInterval;
+	buffer.clear();
+	for(size_t i=0; i<n; i++)
+	{
+		double q = floor((positions[i] - header.origin[i % 3]) / header.precision + 0.5);
+		if(!(q >= INT_MIN && q <= INT_MAX))
+		{
+			q = q > 0 ? INT_MAX : INT_MIN;       // also NaN
+			clampedCount++;
+		}
+		long long prediction = predict(k, i, &older[0], &previous[0], &older[0]);
+		older[i] = q;
+		putVarint(buffer, older[i] - prediction);
+	}
+	previous.swap(older);
+	writeFailed = writeFailed || fwrite(&buffer[0], 1, buffer.size(), file) != buffer.size();
+	offsets.push_back(offsets.back() + buffer.size());
+	return !writeFailed;
+}
+
+bool VertexCacheWriter::writeFrame(const std::vector<Vector3> & positions)
+{
+	if(positions.size() != header.vertexCount)
+		return false;
+	scratch.resize(3 * positions.size());
+	for(size_t i=0; i<positions.size(); i++)
+		for(int c=0; c<3; c++)
+			scratch[3*i + c] = positions[i][c];
+	return writeFrame(&scratch[0]);
+}
+
+bool VertexCacheWriter::close()
+{
+	if(!file)
+		return false;
+	header.frameCount = frameCount();
+	header.indexOffset = (offsets.back() + 7) / 8 * 8;         // aligned for the player
+	static const char padding[8] = { 0 };
+	writeFailed = writeFailed || fwrite(padding, 1, header.indexOffset - offsets.back(), file) != header.indexOffset - offsets.back();
+	writeFailed = writeFailed || fwrite(&offsets[0], sizeof(offsets[0]), offsets.size(), file) != offsets.size();
+	writeFailed = writeFailed || fseek(file, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, file) != 1;
+	writeFailed = fclose(file) != 0 || writeFailed;
+	file = 0;
+	if(writeFailed)
+		printf("VertexCacheWriter: write error\n");
+	return !writeFailed;
+}
+
+//////////////////////////////////////////////////
+// Player
+//////////////////////////////////////////////////
+
+VertexCachePlayer::VertexCachePlayer() :
+    header(0),
+    index(0),
+    size(0),
+    decoded(-1),
+    decodeCount(0)
+{
+}
+
+VertexCachePlayer::~VertexCachePlayer()
+{
+	close();
+}
+
+bool VertexCachePlayer::open(const char * filename)
+{
+	close();
+	int fd = ::open(filename, O_RDONLY);
+	if(fd < 0)
+	{
+		printf("VertexCachePlayer: unable to open %s\n", filename);
+		return false;
+	}
+	struct stat info;
+	void * p = MAP_FAILED;
+	if(fstat(fd, &info) == 0 && info.st_size >= sizeof(VertexCacheHeader))
+		p = mmap(0, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if(p == MAP_FAILED)
+	{
+		printf("VertexCachePlayer: unable to map %s\n", filename);
+		return false;
+	}
+	header = (const VertexCacheHeader *)p;
+	size = info.st_size;
+
+	// the index table must fit, and the frames must follow one another and
+	// hold at least one byte per coordinate (bounds the vertex count)
+	bool valid = memcmp(header->magic, MAGIC, 4) == 0 && header->version == VERSION &&
+	             header->keyframeInterval > 0 && header->indexOffset % 8 == 0 &&
+	             header->indexOffset <= size && (size - header->indexOffset) / 8 >= header->frameCount + 1ull;
+	index = (const unsigned long long *)((const char *)p + (valid ? header->indexOffset : 0));
+	for(unsigned int f=0; f<header->frameCount && valid; f++)
+		valid = index[f] >= sizeof(VertexCacheHeader) && index[f] <= index[f+1] && index[f+1] <= header->indexOffset &&
+		        3ull * header->vertexCount <= index[f+1] - index[f];
+	if(!valid)
+	{
+		printf("VertexCachePlayer: %s is not a valid vertex cache\n", filename);
+		close();
+		return false;
+	}
+	size_t coordinates = header->frameCount > 0 ? 3 * (size_t)header->vertexCount : 0;   // nothing to decode otherwise
+	current.assign(coordinates, 0);
+	previous.assign(coordinates, 0);
+	decoded = -1;
+	decodeCount = 0;
+	return true;
+}
+
+void VertexCachePlayer::close()
+{
+	if(header)
+		munmap((void *)header, size);
+	header = 0;
+	index = 0;
+	size = 0;
+	decoded = -1;
+}
+
+// Decode frame into current; decoded must be frame-1 unless frame is a keyframe
+bool VertexCachePlayer::decode(int frame)
+{
+	const unsigned char * p = (const unsigned char *)header + index[frame];
+	const unsigned char * end = (const unsigned char *)header + index[frame+1];
+	unsigned int k = frame % header->keyframeInterval;
+	size_t n = current.size();
+
+	// the new frame replaces frame-2, as in the writer
+	previous.swap(current);
+	for(size_t i=0; i<n; i++)
+	{
+		long long residual;
+		if(!getVarint(p, end, residual))
+		{
+			decoded = -1;
+			return false;
+		}
+		current[i] = residual + predict(k, i, &current[0], &previous[0], &current[0]);
+	}
+	decoded = frame;
+	decodeCount++;
+	return true;
+}
+
+bool VertexCachePlayer::readFrame(int frame, float * positions)
+{
+	if(!header || frame < 0 || frame >= header->frameCount)
+		return false;
+	int key = frame - frame % header->keyframeInterval;
+	if(decoded != frame)
+	{
+		int start = decoded >= key && decoded < frame ? decoded + 1 : key;
+		for(int f=start; f<=frame; f++)
+			if(!decode(f))
+			{
+				printf("VertexCachePlayer: frame %d is corrupt\n", f);
+				return false;
+			}
+	}
+	for(size_t i=0; i<current.size(); i++)
+		positions[i] = header->origin[i % 3] + current[i] * (double)header->precision;
+	return true;
+}
+
+bool VertexCachePlayer::readFrame(int frame, std::vector<Vector3> & positions)
+{
+	scratch.resize(current.size());
+	if(scratch.empty() || !readFrame(frame, &scratch[0]))
+		return false;
+	positions.resize(scratch.size() / 3);
+	for(size_t i=0; i<positions.size(); i++)
+		positions[i] = Vector3(scratch[3*i], scratch[3*i+1], scratch[3*i+2]);
+	return true;
+}
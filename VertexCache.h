@@ -0,0 +1,118 @@
+/**
+  * Baked deformation: a vertex cache file of per-frame positions, written
+  * frame by frame from the skinning loop and played back without skinning.
+  *
+  * Positions are quantized on a uniform grid (step: precision, origin:
+  * the minimum of the first frame), so the error is precision/2 at most
+  * per coordinate (plus float rounding), and the rest is lossless:
+  *  - every keyframeInterval frames, a keyframe stores each coordinate
+  *    minus the same coordinate of the previous vertex;
+  *  - the next frame stores the difference with the previous frame;
+  *  - the others the difference with the linear prediction from the two
+  *    previous frames (2 q[t-1] - q[t-2]), small for smooth motion.
+  * Residuals are zigzag varints (1 byte for |r| < 64).
+  *
+  * File: VertexCacheHeader, the frames, then the frame index table
+  * (frameCount+1 64-bit offsets, the last one is the end of the frames;
+  * the table starts at a multiple of 8).
+  * The writer holds two frames of integers and the table; the player maps
+  * the file and decodes from the nearest keyframe at or before the frame
+  * asked for, so a random access costs at most keyframeInterval frames
+  * and sequential playback one frame.
+  */
+
+#ifndef VERTEX_CACHE_H
+#define VERTEX_CACHE_H
+
+#include <cstdio>
+#include <cstddef>
+#include <vector>
+#include "GraphicsMath.h"
+
+struct VertexCacheHeader
+{
+	char magic[4];                       // "LBVC"
+	unsigned int version;
+	unsigned int vertexCount, frameCount;
+	unsigned int keyframeInterval;
+	float framesPerSecond;
+	float precision;                     // quantization step
+	float origin[3];
+	unsigned long long indexOffset;      // frame index table
+};
+
+struct VertexCacheOptions
+{
+	float precision;
+	unsigned int keyframeInterval;
+	float framesPerSecond;
+
+	VertexCacheOptions() : precision(1e-4f), keyframeInterval(30), framesPerSecond(30) {}
+};
+
+class VertexCacheWriter
+{
+public:
+	VertexCacheWriter();
+	~VertexCacheWriter();
+
+	bool open(const char * filename, int vertexCount, const VertexCacheOptions & options = VertexCacheOptions());
+	bool writeFrame(const float * positions);                // 3 per vertex
+	bool writeFrame(const std::vector<Vector3> & positions);
+	// Write the index table and the header; false on a write error
+	bool close();
+
+	int frameCount() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+	unsigned long long bytes() const { return offsets.empty() ? 0 : offsets.back(); }
+	int clamped() const { return clampedCount; }       // coordinates outside the grid
+
+private:
+	VertexCacheWriter(const VertexCacheWriter &);
+	VertexCacheWriter & operator=(const VertexCacheWriter &);
+
+	FILE * file;
+	VertexCacheHeader header;
+	std::vector<unsigned long long> offsets;
+	std::vector<int> previous, older;    // quantized frames t-1 and t-2
+	std::vector<unsigned char> buffer;
+	std::vector<float> scratch;
+	int clampedCount;
+	bool writeFailed;
+};
+
+class VertexCachePlayer
+{
+public:
+	VertexCachePlayer();
+	~VertexCachePlayer();
+
+	bool open(const char * filename);
+	void close();
+	bool isOpen() const { return header != 0; }
+
+	int vertexCount() const { return header ? header->vertexCount : 0; }
+	int frameCount() const { return header ? header->frameCount : 0; }
+	float framesPerSecond() const { return header ? header->framesPerSecond : 0; }
+
+	// Positions of a frame (3 floats per vertex); false if out of range or corrupt
+	bool readFrame(int frame, float * positions);
+	bool readFrame(int frame, std::vector<Vector3> & positions);
+
+	int framesDecoded() const { return decodeCount; }  // since open(), for the cost of seeks
+
+private:
+	VertexCachePlayer(const VertexCachePlayer &);
+	VertexCachePlayer & operator=(const VertexCachePlayer &);
+
+	bool decode(int frame);
+
+	const VertexCacheHeader * header;
+	const unsigned long long * index;
+	size_t size;
+	std::vector<int> current, previous;  // quantized frames decoded and decoded-1
+	std::vector<float> scratch;
+	int decoded;                         // frame in current, -1 if none
+	int decodeCount;
+};
+
+#endif // VERTEX_CACHE_H
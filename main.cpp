@@ -5,12 +5,22 @@
 
 #include "defs.h"
 #include "TriangleMesh.h"
+#include "FramePipeline.h"      // before MeshAnimation.h, whose clamp() macro breaks <algorithm>
 #include "MeshAnimation.h"
 #include <fstream>
 #include <iostream>
 #include <sstream>
 #include <cstdlib>
 #include "GLCamera.h"
+#include "MorphTargets.h"
+#include "GPUSkinning.h"
+#include "BoneHeat.h"
+#include "NearestBoneBinder.h"
+#include "MeshConnectivity.h"
+#include "MeshDecimation.h"
+#include "Meshlets.h"
+#include "StreamingImport.h"
+#include "VertexCache.h"
 
 #define Bone MeshAnimation::TBone
 
@@ -45,13 +55,60 @@ int animation_id = 0;	// first animation clip
 TriangleMesh mesh;
 TriangleMesh meshOriginal;
 MeshAnimation animation;
+bool weldOnLoad = false;                // merge vertices closer than weldEpsilon when loading
+double weldEpsilon = 1e-5;
+bool compactMesh = false;               // float positions, 16-bit indices for the drawn mesh
+std::vector<Vector3> skinnedVertices;   // skinning output copied into a compact mesh
+bool optimizeOnLoad = true;             // reorder triangles for the vertex cache, vertices by first use
+std::vector<unsigned int> weldMap;      // OBJ vertex -> loaded vertex (empty if unchanged)
+string glbFile;                         // mesh, skeleton and weights from one .glb instead
+string ogreMeshFile;                    // or mesh and weights from an Ogre binary .mesh
+InfluenceTable authoredInfluences;      // weights read from either, used by modes 1 to 4
+bool streamedImport = false;            // load through streamOBJ() and a mapped mesh file (welds on the fly)
+string streamedMeshFile;                // where that file goes; empty: lbskinning.lbsm in $TMPDIR or /tmp
 string skeletonOldFile;
 string skeletonNewFile;
 int currentSkeletonId = 0;
 //string skeletonFiles[] = {"skeletons/old_org_mapped.skeleton.xml", "skeletons/org_mapped.skeleton.xml"};
 
-// weights contain the weights of all the bones per mesh vertex
-std::vector<std::vector<float> > weights;
+// influences contain the non-zero bone weights per mesh vertex
+InfluenceTable influences;
+SkinningPalette palette;
+bool quantizedInput = false;            // skin from the 16/8-bit stream below
+QuantizedSkinStream quantizedStream;
+SkinBatches skinBatches;                // vertices grouped by influence count
+NearestBoneBinder nearestBoneBinder;    // closest-bone weights, updated per changed bone
+int weightSmoothing = 0;                // Jacobi sweeps of weight diffusion after binding
+int maxInfluencesPerVertex = 4;         // weight clean-up after binding (pruneInfluences)
+float minInfluenceWeight = 0.01;
+int weightBits = 0;                     // 0 (float), 8 or 16 bit quantized weights
+SkinBounds skinBounds;                  // per-bone bind pose boxes
+bool meshCulled = false;                // skinned mesh outside the view: not skinned nor drawn
+bool clusterCulling = false;            // draw only the meshlets in view and facing the camera
+Meshlets meshlets;
+std::vector<TriangleMesh::TriangleRange> visibleClusters;
+
+// Baked deformation: the skinned clip written to a vertex cache, played back without skinning
+const char *vertexCacheFile = "meshes/baked.lbvc";
+bool cachePlayback = false;
+VertexCachePlayer vertexCache;
+
+// Morph targets (OBJ files given after the skeletons), applied before skinning
+std::vector<string> morphTargetFiles;
+MorphTargets morphTargets;
+MorphTargets::Instance morphInstance;
+
+// Level of detail: 0 is the full mesh, level i has 1/2^i of its triangles
+int lodLevel = 0;
+
+// Mode 4: closest-2-bones weights, skinned in a vertex shader
+GPUSkinning gpuSkinning;
+
+// Pipelined mode: a worker skins frame N+1 while frame N is drawn
+bool pipelined = false;
+FramePipeline framePipeline;
+MeshAnimation pipelineAnimation;        // skeleton posed by the worker
+FramePipeline::Frame pipelineFrame;     // last frame handed to the main thread
 
 // Camera related:
 int mouseButtonPressed;
@@ -73,9 +130,27 @@ extern Vector3 convertToWorldCoordinateFromBoneCoordinate(Vector3 boneVector, Me
 extern Vector3 convertToBoneCoordinateFromWorldCoordinate(Vector3 worldVector, MeshAnimation::TBone &bone);
 extern void computeClosest1Bone();
 extern void computeClosest2Bones();
-extern float pivot(float distArr[], int indexArr[], int first, int last);
-extern void quickSort(float distArr[], int indexArr[], int first, int last);
+void computeBoneHeat();
+void bindNearestBones(int bonesPerVertex, double maxDistance);
+void sortVerticesByInfluence();
+void selectLOD();
+int dropUnknownBones(InfluenceTable &table, int boneCount);
+void optimizeMeshOrder(std::vector<unsigned int> & newToOld);
+bool meshInView();
+void skinFrame(const SkinningPalette &framePalette, MorphTargets::Instance &morph, double time, std::vector<Vector3> &out);
+const float * morphFrame(MorphTargets::Instance &morph, double time);
+void startPipeline();
+void uploadGPUSkinning();
+void checkGPUSkinning();
+void updatePipelinedScene();
+void getBoneSegments(std::vector<Vector3> &heads, std::vector<Vector3> &tails);
+void benchmarkSkinning();
 void changeSkeleton();
+bool hasExtension(const string &file, const char *extension);
+void loadSkeleton(const string &file);
+void bakeVertexCache();
+void toggleCachePlayback();
+bool updateCachedScene();
 
 ///////////////////////////////////////////////////////////////////
 // FUNC:  init()
@@ -104,6 +179,8 @@ void init(void)
 
 void initScene()
 {
+  framePipeline.stop();   // the worker reads the skeleton and weights rebuilt below
+
     camera.target = Point3d(0,2,0);      // camera setup
 	camera.camDistance = -10;
   currentTime = 0;     // reset time
@@ -117,6 +194,18 @@ void initScene()
     }
     meshOriginal.vertices = vertice;
 
+    // Morph targets are stored relative to the freshly loaded mesh
+    morphTargets.targets.clear();
+    for (int i = 0; i < morphTargetFiles.size(); i++)
+        morphTargets.addTargetFromOBJ(morphTargetFiles[i].c_str(), meshOriginal.vertices, 1e-6f, weldMap.empty() ? 0 : &weldMap);
+
+  if (mode >= 1 && authoredInfluences.vertexCount() == mesh.vertices.size()) {
+    influences = authoredInfluences;   // the file's weights replace the binding of modes 1 to 4
+    printf("weights: authored, from %s\n", mesh.name.c_str());
+    int dropped = dropUnknownBones(influences, animation.bones.size());
+    if (dropped > 0)
+      printf("weights: %d influences on bones the skeleton does not have, dropped\n", dropped);
+  } else
   switch(mode) {   // mode-specific initialization
   case 0:
     break;
@@ -127,10 +216,62 @@ void initScene()
     computeClosest2Bones();
     break;
   case 3:
+    computeBoneHeat();
     break;
   case 4:
+    computeClosest2Bones();
     break;
   }
+
+  if (influences.vertexCount() == mesh.vertices.size()) {
+    if (weightSmoothing > 0) {
+        int t0 = glutGet(GLUT_ELAPSED_TIME);
+        std::vector<unsigned int> adjacencyOffsets, adjacency;
+        mesh.vertexAdjacency(adjacencyOffsets, adjacency);
+        pruneInfluences(influences, InfluenceTable::MAX_BONES, 0);    // normalize only
+        smoothInfluences(influences, adjacencyOffsets, adjacency, weightSmoothing);
+        printf("weights: %d smoothing iterations, %d ms\n", weightSmoothing, glutGet(GLUT_ELAPSED_TIME) - t0);
+    }
+    if (lodLevel > 0)
+        selectLOD();
+    PruneStats stats;
+    pruneInfluences(influences, maxInfluencesPerVertex, minInfluenceWeight, weightBits, &stats);
+    printf("weights: %d -> %d influences (max %d -> %d per vertex), %d over the count, %d below %g, %d invalid vertices\n",
+           stats.influencesBefore, stats.influencesAfter, stats.maxBefore, stats.maxAfter,
+           stats.droppedByCount, stats.droppedByWeight, minInfluenceWeight, stats.invalidVertices);
+    printf("weights: %s, error per vertex (L1) max %g mean %g\n",
+           weightBits ? (weightBits == 8 ? "8 bit" : "16 bit") : "float", stats.maxWeightError, stats.meanWeightError);
+    sortVerticesByInfluence();
+  }
+  skinBounds.build(meshOriginal.vertices, influences, animation.bones.size());
+  meshCulled = false;
+
+  // normals are recomputed when drawing, so only positions and weights are streamed
+  if (quantizedInput)
+    quantizedStream.build(meshOriginal.vertices, std::vector<Vector3>(), influences);
+
+  if (pipelined && (mode >= 1 && mode <= 3))
+    startPipeline();
+
+  if (mode == 4)
+    uploadGPUSkinning();
+  else
+    gpuSkinning.release();
+
+  if (clusterCulling) {
+    // bone boxes wherever the CPU skins the mesh, mode 4 included when the GPU is unavailable
+    bool cpuSkinning = (mode >= 1 && mode <= 3) || (mode == 4 && !gpuSkinning.ready());
+    meshlets.build(mesh, cpuSkinning ? influences : InfluenceTable());
+    printf("meshlets: %d clusters, %.1f vertices and %.1f triangles on average, %d bone boxes\n",
+           (int)meshlets.clusters.size(), meshlets.averageVertices(), meshlets.averageTriangles(), (int)meshlets.bones.size());
+  }
+
+  if (compactMesh) {
+    size_t before = mesh.bytes();
+    mesh.compact();
+    printf("mesh storage: %d -> %d bytes (float positions, %d-bit indices)\n",
+           (int)before, (int)mesh.bytes(), mesh.indices16.empty() ? 32 : 16);
+  }
 }
 
 ///////////////////////////////////////////////////////////////////
@@ -140,7 +281,90 @@ void initScene()
 
 void loadScene()
 {
-    mesh.readFromOBJ("meshes/simplebear.obj");
+    const char * meshFile = "meshes/simplebear.obj";
+    weldMap.clear();
+    authoredInfluences.clear();
+    if (!glbFile.empty()) {
+        int t0 = glutGet(GLUT_ELAPSED_TIME);
+        if (!animation.LoadGLB(glbFile.c_str(), &mesh, &authoredInfluences)) {
+            cerr << "Unable to load " << glbFile << ", using the OBJ mesh and XML skeletons" << endl;
+            glbFile.clear();
+            mesh.readFromOBJ(meshFile);
+        } else {
+            mesh.name = glbFile;
+            printf("GLB: %d vertices, %d triangles, %d influences, %d ms\n", (int)mesh.vertices.size(),
+                   (int)mesh.triangles.size(), (int)authoredInfluences.weights.size(), glutGet(GLUT_ELAPSED_TIME) - t0);
+        }
+    } else if (!ogreMeshFile.empty()) {
+        string linkedSkeleton;
+        if (!readOgreMesh(ogreMeshFile.c_str(), mesh, &authoredInfluences, &linkedSkeleton)) {
+            cerr << "Unable to load " << ogreMeshFile << ", using the OBJ mesh" << endl;
+            ogreMeshFile.clear();
+            mesh.readFromOBJ(meshFile);
+        } else if (!linkedSkeleton.empty()) {
+            // the linked skeleton is looked up next to the mesh
+            string directory = ogreMeshFile.substr(0, ogreMeshFile.find_last_of('/') + 1);
+            skeletonOldFile = skeletonNewFile = directory + linkedSkeleton;
+        }
+    } else if (streamedImport) {
+        // bounded memory import; cell clustering stands in for the weld
+        string streamedFile = streamedMeshFile;
+        if (streamedFile.empty()) {
+            const char *tmp = getenv("TMPDIR");
+            streamedFile = string(tmp && *tmp ? tmp : "/tmp") + "/lbskinning.lbsm";
+        }
+        StreamingImportOptions options;
+        options.cellSize = weldOnLoad ? weldEpsilon : 0;
+        StreamingImportStats stats;
+        MappedMesh mapped;
+        if (!streamOBJ(meshFile, streamedFile.c_str(), options, &stats, &weldMap) || !mapped.open(streamedFile.c_str())) {
+            cerr << "Streamed import failed, loading " << meshFile << " in memory" << endl;
+            streamedImport = false;       // so the in-memory weld below applies
+            weldMap.clear();
+            mesh.readFromOBJ(meshFile);
+        } else {
+            printf("streamed import: %lld -> %lld vertices, %lld -> %lld triangles (%lld invalid), "
+                   "%d passes, %d KB buffer + %d KB cells, %.1f ms\n",
+                   stats.objVertices, stats.vertices, stats.objTriangles, stats.triangles, stats.invalidTriangles,
+                   stats.passes, (int)(stats.bufferBytes >> 10), (int)(stats.tableBytes >> 10), 1000 * stats.seconds);
+            mapped.toTriangleMesh(mesh);
+            mesh.name = meshFile;
+        }
+    } else {
+        mesh.readFromOBJ(meshFile);
+    }
+    if (weldOnLoad && !streamedImport) {
+        int removed = mesh.weld(weldEpsilon, &weldMap);
+        printf("weld: %d vertices merged, %d vertices and %d triangles left\n",
+               removed, (int)mesh.vertices.size(), (int)mesh.triangles.size());
+    }
+    if (optimizeOnLoad) {
+        std::vector<unsigned int> newToOld;
+        double before = mesh.averageCacheMissRatio();
+        int t0 = glutGet(GLUT_ELAPSED_TIME);
+        optimizeMeshOrder(newToOld);
+        printf("vertex cache: ACMR %.3f -> %.3f (FIFO 16), %d ms\n",
+               before, mesh.averageCacheMissRatio(), glutGet(GLUT_ELAPSED_TIME) - t0);
+        // morph targets are read in OBJ order: compose the weld with the reordering
+        std::vector<unsigned int> oldToNew(newToOld.size());
+        for (int i = 0; i < newToOld.size(); i++)
+            oldToNew[newToOld[i]] = i;
+        if (weldMap.empty())
+            weldMap.swap(oldToNew);
+        else
+            for (int i = 0; i < weldMap.size(); i++)
+                weldMap[i] = oldToNew[weldMap[i]];
+    }
+
+    // authored weights follow the weld and the reordering (first file vertex of each vertex)
+    if (!weldMap.empty() && authoredInfluences.vertexCount() == weldMap.size()) {
+        std::vector<unsigned int> newToOld(mesh.vertices.size());
+        for (int i = weldMap.size() - 1; i >= 0; i--)
+            newToOld[weldMap[i]] = i;
+        authoredInfluences.permute(newToOld);
+    }
+    if (!glbFile.empty())
+        return;     // skeleton and clips come from the same file
 	
 	// read in mesh skeleton - arg 1 is old skeleton, arg 2 is new skeleton
     if (currentSkeletonId == 0) {
@@ -149,7 +373,7 @@ void loadScene()
             cerr << "Unable open skeleton: " << skeletonOldFile << endl;
             return;
         }
-        animation.LoadSkeletonXML(skeletonOldFile.c_str());
+        loadSkeleton(skeletonOldFile);
    
     } else if (currentSkeletonId == 1) {
         ifstream myanimationfile(skeletonNewFile.c_str());
@@ -157,11 +381,32 @@ void loadScene()
             cerr << "Unable open skeleton: " << skeletonNewFile << endl;
             return;
         }
-        animation.LoadSkeletonXML(skeletonNewFile.c_str());
+        loadSkeleton(skeletonNewFile);
     }
 	
 }
 
+///////////////////////////////////////////////////////////////////
+// FUNC: hasExtension() / loadSkeleton()
+// DOES: read an Ogre skeleton, XML (.xml) or binary (anything else)
+///////////////////////////////////////////////////////////////////
+
+bool hasExtension(const string &file, const char *extension)
+{
+    size_t n = strlen(extension);
+    return file.size() > n && file.compare(file.size() - n, n, extension) == 0;
+}
+
+void loadSkeleton(const string &file)
+{
+    int t0 = glutGet(GLUT_ELAPSED_TIME);
+    if (hasExtension(file, ".xml"))
+        animation.LoadSkeletonXML(file.c_str());
+    else if (!animation.LoadSkeletonBinary(file.c_str()))
+        error_stop("unable to read binary skeleton %s", file.c_str());
+    printf("skeleton: %s, %d ms\n", file.c_str(), glutGet(GLUT_ELAPSED_TIME) - t0);
+}
+
 ///////////////////////////////////////////////////////////////////
 // FUNC: changeSkeleton
 // DOES: cycle through the skeleton files and change skeleton
@@ -202,41 +447,27 @@ Vector3 getBoneTail(int boneId)
 	}
 }
 
+///////////////////////////////////////////////////////////////////
+// FUNC: getBoneSegments()
+// DOES: compute head and tail of every bone once, in world coordinate
+///////////////////////////////////////////////////////////////////
+
+void getBoneSegments(std::vector<Vector3> &heads, std::vector<Vector3> &tails)
+{
+    heads.resize(animation.bones.size());
+    tails.resize(animation.bones.size());
+    for (int j = 0; j < animation.bones.size(); j++) {
+        heads[j] = getBoneHead(j);
+        tails[j] = getBoneTail(j);
+    }
+}
+
 ///////////////////////////////////////////////////////////////////
 // FUNC: computeClosest1Bone()
 // DOES: Assign weights to the closest bone
 ///////////////////////////////////////////////////////////////////
 void computeClosest1Bone() {
-    // For every vertex of a mesh, find the closest bone
-    weights.clear();
-    for (int i = 0; i < mesh.vertices.size(); i++) {
-        
-        Vector3 meshV = mesh.vertices.at(i);
-        double closestDist = 10;
-        int closestBoneIndex = -1;
-        for (int j = 0; j < animation.bones.size(); j++) {
-            
-            Vector3 boneHead = getBoneHead(j);
-            Vector3 boneTail = getBoneTail(j);
-            
-            float dist = closestDistance(boneHead, boneTail, meshV);
-            if (dist <= closestDist) {
-                closestDist = dist;
-                closestBoneIndex = j;
-            }
-            
-        }
-        std::vector<float> boneWeights;
-        
-        for (int k = 0; k < animation.bones.size(); k++) {
-            if (k == closestBoneIndex) {
-                boneWeights.push_back(1);
-            } else {
-                boneWeights.push_back(0);
-            }
-        }
-        weights.push_back(boneWeights);
-    }
+    bindNearestBones(1, 10);                // bones further than 10 units are ignored
 }
 
 ///////////////////////////////////////////////////////////////////
@@ -244,99 +475,140 @@ void computeClosest1Bone() {
 // DOES: Assign weights to the closest 2 bones using linear blending
 ///////////////////////////////////////////////////////////////////
 void computeClosest2Bones() {
-    // For every vertex of a mesh, find the closest bone
-    int numBones = animation.bones.size();
-    weights.clear();
-    for (int i = 0; i < mesh.vertices.size(); i++) {
-        
-        Vector3 meshV = mesh.vertices.at(i);
-        int boneIndexArray[numBones];
-        float distArray[numBones];
-        
-        for (int j = 0; j < numBones; j++) {
-            
-            Vector3 boneHead = getBoneHead(j);
-            Vector3 boneTail = getBoneTail(j);
-            
-            float dist = closestDistance(boneHead, boneTail, meshV);
-            boneIndexArray[j] = j;
-            distArray[j] = dist;
-        }
-        
-        // sort the distanceArray from smallest to largest
-        quickSort(distArray, boneIndexArray, 0, numBones - 1);
-        
-        std::vector<float> boneWeights;
-        
-        int closest1Bone = boneIndexArray[0];
-        int closest2Bone = boneIndexArray[1];
-        
-        float closest1Dist = distArray[0];
-        float closest2Dist = distArray[1];
-        
-        float weight1 = 1 / pow(closest1Dist, 2);
-        float weight2 = 1 / pow(closest2Dist, 2);
-        
-        float newWeight1 = weight1 / (weight1 + weight2);
-        float newWeight2 = weight2 / (weight1 + weight2);
-        
-//        cout << "New Weight 1 for Bone " << closest1Bone << " is " <<
-//        newWeight1 << endl;
-//        
-//        cout << "New Weight 2 for Bone " << closest2Bone << " is " <<
-//        newWeight2 << endl;
-        
-        for (int k = 0; k < numBones; k++) {
-            if (k == closest1Bone) {
-                boneWeights.push_back(newWeight1);
-            } else if (k == closest2Bone) {
-                boneWeights.push_back(newWeight2);
-            } else {
-                boneWeights.push_back(0);
+    // raw inverse square distances (infinite on a bone), normalized by pruneInfluences()
+    bindNearestBones(2, FLT_MAX);
+}
+
+///////////////////////////////////////////////////////////////////
+// FUNC: bindNearestBones()
+// DOES: bind every vertex to its nearest bones. When only the skeleton
+//			 changed since the last call, only the vertices the changed
+//			 bones can affect are recomputed (see NearestBoneBinder.h)
+///////////////////////////////////////////////////////////////////
+void bindNearestBones(int bonesPerVertex, double maxDistance) {
+    std::vector<Vector3> boneHeads, boneTails;
+    getBoneSegments(boneHeads, boneTails);
+    std::vector<string> boneNames(animation.bones.size());
+    for (int j = 0; j < animation.bones.size(); j++)
+        boneNames[j] = animation.GetBoneName(j);
+
+    NearestBoneBinder::Stats stats;
+    nearestBoneBinder.bind(mesh.vertices, boneNames, boneHeads, boneTails, bonesPerVertex, maxDistance, influences, &stats);
+    printf("binding: %s, %d of %d vertices recomputed (%d bones changed), %.2f ms\n",
+           stats.full ? "full" : "incremental", stats.recomputed, stats.vertices, stats.changedBones, stats.seconds * 1000);
+}
+
+///////////////////////////////////////////////////////////////////
+// FUNC: computeBoneHeat()
+// DOES: Assign weights by heat diffusion from the nearest bones over the
+//			 mesh surface (see BoneHeat.h)
+///////////////////////////////////////////////////////////////////
+void computeBoneHeat() {
+    std::vector<Vector3> boneHeads, boneTails;
+    getBoneSegments(boneHeads, boneTails);
+
+    BoneHeatStats stats;
+    computeBoneHeatWeights(mesh, boneHeads, boneTails, influences, 0, &stats);
+    printf("bone heat: %d vertices, %d bones, %d threads, %.2f s (%d CG iterations, at most %d per bone)\n",
+           stats.vertices, stats.bones, stats.threads, stats.seconds, stats.iterations, stats.maxIterations);
+}
+
+///////////////////////////////////////////////////////////////////
+// FUNC: dropUnknownBones()
+// DOES: removes the influences on bones >= boneCount (weights from a file
+//       whose skeleton has fewer bones); returns how many were removed
+///////////////////////////////////////////////////////////////////
+
+int dropUnknownBones(InfluenceTable &table, int boneCount)
+{
+    int dropped = 0;
+    for (int k = 0; k < table.bones.size(); k++)
+        dropped += table.bones[k] >= boneCount;
+    if (dropped == 0)
+        return 0;
+    InfluenceTable kept;
+    std::vector<InfluenceTable::BoneIndex> bones;
+    std::vector<float> weights;
+    for (int v = 0; v < table.vertexCount(); v++) {
+        bones.clear();
+        weights.clear();
+        for (unsigned int k = table.offsets[v]; k < table.offsets[v+1]; k++)
+            if (table.bones[k] < boneCount) {
+                bones.push_back(table.bones[k]);
+                weights.push_back(table.weights[k]);
             }
-        }
-        weights.push_back(boneWeights);
+        kept.addVertex(bones.data(), weights.data(), bones.size());
     }
+    table = kept;
+    return dropped;
 }
 
 ///////////////////////////////////////////////////////////////////
-// FUNC: quickSort() modified to take in two arrays
-// DOES: sorts the array
+// FUNC: selectLOD()
+// DOES: decimates the skinned mesh and keeps level lodLevel
 ///////////////////////////////////////////////////////////////////
 
-void quickSort(float distArr[], int indexArr[], int first, int last) {
-    int pivotElement;
-    
-    if(first < last) {
-        pivotElement = pivot(distArr, indexArr, first, last);
-        quickSort(distArr, indexArr, first, pivotElement-1);
-        quickSort(distArr, indexArr, pivotElement+1, last);
+void selectLOD()
+{
+    pruneInfluences(influences, InfluenceTable::MAX_BONES, 0);    // normalize only
+    int triangles = mesh.triangles.size();
+    std::vector<int> targets;
+    for (int i = 1; i <= 3; i++)
+        targets.push_back(triangles >> i);
+    std::vector<MeshLOD> lods;       // rebuilt from the current mesh and binding each time
+    DecimationStats stats;
+    buildLODChain(mesh, influences, targets, lods, 1, &stats);
+    for (int i = 0; i < lods.size(); i++)
+        printf("lod %d: %d triangles, %d vertices, max error %g\n", i+1,
+               (int)lods[i].mesh.triangles.size(), (int)lods[i].mesh.vertices.size(), lods[i].maxError);
+    printf("lod: %d collapses, %d rejected, %.1f ms\n", stats.collapses, stats.rejected, stats.seconds * 1000);
+
+    const MeshLOD & lod = lods[lodLevel - 1];
+    mesh.vertices = lod.mesh.vertices;
+    mesh.normals.clear();
+    mesh.triangles = lod.mesh.triangles;
+    mesh.topologyChanged();
+    meshOriginal.vertices = lod.mesh.vertices;
+    influences = lod.influences;
+    morphTargets.targets.clear();   // deltas are per vertex of the full mesh
+    if (optimizeOnLoad) {
+        std::vector<unsigned int> newToOld;
+        optimizeMeshOrder(newToOld);
+        meshOriginal.permuteVertices(newToOld);
+        influences.permute(newToOld);
     }
 }
 
-float pivot(float distArr[], int indexArr[], int first, int last) {
-    int  p = first;
-    float pivotElement = distArr[first];
-    
-    for(int i = first+1 ; i <= last ; i++) {
-        if(distArr[i] <= pivotElement) {
-            p++;
-            float tmp1 = distArr[i];
-            float tmp2 = indexArr[i];
-            distArr[i] = distArr[p];
-            indexArr[i] = indexArr[p];
-            distArr[p] = tmp1;
-            indexArr[p] = tmp2;
-        }
-    }
-    float tmp1 = distArr[p];
-    float tmp2 = indexArr[p];
-    distArr[p] = distArr[first];
-    indexArr[p] = indexArr[first];
-    distArr[first] = tmp1;
-    indexArr[first] = tmp2;
-    
-    return p;
+///////////////////////////////////////////////////////////////////
+// FUNC: optimizeMeshOrder()
+// DOES: reorders the triangles of mesh for the post-transform vertex
+//			 cache, then its vertices by first use (newToOld receives the
+//			 vertex order, for the other per-vertex arrays)
+///////////////////////////////////////////////////////////////////
+
+void optimizeMeshOrder(std::vector<unsigned int> & newToOld)
+{
+    mesh.optimizeVertexCache();
+    mesh.firstUseOrder(newToOld);
+    mesh.permuteVertices(newToOld);
+}
+
+///////////////////////////////////////////////////////////////////
+// FUNC: sortVerticesByInfluence()
+// DOES: reorder the mesh vertices by influence count and dominant bone,
+//			 so that skinning runs one branch-free kernel per group
+///////////////////////////////////////////////////////////////////
+
+void sortVerticesByInfluence()
+{
+    std::vector<unsigned int> newToOld;
+    SkinBatches::sortedOrder(influences, true, newToOld);
+    mesh.permuteVertices(newToOld);
+    meshOriginal.permuteVertices(newToOld);
+    influences.permute(newToOld);
+    morphTargets.permuteVertices(newToOld);
+    skinBatches.build(meshOriginal.vertices, influences, true);
+    morphTargets.initInstance(morphInstance, skinBatches.positions.data(), meshOriginal.vertices.size());
 }
 
 ///////////////////////////////////////////////////////////////////
@@ -396,28 +668,337 @@ float computeDistance(Vector3 p1, Vector3 p2) {
 
 ///////////////////////////////////////////////////////////////////
 // FUNC: computeDeformedMesh()
-// DOES: compute new location of all vertices based on the current skeleton
+// DOES: compute new location of all vertices based on the current palette
 //			 using linear blend skinning
 ///////////////////////////////////////////////////////////////////
 
 void computeDeformedMesh()
 {
 	// compute and update coords of mesh vertices based on bone positions
-    for (int i = 0; i < mesh.vertices.size(); i++) {
-        Vector3 meshV = meshOriginal.vertices.at(i);
-        
-        std::vector<float> boneWeights = weights.at(i);
-        Vector3 pDeformed;
-        for (int j = 0; j < boneWeights.size(); j++) {
-            float weight = boneWeights.at(j);
-            if (weight != 0) {
-                MeshAnimation::TBone b = animation.bones.at(j);
-                Vector3 meshInBone = convertToBoneCoordinateFromWorldCoordinate(meshV, b);
-                pDeformed = pDeformed + (weight * convertToWorldCoordinateFromBoneCoordinate(meshInBone, b));
-            }
-        }
-        mesh.vertices.at(i) = pDeformed;
-    }
+	if (!mesh.isCompact())
+		skinFrame(palette, morphInstance, currentTime, mesh.vertices);
+	else if (!quantizedInput && skinBatches.order.size() == mesh.vertexCount())
+		skinBatches.skin(palette, &mesh.compactVertices[0], morphFrame(morphInstance, currentTime));
+	else {
+		skinFrame(palette, morphInstance, currentTime, skinnedVertices);
+		mesh.setPositions(skinnedVertices);
+	}
+}
+
+///////////////////////////////////////////////////////////////////
+// FUNC: skinFrame()
+// DOES: apply the morph targets (weights animated over time) to the bind
+//			 pose, then skin with the given palette
+///////////////////////////////////////////////////////////////////
+
+void skinFrame(const SkinningPalette &framePalette, MorphTargets::Instance &morph, double time, std::vector<Vector3> &out)
+{
+	if (quantizedInput) {				// the quantized stream has no morph layer
+		skinQuantized(quantizedStream, framePalette, out, NULL);
+		return;
+	}
+	skinBatches.skin(framePalette, out, morphFrame(morph, time));
+}
+
+///////////////////////////////////////////////////////////////////
+// FUNC: morphFrame()
+// DOES: animate the morph weights and apply them to the bind pose;
+//			 returns the morphed positions (batch order), NULL without targets
+///////////////////////////////////////////////////////////////////
+
+const float * morphFrame(MorphTargets::Instance &morph, double time)
+{
+	if (morphTargets.targets.empty() || morph.positions.empty())
+		return NULL;
+	for (int t = 0; t < morph.weights.size(); t++) morph.weights[t] = 0.5 - 0.5 * cos(time * (t + 1));
+	morphTargets.apply(morph, skinBatches.positions.data());
+	return morph.positions.data();
+}
+
+///////////////////////////////////////////////////////////////////
+// FUNC: benchmarkSkinning()
+// DOES: time pose and skin of synthetic chain skeletons of growing size,
+//			 every vertex blending 4 bones, and print the cost per bone
+///////////////////////////////////////////////////////////////////
+
+void benchmarkSkinning()
+{
+	const int frames = 20;
+	std::vector<Vector3> out;
+	SkinningPalette chainPalette;
+	for (int numBones = 64; numBones <= 4096; numBones *= 4) {
+		MeshAnimation chain;
+		chain.animations.resize(1);
+		chain.animations[0].nameId = 0;
+		chain.animations[0].timeLength = 1;
+		chain.animations[0].frameCount = 2;
+		chain.animations[0].tracks.resize(numBones);
+		chain.bones.resize(numBones);
+		for (int j = 0; j < numBones; j++) {
+			Bone &b = chain.bones[j];
+			b.nameId = j;
+			b.rot[0] = 0.01; b.rot[1] = 0; b.rot[2] = 0; b.rot[3] = 1;
+			b.pos[0] = 0; b.pos[1] = 0.01; b.pos[2] = 0;
+			b.parent = j - 1;
+			if (j > 0) chain.bones[j-1].childs.push_back(j);
+			MeshAnimation::TKey key = { 0, { 0.1f, 1, 0, 0 }, { 0, 0, 0 } };
+			chain.animations[0].tracks[j].keys.assign(2, key);
+		}
+		chain.BuildEvalOrder();
+		chain.SetBindPose();
+
+		InfluenceTable chainInfluences;
+		for (int i = 0; i < meshOriginal.vertices.size(); i++) {
+			InfluenceTable::BoneIndex b[4];
+			float w[4] = { 0.4, 0.3, 0.2, 0.1 };
+			for (int k = 0; k < 4; k++) b[k] = (i + k * 17) % numBones;
+			chainInfluences.addVertex(b, w, 4);
+		}
+
+		int t0 = glutGet(GLUT_ELAPSED_TIME);
+		for (int f = 0; f < frames; f++) chain.SetPose(0, f * 0.05);
+		int t1 = glutGet(GLUT_ELAPSED_TIME);
+		for (int f = 0; f < frames; f++) {
+			chain.GetSkinningPalette(chainPalette);
+			skinVertices(chainInfluences, meshOriginal.vertices, chainPalette, out);
+		}
+		int t2 = glutGet(GLUT_ELAPSED_TIME);
+		printf("%5d bones: pose %.3f ms (%.3f us/bone), skin %d vertices %.3f ms\n",
+			numBones, (t1 - t0) / double(frames), 1000.0 * (t1 - t0) / (frames * numBones),
+			(int)out.size(), (t2 - t1) / double(frames));
+	}
+
+	// half-edge connectivity of the mesh, on one core and on all of them
+	TriangleMesh topology = mesh;
+	topology.expand();                // connectivity reads the 32-bit triangles
+	if (topology.triangles.size() > 0) {
+		const int builds = 10;
+		int threadCounts[2] = { 1, (int)std::thread::hardware_concurrency() };
+		for (int k = 0; k < (threadCounts[1] > 1 ? 2 : 1); k++) {
+			int threads = threadCounts[k];
+			MeshConnectivity connectivity;
+			int t0 = glutGet(GLUT_ELAPSED_TIME);
+			for (int i = 0; i < builds; i++) {
+				connectivity.invalidate();
+				connectivity.update(topology, threads);
+			}
+			int t1 = glutGet(GLUT_ELAPSED_TIME);
+			printf("connectivity, %d thread(s): %d triangles in %.3f ms, %.1f bytes/triangle, %d non-manifold half-edges\n",
+				threads, (int)topology.triangles.size(), (t1 - t0) / double(builds),
+				connectivity.bytes() / double(topology.triangles.size()), connectivity.nonManifoldEdges);
+		}
+	}
+
+	// crowd: one clip time per instance, sampled one by one or in a batch
+	if (animation.animations.size() > animation_id) {
+		const int instances = 1024;
+		std::vector<double> times(instances);
+		std::vector<MeshAnimation::TKey> poses;
+		for (int i = 0; i < instances; i++) times[i] = 0.0137 * i;
+		int t0 = glutGet(GLUT_ELAPSED_TIME);
+		for (int i = 0; i < instances; i++) animation.SetPose(animation_id, times[i]);
+		int t1 = glutGet(GLUT_ELAPSED_TIME);
+		animation.SamplePoses(animation_id, &times[0], instances, poses);
+		for (int i = 0; i < instances; i++) animation.SetLocalPose(&poses[i * animation.bones.size()]);
+		int t2 = glutGet(GLUT_ELAPSED_TIME);
+		printf("%d instances: SetPose %d ms, SamplePoses+SetLocalPose %d ms\n", instances, t1 - t0, t2 - t1);
+		animation.SetPose(animation_id, currentTime);
+	}
+}
+
+///////////////////////////////////////////////////////////////////
+// FUNC: startPipeline()
+// DOES: start the worker thread that poses and skins frames ahead of drawing.
+//			 It owns a copy of the skeleton; skinBatches and quantizedStream
+//			 are only read until the next initScene() stops it.
+///////////////////////////////////////////////////////////////////
+
+void startPipeline()
+{
+	pipelineAnimation = animation;
+	int clip = animation_id;
+	MorphTargets::Instance morph = morphInstance;		// the worker's own morph instance
+	framePipeline.start([clip, morph](FramePipeline::Frame &frame) mutable {
+		SkinningPalette framePalette;
+		pipelineAnimation.SetPose(clip, frame.time);
+		pipelineAnimation.GetSkinningPalette(framePalette);
+		skinFrame(framePalette, morph, frame.time, frame.vertices);
+		frame.bones.resize(pipelineAnimation.bones.size());
+		for (int i = 0; i < frame.bones.size(); i++) frame.bones[i] = pipelineAnimation.bones[i].matrix;
+	});
+	framePipeline.submit(currentTime);
+}
+
+///////////////////////////////////////////////////////////////////
+// FUNC: updatePipelinedScene()
+// DOES: take the frame computed while the previous one was drawn,
+//			 and start computing the next one
+///////////////////////////////////////////////////////////////////
+
+void updatePipelinedScene()
+{
+	if (framePipeline.retrieve(pipelineFrame)) {
+		if (mesh.isCompact())
+			mesh.setPositions(pipelineFrame.vertices);
+		else
+			mesh.vertices.swap(pipelineFrame.vertices);
+		for (int i = 0; i < pipelineFrame.bones.size(); i++) animation.bones[i].matrix = pipelineFrame.bones[i];
+		animation.GetSkinningPalette(palette);     // for the meshlet bounds
+		meshCulled = !meshInView();                // with the pose of the vertices just swapped in
+	}
+	framePipeline.submit(currentTime);
+}
+
+///////////////////////////////////////////////////////////////////
+// FUNC: uploadGPUSkinning()
+// DOES: upload the bind pose mesh and its weights for mode 4, then
+//			 compare the GPU skinning with the CPU one at the bind pose
+///////////////////////////////////////////////////////////////////
+
+void uploadGPUSkinning()
+{
+	TriangleMesh bindMesh;
+	bindMesh.vertices = meshOriginal.vertices;
+	bindMesh.triangles = mesh.triangles;
+	bindMesh.computeNormals();
+	if (!gpuSkinning.upload(bindMesh, influences, animation.bones.size())) {
+		cerr << "GPU skinning unavailable, skinning on the CPU" << endl;
+		return;
+	}
+	animation.SetPose(animation_id, currentTime);
+	animation.GetSkinningPalette(palette);
+	checkGPUSkinning();
+}
+
+///////////////////////////////////////////////////////////////////
+// FUNC: checkGPUSkinning()
+// DOES: read the vertex shader output back and compare it with the
+//			 CPU skinning of the current pose
+///////////////////////////////////////////////////////////////////
+
+void checkGPUSkinning()
+{
+	if (mode != 4 || !gpuSkinning.ready())
+		return;
+	std::vector<Vector3> gpu = meshOriginal.vertices, cpu;
+	if (!gpuSkinning.readback(palette, gpu)) {
+		cout << "GPU skinning readback needs OpenGL 3.0" << endl;
+		return;
+	}
+	skinVertices(influences, meshOriginal.vertices, palette, cpu);
+	double maxError = 0;
+	for (int i = 0; i < cpu.size(); i++)
+		for (int c = 0; c < 3; c++)
+			maxError = max(maxError, fabs(cpu[i][c] - gpu[i][c]));
+	printf("GPU skinning readback: %d vertices, max difference to CPU %g\n", (int)cpu.size(), maxError);
+}
+
+///////////////////////////////////////////////////////////////////
+// FUNC: meshInView()
+// DOES: bound the skinned mesh from the bone boxes and the current
+//			 palette (no vertex is touched), and test it against the view
+///////////////////////////////////////////////////////////////////
+
+bool meshInView()
+{
+	float boxMin[3], boxMax[3];
+	if (!skinBounds.compute(palette, boxMin, boxMax))
+		return true;
+	return camera.isBoxVisible(boxMin, boxMax);
+}
+
+///////////////////////////////////////////////////////////////////
+// FUNC: bakeVertexCache()
+// DOES: skin the whole clip at the cache frame rate and write every frame
+//			 to the vertex cache file (modes 1 to 3)
+///////////////////////////////////////////////////////////////////
+
+void bakeVertexCache()
+{
+	if (mode < 1 || mode > 3 || animation.animations.size() <= animation_id) {
+		printf("vertex cache: baking needs a clip and CPU skinning (modes 1 to 3)\n");
+		return;
+	}
+	vertexCache.close();					// the file is rewritten under the mapping
+	cachePlayback = false;
+
+	VertexCacheOptions options;
+	int frames = (int)ceil(animation.animations[animation_id].timeLength * options.framesPerSecond);
+	VertexCacheWriter writer;
+	if (!writer.open(vertexCacheFile, mesh.vertexCount(), options))
+		return;
+	float time = currentTime;
+	int t0 = glutGet(GLUT_ELAPSED_TIME);
+	for (int f = 0; f < frames; f++) {
+		currentTime = f / options.framesPerSecond;		// the morph weights follow the same time
+		animation.SetPose(animation_id, currentTime);
+		animation.GetSkinningPalette(palette);
+		computeDeformedMesh();
+		if (mesh.isCompact())
+			writer.writeFrame(&mesh.compactVertices[0]);
+		else
+			writer.writeFrame(mesh.vertices);
+	}
+	int t1 = glutGet(GLUT_ELAPSED_TIME);
+	currentTime = time;
+	if (!writer.close())
+		return;
+	double raw = 12.0 * frames * mesh.vertexCount();
+	printf("vertex cache: %d frames of %d vertices in %s, %llu bytes (%.1f%% of floats), %d clamped, %d ms\n",
+		writer.frameCount(), mesh.vertexCount(), vertexCacheFile, writer.bytes(),
+		100.0 * writer.bytes() / raw, writer.clamped(), t1 - t0);
+}
+
+///////////////////////////////////////////////////////////////////
+// FUNC: toggleCachePlayback()
+// DOES: map the vertex cache and play it instead of skinning, or stop
+///////////////////////////////////////////////////////////////////
+
+void toggleCachePlayback()
+{
+	cachePlayback = !cachePlayback;
+	if (cachePlayback && (mode < 1 || mode > 3)) {
+		printf("vertex cache: playback replaces CPU skinning (modes 1 to 3)\n");
+		cachePlayback = false;
+	} else if (cachePlayback) {
+		if (!vertexCache.open(vertexCacheFile) || vertexCache.frameCount() == 0 ||
+			vertexCache.vertexCount() != mesh.vertexCount()) {
+			printf("vertex cache: no baked frames for this mesh (bake with 'e')\n");
+			vertexCache.close();
+			cachePlayback = false;
+		} else
+			printf("vertex cache: playing %d frames at %g fps\n", vertexCache.frameCount(), vertexCache.framesPerSecond());
+	} else {
+		vertexCache.close();
+		printf("vertex cache: off\n");
+	}
+}
+
+///////////////////////////////////////////////////////////////////
+// FUNC: updateCachedScene()
+// DOES: decode the cached frame at the current time into the mesh;
+//			 false if no cache is playing
+///////////////////////////////////////////////////////////////////
+
+bool updateCachedScene()
+{
+	if (!cachePlayback || !vertexCache.isOpen())
+		return false;
+	if (vertexCache.vertexCount() != mesh.vertexCount() || mode < 1 || mode > 3) {	// mesh reloaded differently or mode changed
+		toggleCachePlayback();
+		return false;
+	}
+	int frame = int(currentTime * vertexCache.framesPerSecond()) % vertexCache.frameCount();
+	if (mesh.isCompact())
+		vertexCache.readFrame(frame, &mesh.compactVertices[0]);
+	else
+		vertexCache.readFrame(frame, mesh.vertices);
+	if (animation.animations.size() > animation_id) {
+		animation.SetPose(animation_id, frame / vertexCache.framesPerSecond());	// for the drawn skeleton
+		animation.GetSkinningPalette(palette);		// and the cluster bounds
+	}
+	meshCulled = false;
+	return true;
 }
 
 ///////////////////////////////////////////////////////////////////
@@ -427,20 +1008,37 @@ void computeDeformedMesh()
 
 void updateScene()
 {
+  if (updateCachedScene())
+    return;
   switch(mode) {
   case 0:					// no motion
     break;
   case 1:   
 		animation.SetPose(animation_id, currentTime);		// set skeleton pose
-        computeDeformedMesh();     							// now compute the deformed mesh
+        animation.GetSkinningPalette(palette);
+        meshCulled = !meshInView();
+        if (!meshCulled)
+            computeDeformedMesh();     						// now compute the deformed mesh
         break;
   case 2:
         animation.SetPose(animation_id, currentTime);		// set skeleton pose
-        computeDeformedMesh();     							// now compute the deformed mesh
+        animation.GetSkinningPalette(palette);
+        meshCulled = !meshInView();
+        if (!meshCulled)
+            computeDeformedMesh();     						// now compute the deformed mesh
         break;
     break;
   case 3:
+        animation.SetPose(animation_id, currentTime);		// set skeleton pose
+        animation.GetSkinningPalette(palette);
+        meshCulled = !meshInView();
+        if (!meshCulled)
+            computeDeformedMesh();     						// now compute the deformed mesh
+    break;
   case 4:
+        animation.SetPose(animation_id, currentTime);		// set skeleton pose
+        animation.GetSkinningPalette(palette);				// the mesh is skinned when drawn
+        meshCulled = !meshInView();
     break;
   }
 
@@ -467,7 +1065,17 @@ void drawScene()
 
   // Draw mesh
   glColor3f(0.7,0.5,0.1);   // brownish color
-  mesh.draw(meshDrawStyle);
+  if (meshCulled)
+    ;                          // off-screen: neither skinned nor drawn
+  else if (mode == 4 && gpuSkinning.ready())
+    gpuSkinning.draw(palette);
+  else if (clusterCulling) {
+    meshlets.refit(palette);     // bind pose bounds where no bone moves a cluster
+    meshlets.cull(camera, visibleClusters);
+    mesh.draw(meshDrawStyle, visibleClusters);
+  }
+  else
+    mesh.draw(meshDrawStyle);
 	
 	// Draw skeleton
 	//animation.DrawSkeleton();
@@ -501,6 +1109,13 @@ void displayCallback(void)
 		cameraCenter[2] + cameraR * std::sin(cameraTheta) * std::cos(cameraPhi)  	};
   gluLookAt(eye[0],eye[1],eye[2],cameraCenter[0],cameraCenter[1],cameraCenter[2],cameraUp[0],cameraUp[1], cameraUp[2]);
   camera.applyCameraTransformations();
+  camera.updateFrustum();   // culls the mesh in the next updateScene()
+  if (meshCulled && meshInView()) {
+    // the camera came back to the mesh since the last update (e.g. while paused)
+    meshCulled = false;
+    if (mode >= 1 && mode <= 3)
+      computeDeformedMesh();
+  }
     
   drawScene();        // draw scene
   glutSwapBuffers();  // swap buffers
@@ -540,6 +1155,77 @@ void keyCallback(unsigned char key, int x, int y)
 	case 's':
 		changeSkeleton();
 		break;
+  case 'b':
+    benchmarkSkinning();
+    break;
+  case 'o':
+    pipelined = !pipelined;
+    cout << "pipelined skinning: " << (pipelined ? "on" : "off") << "\n";
+    initScene();
+    updateScene();
+    break;
+  case 'g':
+    checkGPUSkinning();
+    break;
+  case 'v':
+    weldOnLoad = !weldOnLoad;
+    cout << "weld on load: " << (weldOnLoad ? "on" : "off") << "\n";
+    initScene();
+    updateScene();
+    break;
+  case 'l':
+    weightSmoothing = weightSmoothing == 0 ? 4 : (weightSmoothing < 64 ? 4 * weightSmoothing : 0);   // 0, 4, 16, 64
+    initScene();
+    updateScene();
+    break;
+  case 'w':
+    weightBits = weightBits == 0 ? 8 : (weightBits == 8 ? 16 : 0);   // cycle weight quantization
+    initScene();
+    updateScene();
+    break;
+  case 'f':
+    compactMesh = !compactMesh;
+    cout << "compact mesh storage: " << (compactMesh ? "on" : "off") << "\n";
+    initScene();
+    updateScene();
+    break;
+  case 'i':
+    streamedImport = !streamedImport;
+    cout << "streamed import: " << (streamedImport ? "on" : "off") << "\n";
+    initScene();
+    updateScene();
+    break;
+  case 'k':
+    clusterCulling = !clusterCulling;
+    cout << "meshlet culling: " << (clusterCulling ? "on" : "off") << "\n";
+    initScene();
+    updateScene();
+    break;
+  case 'c':
+    optimizeOnLoad = !optimizeOnLoad;
+    cout << "vertex cache optimization: " << (optimizeOnLoad ? "on" : "off") << "\n";
+    initScene();
+    updateScene();
+    break;
+  case 'd':
+    lodLevel = (lodLevel + 1) % 4;   // full mesh, then 1/2, 1/4 and 1/8 of the triangles
+    cout << "level of detail: " << lodLevel << "\n";
+    initScene();
+    updateScene();
+    break;
+  case 'e':
+    bakeVertexCache();
+    break;
+  case 'y':
+    toggleCachePlayback();
+    updateScene();
+    break;
+  case 'z':
+    quantizedInput = !quantizedInput;
+    cout << "quantized skinning input: " << (quantizedInput ? "on" : "off") << "\n";
+    initScene();
+    updateScene();
+    break;
   default:
     break;
   }
@@ -615,7 +1301,10 @@ void idleCallback()
   elapsedTime = newElapsedTime;
   currentTime += deltaTime;
   //if (currentTime>=maxTime)   currentTime = 0.0;
-  updateScene();         // update scene
+  if (framePipeline.running() && !cachePlayback)
+    updatePipelinedScene();  // swap in the frame skinned during the last draw
+  else
+    updateScene();         // update scene
   glutPostRedisplay();   // draw scene
 }
 
@@ -655,6 +1344,7 @@ void processMouseActiveMotion(int x, int y){
 	}
 	oldMouseX = x;
 	oldMouseY = y;
+	glutPostRedisplay();    // also redraw while paused
 }
 
 ///////////////////////////////////////////////////////////////////
@@ -664,10 +1354,19 @@ void processMouseActiveMotion(int x, int y){
 
 int main(int argc, char **argv)
 {
-    if (argc==3) {
+    int firstMorphTarget = 3;
+    if (argc>=2 && hasExtension(argv[1], ".glb")) {
+        glbFile = argv[1];               // go scene.glb [morph targets...]
+        firstMorphTarget = 2;
+    } else if (argc>=2 && hasExtension(argv[1], ".mesh")) {
+        ogreMeshFile = argv[1];          // go bear.mesh [morph targets...], with its linked skeleton
+        firstMorphTarget = 2;
+    } else if (argc>=3) {
         skeletonOldFile = argv[1];
         skeletonNewFile = argv[2];
     }
+    for (int i = firstMorphTarget; i < argc; i++)       // morph targets: OBJ files with the mesh topology
+        morphTargetFiles.push_back(argv[i]);
 
    glutInit(&argc, argv);
    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
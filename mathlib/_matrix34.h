@@ -0,0 +1,282 @@
+#ifndef _MATRIX34_H
+#define _MATRIX34_H
+//------------------------------------------------------------------------------
+/**
+    @class _matrix34
+    @ingroup Math
+
+    Affine 3x4 matrix: a 3x3 linear part and a translation, without the
+    constant [0,0,0,1] row of a _matrix44.
+
+    Stored as 3 rows of 4 floats, row i giving output component i:
+
+        out.x = m[0][0]*x + m[0][1]*y + m[0][2]*z + m[0][3]
+
+    which is also the 3 x vec4 layout of a shader skinning palette.
+    Products compose like _matrix44: (a*b) transforms by a first, then
+    by b, so _matrix34(a*b) == _matrix34(a)*_matrix34(b) for affine a, b.
+*/
+#include "_vector3.h"
+#include "_matrix44.h"
+
+//------------------------------------------------------------------------------
+class _matrix34
+{
+public:
+    /// constructor 1 (identity)
+    _matrix34();
+    /// constructor 2, from an affine _matrix44 (projective terms dropped)
+    _matrix34(const _matrix44& m1);
+    /// set to identity
+    void ident();
+    /// set linear part to rotation of angle (radians) about axis, as _matrix44::set()
+    void set(float angle, float ax, float ay, float az);
+    /// set absolute translation
+    void set_translation(const _vector3& t);
+    /// return translation
+    _vector3 get_translation() const;
+    /// full affine invert
+    void invert();
+    /// fast invert (if 3x3 is a rotation)
+    void invert_simpler();
+    /// transform point
+    void mult(const _vector3& src, _vector3& dst) const;
+    /// transform direction (no translation)
+    void mult_dir(const _vector3& src, _vector3& dst) const;
+    /// convert to _matrix44
+    _matrix44 get_matrix44() const;
+    /// write as column-major 4x4 OpenGL matrix
+    void get_gl(float* ogl_mat) const;
+
+    float m[3][4];
+};
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline
+_matrix34::_matrix34()
+{
+    ident();
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline
+_matrix34::_matrix34(const _matrix44& m1)
+{
+    for (int i=0; i<3; i++)
+    {
+        m[i][0] = m1.m[0][i];
+        m[i][1] = m1.m[1][i];
+        m[i][2] = m1.m[2][i];
+        m[i][3] = m1.m[3][i];
+    }
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline
+void
+_matrix34::ident()
+{
+    m[0][0] = 1.0f; m[0][1] = 0.0f; m[0][2] = 0.0f; m[0][3] = 0.0f;
+    m[1][0] = 0.0f; m[1][1] = 1.0f; m[1][2] = 0.0f; m[1][3] = 0.0f;
+    m[2][0] = 0.0f; m[2][1] = 0.0f; m[2][2] = 1.0f; m[2][3] = 0.0f;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Same rotation as _matrix44::set(angle,ax,ay,az), stored transposed.
+*/
+inline
+void
+_matrix34::set(float angle, float ax, float ay, float az)
+{
+    float c = cos(angle);
+    float s = sin(angle);
+    float t = 1.0 - c;
+
+    _vector3 a1(ax,ay,az);
+    a1.norm();
+
+    m[0][0] = c + a1.x*a1.x*t;
+    m[1][1] = c + a1.y*a1.y*t;
+    m[2][2] = c + a1.z*a1.z*t;
+    float tmp1 = a1.x*a1.y*t;
+    float tmp2 = a1.z*s;
+    m[0][1] = tmp1 - tmp2;
+    m[1][0] = tmp1 + tmp2;
+    tmp1 = a1.x*a1.z*t;
+    tmp2 = a1.y*s;
+    m[0][2] = tmp1 + tmp2;
+    m[2][0] = tmp1 - tmp2;
+    tmp1 = a1.y*a1.z*t;
+    tmp2 = a1.x*s;
+    m[1][2] = tmp1 - tmp2;
+    m[2][1] = tmp1 + tmp2;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline
+void
+_matrix34::set_translation(const _vector3& t)
+{
+    m[0][3] = t.x;
+    m[1][3] = t.y;
+    m[2][3] = t.z;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline
+_vector3
+_matrix34::get_translation() const
+{
+    return _vector3(m[0][3], m[1][3], m[2][3]);
+}
+
+//------------------------------------------------------------------------------
+/**
+    Inverts the 3x3 part by its adjugate, then the translation.
+*/
+inline
+void
+_matrix34::invert()
+{
+    float c00 = m[1][1]*m[2][2] - m[1][2]*m[2][1];
+    float c01 = m[0][2]*m[2][1] - m[0][1]*m[2][2];
+    float c02 = m[0][1]*m[1][2] - m[0][2]*m[1][1];
+    float c10 = m[1][2]*m[2][0] - m[1][0]*m[2][2];
+    float c11 = m[0][0]*m[2][2] - m[0][2]*m[2][0];
+    float c12 = m[0][2]*m[1][0] - m[0][0]*m[1][2];
+    float c20 = m[1][0]*m[2][1] - m[1][1]*m[2][0];
+    float c21 = m[0][1]*m[2][0] - m[0][0]*m[2][1];
+    float c22 = m[0][0]*m[1][1] - m[0][1]*m[1][0];
+    float d = m[0][0]*c00 + m[0][1]*c10 + m[0][2]*c20;
+    if (d == 0.0f) return;
+    d = 1.0f/d;
+    float tx = m[0][3], ty = m[1][3], tz = m[2][3];
+    m[0][0] = c00*d; m[0][1] = c01*d; m[0][2] = c02*d;
+    m[1][0] = c10*d; m[1][1] = c11*d; m[1][2] = c12*d;
+    m[2][0] = c20*d; m[2][1] = c21*d; m[2][2] = c22*d;
+    m[0][3] = -(m[0][0]*tx + m[0][1]*ty + m[0][2]*tz);
+    m[1][3] = -(m[1][0]*tx + m[1][1]*ty + m[1][2]*tz);
+    m[2][3] = -(m[2][0]*tx + m[2][1]*ty + m[2][2]*tz);
+}
+
+//------------------------------------------------------------------------------
+/**
+    Transposes the rotation and rotates the negated translation.
+*/
+inline
+void
+_matrix34::invert_simpler()
+{
+    float t;
+    t = m[0][1]; m[0][1] = m[1][0]; m[1][0] = t;
+    t = m[0][2]; m[0][2] = m[2][0]; m[2][0] = t;
+    t = m[1][2]; m[1][2] = m[2][1]; m[2][1] = t;
+    float tx = m[0][3], ty = m[1][3], tz = m[2][3];
+    m[0][3] = -(m[0][0]*tx + m[0][1]*ty + m[0][2]*tz);
+    m[1][3] = -(m[1][0]*tx + m[1][1]*ty + m[1][2]*tz);
+    m[2][3] = -(m[2][0]*tx + m[2][1]*ty + m[2][2]*tz);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline
+void
+_matrix34::mult(const _vector3& src, _vector3& dst) const
+{
+    dst.x = m[0][0]*src.x + m[0][1]*src.y + m[0][2]*src.z + m[0][3];
+    dst.y = m[1][0]*src.x + m[1][1]*src.y + m[1][2]*src.z + m[1][3];
+    dst.z = m[2][0]*src.x + m[2][1]*src.y + m[2][2]*src.z + m[2][3];
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline
+void
+_matrix34::mult_dir(const _vector3& src, _vector3& dst) const
+{
+    dst.x = m[0][0]*src.x + m[0][1]*src.y + m[0][2]*src.z;
+    dst.y = m[1][0]*src.x + m[1][1]*src.y + m[1][2]*src.z;
+    dst.z = m[2][0]*src.x + m[2][1]*src.y + m[2][2]*src.z;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline
+_matrix44
+_matrix34::get_matrix44() const
+{
+    return _matrix44(
+        m[0][0], m[1][0], m[2][0], 0.0f,
+        m[0][1], m[1][1], m[2][1], 0.0f,
+        m[0][2], m[1][2], m[2][2], 0.0f,
+        m[0][3], m[1][3], m[2][3], 1.0f);
+}
+
+//------------------------------------------------------------------------------
+/**
+    Column-major, as expected by glLoadMatrixf() / glMultMatrixf().
+*/
+inline
+void
+_matrix34::get_gl(float* ogl_mat) const
+{
+    for (int j=0; j<4; j++)
+    {
+        ogl_mat[j*4+0] = m[0][j];
+        ogl_mat[j*4+1] = m[1][j];
+        ogl_mat[j*4+2] = m[2][j];
+        ogl_mat[j*4+3] = (j == 3) ? 1.0f : 0.0f;
+    }
+}
+
+//------------------------------------------------------------------------------
+/**
+    Transform by m0 first, then by m1 (36 multiplies instead of 64).
+*/
+static
+inline
+_matrix34 operator * (const _matrix34& m0, const _matrix34& m1)
+{
+    _matrix34 m2;
+    for (int i=0; i<3; i++)
+    {
+        float a0 = m1.m[i][0];
+        float a1 = m1.m[i][1];
+        float a2 = m1.m[i][2];
+        m2.m[i][0] = a0*m0.m[0][0] + a1*m0.m[1][0] + a2*m0.m[2][0];
+        m2.m[i][1] = a0*m0.m[0][1] + a1*m0.m[1][1] + a2*m0.m[2][1];
+        m2.m[i][2] = a0*m0.m[0][2] + a1*m0.m[1][2] + a2*m0.m[2][2];
+        m2.m[i][3] = a0*m0.m[0][3] + a1*m0.m[1][3] + a2*m0.m[2][3] + m1.m[i][3];
+    }
+    return m2;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static
+inline
+_vector3 operator * (const _matrix34& m, const _vector3& v)
+{
+    return _vector3(
+        m.m[0][0]*v.x + m.m[0][1]*v.y + m.m[0][2]*v.z + m.m[0][3],
+        m.m[1][0]*v.x + m.m[1][1]*v.y + m.m[1][2]*v.z + m.m[1][3],
+        m.m[2][0]*v.x + m.m[2][1]*v.y + m.m[2][2]*v.z + m.m[2][3]);
+}
+
+//------------------------------------------------------------------------------
+#endif